@@ -26,6 +26,25 @@
 #endif /* _CRT_SECURE_NO_WARNINGS */
 #endif /* _MSC_VER */
 
+/* POSIX APIs (mmap) are used when available, define PARSON_POSIX as 0 to use only standard C */
+#ifndef PARSON_POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#define PARSON_POSIX 1
+#else
+#define PARSON_POSIX 0
+#endif
+#endif /* PARSON_POSIX */
+
+/* Parallel functions use pthreads when PARSON_THREADS is defined as 1 (program has to be linked
+   with pthreads), otherwise they run on calling thread only */
+#ifndef PARSON_THREADS
+#define PARSON_THREADS 0
+#endif /* PARSON_THREADS */
+
+#if PARSON_POSIX && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L /* pread */
+#endif
+
 #include "parson.h"
 
 #include <stdio.h>
@@ -34,6 +53,20 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#include <limits.h>
+#include <float.h>
+
+#if PARSON_POSIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if PARSON_THREADS
+#include <pthread.h>
+#endif
 
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
@@ -41,6 +74,28 @@
 
 #define STARTING_CAPACITY 16
 #define MAX_NESTING       2048
+#define SCRATCH_SIZE      256 /* strings shorter than this are decoded without touching the heap */
+#define OBJECT_INDEX_THRESHOLD 8 /* objects with more name-value pairs get a hash index */
+#define OBJECT_NOT_FOUND  ((size_t)-1)
+#define NUMBER_TEXT_SIZE  16 /* numbers shorter than this keep their text in lazy numbers mode */
+#define SEGMENT_MIN_REFERENCE 64 /* shorter runs of string bytes are copied rather than referenced */
+#define BINARY_BUFFER_SIZE 512 /* bytes staged by streaming binary writers before calling write function */
+#define BINARY_STRING_PIECE 4096 /* streamed strings are read in pieces starting at this size */
+#define MAX_SAFE_INTEGER 9007199254740992.0 /* 2^53, integers up to this are exact in a double */
+#define SNAPSHOT_MAGIC "PJSN"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 16 /* magic, version, size, root offset */
+#define SNAPSHOT_MAX_SIZE 0xffffffffUL /* offsets are 32 bit */
+#define TAPE_TAG_BITS 3
+#define LINES_BUFFER_SIZE 65536 /* bytes read at once by lines readers and batched by lines writers */
+#define PARALLEL_CHUNK_MIN 4096 /* parallel parsing splits input to chunks of about this size... */
+#define PARALLEL_CHUNK_MAX 1048576 /* ...up to this size */
+#define ARRAY_CHUNKS_PER_THREAD 8 /* parallel array parsing aims at this many chunks per thread */
+#define LINES_CHUNKS_PER_THREAD 4 /* chunks being parsed or waiting for delivery per worker thread */
+#define SERIALIZATION_CHUNKS_PER_THREAD 8 /* parallel serialization splits items to this many chunks per thread */
+
+#define TAPE_TAG(word)     ((int)((word) & ((1 << TAPE_TAG_BITS) - 1)))
+#define TAPE_PAYLOAD(word) ((word) >> TAPE_TAG_BITS)
 
 #define FLOAT_FORMAT "%1.17g" /* do not increase precision without incresing NUM_BUF_SIZE */
 #define NUM_BUF_SIZE 64 /* double printed with "%1.17g" shouldn't be longer than 25 bytes so let's be paranoid and use 64 */
@@ -49,6 +104,7 @@
 #define SKIP_CHAR(str)        ((*str)++)
 #define SKIP_WHITESPACES(str) while (isspace((unsigned char)(**str))) { SKIP_CHAR(str); }
 #define MAX(a, b)             ((a) > (b) ? (a) : (b))
+#define MIN(a, b)             ((a) < (b) ? (a) : (b))
 
 #undef malloc
 #undef free
@@ -56,41 +112,451 @@
 static JSON_Malloc_Function parson_malloc = malloc;
 static JSON_Free_Function parson_free = free;
 
+static int parson_lazy_parsing = 0;
+static int parson_lazy_numbers = 0;
+static int parson_serialization_cache = 0;
+
 #define IS_CONT(b) (((unsigned char)(b) & 0xC0) == 0x80) /* is utf-8 continuation byte */
 
 /* Type definitions */
+typedef struct json_shared_t JSON_Shared;
+typedef struct json_source_t JSON_Source;
+
+/* Reference to a value inside a read-only shared tree */
+typedef struct json_shared_ref_t {
+    JSON_Shared      *store;
+    const JSON_Value *source;
+} JSON_Shared_Ref;
+
+/* Reference to an unparsed container in a lazily parsed source */
+typedef struct json_lazy_ref_t {
+    JSON_Source *source;
+    size_t       span; /* index of container's span in source */
+} JSON_Lazy_Ref;
+
 typedef union json_value_value {
-    char        *string;
-    double       number;
-    JSON_Object *object;
-    JSON_Array  *array;
-    int          boolean;
-    int          null;
+    char           *string;
+    double          number;
+    JSON_Object    *object;
+    JSON_Array     *array;
+    int             boolean;
+    int             null;
+    JSON_Shared_Ref shared;
+    JSON_Lazy_Ref   lazy;
+    char            text[NUMBER_TEXT_SIZE];
 } JSON_Value_Value;
 
+enum json_value_storage {
+    JSONStorageOwned  = 0, /* payload is in value and owned by it */
+    JSONStorageShared = 1, /* payload is in a shared tree, see value.shared */
+    JSONStorageLazy   = 2, /* container hasn't been parsed yet, see value.lazy */
+    JSONStorageText   = 3  /* number kept as its source text, see value.text */
+};
+
 struct json_value_t {
     JSON_Value      *parent;
     JSON_Value_Type  type;
+    int              storage;
     JSON_Value_Value value;
 };
 
+/* Compiled schema is a flat array of nodes in pre-order, members of a node follow it directly */
+typedef struct json_schema_node_t {
+    JSON_Value_Type type;
+    const char     *name;      /* name in parent object, points to schema's names */
+    size_t          name_len;
+    unsigned long   name_hash;
+    size_t          count;     /* number of names in object, 1 if array has item schema */
+    size_t          size;      /* number of nodes in subtree, including this one */
+} JSON_Schema_Node;
+
+struct json_schema_t {
+    JSON_Schema_Node *nodes;
+    char             *names;
+};
+
+typedef struct json_path_segment_t {
+    const char    *name;
+    size_t         name_len;
+    unsigned long  hash;
+} JSON_Path_Segment;
+
+/* Path, its segments and names are allocated as a single block */
+struct json_path_t {
+    JSON_Path_Segment *segments;
+    size_t             count;
+};
+
+enum json_query_step_type {
+    JSONQueryMember,   /* .name, ['name'] or pointer token, which also selects array item if it's an index */
+    JSONQueryIndex,    /* [index], negative index counts from the end */
+    JSONQuerySlice,    /* [start:end:step] */
+    JSONQueryWildcard, /* .* or [*] */
+    JSONQueryFilter    /* [?(@.member op literal)] */
+};
+
+enum json_query_op {
+    JSONQueryExists,
+    JSONQueryEqual,
+    JSONQueryNotEqual,
+    JSONQueryLess,
+    JSONQueryLessOrEqual,
+    JSONQueryGreater,
+    JSONQueryGreaterOrEqual
+};
+
+typedef struct json_query_step_t {
+    int            type;
+    int            descendant; /* step preceded by "..", matched against all descendants */
+    const char    *name;
+    size_t         name_len;
+    unsigned long  hash;
+    long           index;
+    long           start;
+    long           end;
+    long           step;
+    int            has_start;
+    int            has_end;
+    int            op;
+    JSON_Path     *member;  /* filter operand relative to tested value, NULL for @ itself */
+    JSON_Value    *literal; /* filter literal compared with operand */
+} JSON_Query_Step;
+
+/* Query, its steps and names are allocated as a single block, there are at most as many steps as path has characters */
+struct json_query_t {
+    JSON_Query_Step *steps;
+    size_t           count;
+    char            *names;
+    size_t           names_used;
+};
+
+typedef struct json_query_run_t {
+    JSON_Query_Callback callback;
+    void               *arg;
+    JSON_Value        **matches;
+    size_t              max_matches;
+    size_t              count;
+    int                 first_only;
+} JSON_Query_Run;
+
+/* Byte span of a container in source text. Spans are stored in pre-order, so containers
+   nested in a span follow it directly and its next sibling is size spans further. */
+typedef struct json_span_t {
+    size_t start;
+    size_t end;  /* offset following closing bracket */
+    size_t size; /* number of containers in span, including this one */
+} JSON_Span;
+
+/* Reference counted copy of lazily parsed text, released when all its containers are parsed */
+struct json_source_t {
+    char      *text;
+    JSON_Span *spans;
+    size_t     spans_count;
+    size_t     spans_capacity;
+    size_t     refcount;
+    int        raw; /* created by json_value_init_raw, unparsed containers are serialized verbatim */
+};
+
+/* Reference counted, read-only tree created by json_value_share */
+struct json_shared_t {
+    JSON_Value *root;
+    size_t      refcount;
+};
+
+/* Serialized form of a name, cached when name is added */
+typedef struct json_object_key_t {
+    char   *escaped; /* quoted and escaped name, NULL if name is written as it is */
+    size_t  length;  /* length of serialized name including quotes, 0 if it isn't cached */
+} JSON_Object_Key;
+
 struct json_object_t {
-    JSON_Value  *wrapping_value;
-    char       **names;
-    JSON_Value **values;
-    size_t       count;
-    size_t       capacity;
+    JSON_Value      *wrapping_value;
+    char           **names;
+    JSON_Value     **values;
+    unsigned long   *hashes;        /* hash_string of each name */
+    JSON_Object_Key *keys;
+    size_t          *cells;         /* hash index (item index + 1, 0 if empty), NULL for small objects */
+    size_t           cell_capacity; /* power of 2 */
+    size_t           count;
+    size_t           capacity;
+    unsigned long    hash;          /* cached json_value_hash */
+    int              hash_valid;
+    char            *serialized;    /* cached compact serialization, NULL if there isn't one */
+    size_t           serialized_len;
 };
 
 struct json_array_t {
-    JSON_Value  *wrapping_value;
-    JSON_Value **items;
-    size_t       count;
-    size_t       capacity;
+    JSON_Value    *wrapping_value;
+    JSON_Value   **items;
+    size_t         count;
+    size_t         capacity;
+    unsigned long  hash;          /* cached json_value_hash */
+    int            hash_valid;
+    char          *serialized;    /* cached compact serialization, NULL if there isn't one */
+    size_t         serialized_len;
+};
+
+/* Tree of paths requested by projected parsing, nodes are stored in an array with root at index 0 */
+typedef struct json_projection_t {
+    const char    *name;
+    size_t         name_len;
+    unsigned long  hash;
+    int            whole;        /* whole subtree is requested */
+    size_t         first_child;  /* 0 if there are no children */
+    size_t         next_sibling; /* 0 if it's the last child */
+} JSON_Projection;
+
+/* Per-parse state. Strings and keys are decoded into scratch, which is used like a stack
+   (keys stay pushed while their values are parsed), so only exact-size copies are allocated. */
+typedef struct json_parser_t {
+    char  *scratch;
+    size_t scratch_used;
+    size_t scratch_capacity;
+    char   scratch_stack[SCRATCH_SIZE];
+} JSON_Parser;
+
+/* State of json_serialize_to_segments. Generated bytes go to scratch, adjacent ones are merged
+   into a single segment. With segments set to NULL only sizes are counted. */
+typedef struct json_segment_writer_t {
+    JSON_Segment *segments;
+    size_t        count;
+    char         *scratch;
+    size_t        scratch_len;
+    int           last_is_scratch;
+} JSON_Segment_Writer;
+
+/* Binary format output (MessagePack, CBOR), either to buf (counting only when buf is NULL) or through write_fun */
+typedef struct json_binary_writer_t {
+    unsigned char      *buf;
+    size_t              len;
+    JSON_Write_Function write_fun;
+    void               *arg;
+    size_t              staged;
+    unsigned char       stage[BINARY_BUFFER_SIZE];
+} JSON_Binary_Writer;
+
+/* Binary format input, either from data or through read_fun */
+typedef struct json_binary_reader_t {
+    const unsigned char *data;
+    size_t               size;
+    size_t               pos;
+    JSON_Read_Function   read_fun;
+    void                *arg;
+} JSON_Binary_Reader;
+
+/* Snapshot is a read-only image of a JSON value. All integers are 32 bit little-endian, every node
+   starts at a multiple of 4 with its JSON_Value_Type and is preceded by its children, which are
+   referenced by their distance to the node, so nodes can be read wherever the image is mapped.
+     null, boolean: type | boolean << 8
+     number:        type, IEEE 754 double (little-endian)
+     string:        type, length, bytes, '\0'
+     array:         type, count, count * item distance
+     object:        type, count, count * (name distance, value distance) in original order,
+                    count * entry index sorted by name (names are string nodes, shared by objects) */
+struct json_snapshot_t {
+    const unsigned char *data;
+    size_t               size;
+    int                  mapped; /* data is mmap'ed */
+    int                  owned;  /* data was allocated by json_snapshot_open */
+};
+
+/* Tape words are tagged size_t values:
+     null, true, false: tag
+     number:            tag | index in numbers
+     string:            tag | offset in strings, length
+     array, object:     tag | index of word after the container, count
+   followed by items (objects' items are name string and value). */
+enum json_tape_tag {
+    TapeNull   = 0,
+    TapeTrue   = 1,
+    TapeFalse  = 2,
+    TapeNumber = 3,
+    TapeString = 4,
+    TapeArray  = 5,
+    TapeObject = 6
+};
+
+struct json_tape_t {
+    size_t *words;
+    size_t  words_count;
+    size_t  words_capacity;
+    double *numbers;
+    size_t  numbers_count;
+    size_t  numbers_capacity;
+    char   *strings; /* decoded strings, each followed by '\0' */
+};
+
+struct json_lines_t {
+    JSON_Parser        parser; /* reused for all lines */
+    const char        *string; /* string being read, NULL when reading with read_fun */
+    char              *buf;
+    size_t             buf_len;
+    size_t             buf_pos;
+    size_t             buf_scanned; /* bytes after buf_pos known not to contain a newline */
+    size_t             buf_capacity;
+    JSON_Read_Function read_fun;
+    void              *arg;
+    FILE              *fp;
+    int                fd;
+    int                eof;
+    int                skip_errors;
+    size_t             line;
+    size_t             error_line;
+    size_t             error_count;
+};
+
+struct json_lines_writer_t {
+    char               *buf;
+    size_t              buf_len;
+    size_t              buf_capacity;
+    JSON_Write_Function write_fun;
+    void               *arg;
+    FILE               *fp;
+    int                 fd;
+    JSON_Status         status; /* first failure is kept until close */
+};
+
+#if PARSON_THREADS
+typedef struct json_lines_item_t {
+    JSON_Value *value; /* NULL for bad lines */
+    size_t      line;  /* in chunk, from 0 */
+} JSON_Lines_Item;
+
+enum json_lines_chunk_state {
+    ChunkFree = 0,
+    ChunkClaimed,
+    ChunkCounted, /* number of lines is known */
+    ChunkParsed,
+    ChunkDelivered
+};
+
+typedef struct json_lines_chunk_t {
+    const char      *start;
+    const char      *end;
+    size_t           lines;
+    size_t           first_line; /* set when all previous chunks are counted */
+    JSON_Lines_Item *items;
+    size_t           items_count;
+    size_t           items_capacity;
+    JSON_Status      status; /* failure if items couldn't be stored */
+    int              state;
+} JSON_Lines_Chunk;
+
+/* Chunk i is kept in chunks[i % window], workers claim chunks only while there is a free slot, so
+   at most window chunks are parsed or wait for delivery at once. All fields are guarded by mutex. */
+typedef struct json_lines_job_t {
+    const char       *next; /* start of the next chunk */
+    const char       *end;
+    size_t            chunk_size;
+    JSON_Lines_Chunk *chunks;
+    size_t            window;
+    size_t            claimed;
+    size_t            counted;   /* chunks before this one have first_line */
+    size_t            delivered; /* chunks before this one are delivered */
+    size_t            lines;     /* lines in counted chunks */
+    int               stop;
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+} JSON_Lines_Job;
+
+typedef struct json_array_chunk_t {
+    const char *start;
+    const char *end;   /* comma after the last item or closing bracket */
+    JSON_Value *items; /* array with parsed items */
+} JSON_Array_Chunk;
+
+/* Chunks are found by calling thread while workers parse ones found earlier, chunks array is big
+   enough for all of them, so it never moves. All fields are guarded by mutex. */
+typedef struct json_array_job_t {
+    JSON_Array_Chunk *chunks;
+    size_t            chunks_count; /* found so far */
+    size_t            next;         /* next chunk to parse */
+    int               scanned;      /* all chunks were found */
+    int               failed;
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+} JSON_Array_Job;
+
+/* Inputs not yet taken by a worker are inputs[next] to inputs[end - 1] */
+typedef struct json_batch_range_t {
+    size_t          next;
+    size_t          end;
+    pthread_mutex_t mutex;
+} JSON_Batch_Range;
+
+/* Every worker has a range of inputs, workers whose range is empty steal half of another one */
+typedef struct json_batch_job_t {
+    const JSON_Input *inputs;
+    JSON_Value      **results;
+    size_t            count;
+    JSON_Batch_Range *ranges;
+    size_t            workers;
+} JSON_Batch_Job;
+
+typedef struct json_batch_worker_t {
+    JSON_Batch_Job *job;
+    size_t          index;
+} JSON_Batch_Worker;
+
+typedef struct json_serialization_chunk_t {
+    size_t begin;    /* first item */
+    size_t end;      /* item after the last one */
+    size_t offset;   /* position in output */
+    int    size;     /* -1 if serialization failed */
+    int    deferred; /* items have lazy values, so chunk is sized by calling thread */
+} JSON_Serialization_Chunk;
+
+/* Chunks are sized by all threads first, then written by all threads after calling thread
+   allocated output and computed their offsets. Only next is shared while threads run. */
+typedef struct json_serialization_job_t {
+    const JSON_Value         *value; /* view of root array or object */
+    int                       is_pretty;
+    char                     *output; /* NULL while chunks are sized */
+    JSON_Serialization_Chunk *chunks;
+    size_t                    chunks_count;
+    size_t                    next;   /* guarded by mutex */
+    pthread_mutex_t           mutex;
+} JSON_Serialization_Job;
+#endif
+
+/* Request of a loader, either with callback (freed after calling it) or a handle returned by
+   json_loader_load (kept in loader's list of handles until json_load_get) */
+struct json_load_t {
+    JSON_Loader       *loader;
+    char              *filename;
+    JSON_Load_Callback callback;
+    void              *arg;
+    JSON_Value        *value;
+    int                done;
+    struct json_load_t *queue_next; /* next request waiting for a worker */
+    struct json_load_t *prev;       /* handles not yet collected */
+    struct json_load_t *next;
+};
+
+struct json_loader_t {
+    JSON_Load *queue;
+    JSON_Load *queue_tail;
+    JSON_Load *loads; /* handles not yet collected */
+    size_t     threads_count; /* 0 if requests are loaded on calling thread */
+#if PARSON_THREADS
+    int              stop;
+    pthread_t       *threads;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   cond;      /* signals new requests */
+    pthread_cond_t   done_cond; /* signals finished handles */
+#endif
 };
 
+typedef struct json_snapshot_entry_t {
+    const char *name;
+    size_t      index;
+} JSON_Snapshot_Entry;
+
 /* Various */
 static char * read_file(const char *filename);
+#if PARSON_POSIX
+static char * read_fd(int fd);
+#endif
 static void   remove_comments(char *string, const char *start_token, const char *end_token);
 static char * parson_strndup(const char *string, size_t n);
 static char * parson_strdup(const char *string);
@@ -100,13 +566,24 @@ static int    num_bytes_in_utf8_sequence(unsigned char c);
 static int    verify_utf8_sequence(const unsigned char *string, int *len);
 static int    is_valid_utf8(const char *string, size_t string_len);
 static int    is_decimal(const char *string, size_t length);
+static size_t scan_number(const char *string, int *has_exponent, int *is_strict);
+static unsigned long hash_string(const char *string, size_t n);
 
 /* JSON Object */
 static JSON_Object * json_object_init(JSON_Value *wrapping_value);
 static JSON_Status   json_object_add(JSON_Object *object, const char *name, JSON_Value *value);
 static JSON_Status   json_object_addn(JSON_Object *object, const char *name, size_t name_len, JSON_Value *value);
+static JSON_Status   json_object_addn_unchecked(JSON_Object *object, const char *name, size_t name_len, unsigned long hash, JSON_Value *value);
+static JSON_Status   json_object_setn_value(JSON_Object *object, const char *name, size_t name_len, unsigned long hash, JSON_Value *value);
+static void          json_object_push(JSON_Object *object, char *name, unsigned long hash, const JSON_Object_Key *key, JSON_Value *value);
+static void          json_object_key_init(JSON_Object_Key *key, const char *name);
 static JSON_Status   json_object_resize(JSON_Object *object, size_t new_capacity);
+static size_t        json_object_find(const JSON_Object *object, const char *name, size_t name_len, unsigned long hash);
 static JSON_Value  * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len);
+static void          json_object_index_rebuild(JSON_Object *object);
+static void          json_object_index_insert(JSON_Object *object, size_t index);
+static size_t        json_object_index_cell(const JSON_Object *object, size_t index);
+static void          json_object_index_remove(JSON_Object *object, size_t index);
 static JSON_Status   json_object_remove_internal(JSON_Object *object, const char *name, int free_value);
 static JSON_Status   json_object_dotremove_internal(JSON_Object *object, const char *name, int free_value);
 static void          json_object_free(JSON_Object *object);
@@ -118,26 +595,198 @@ static JSON_Status  json_array_resize(JSON_Array *array, size_t new_capacity);
 static void         json_array_free(JSON_Array *array);
 
 /* JSON Value */
-static JSON_Value * json_value_init_string_no_copy(char *string);
+static JSON_Value *       json_value_init_string_no_copy(char *string);
+static JSON_Value *       json_value_init_shared(JSON_Shared *store, const JSON_Value *source);
+static const JSON_Value * json_value_view(const JSON_Value *value);
+static JSON_Status        json_value_unshare(JSON_Value *value);
+static void               json_shared_release(JSON_Shared *store);
+static void               json_value_invalidate(JSON_Value *value);
+static JSON_Value *       json_value_init_lazy(JSON_Source *source, size_t span);
+static JSON_Value *       json_value_init_number_text(const char *text, size_t len);
+static JSON_Status        json_value_expand(JSON_Value *value);
+static JSON_Source *      json_source_init(const char *text, size_t len);
+static void               json_source_release(JSON_Source *source);
+static const char *       json_value_raw_text(const JSON_Value *value, size_t *len);
 
 /* Parser */
+static void         parser_init(JSON_Parser *parser);
+static void         parser_deinit(JSON_Parser *parser);
+static JSON_Status  parser_reserve(JSON_Parser *parser, size_t size);
 static JSON_Status  skip_quotes(const char **string);
 static int          parse_utf16(const char **unprocessed, char **processed);
-static char *       process_string(const char *input, size_t len);
-static char *       get_quoted_string(const char **string);
-static JSON_Value * parse_object_value(const char **string, size_t nesting);
-static JSON_Value * parse_array_value(const char **string, size_t nesting);
-static JSON_Value * parse_string_value(const char **string);
+static JSON_Status  process_string(JSON_Parser *parser, const char *input, size_t len, size_t *output_len);
+static JSON_Status  get_quoted_string(JSON_Parser *parser, const char **string, size_t *output_len);
+static JSON_Value * parse_object_value(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Schema_Node *schema);
+static JSON_Value * parse_array_value(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Schema_Node *schema);
+static JSON_Value * parse_string_value(JSON_Parser *parser, const char **string);
 static JSON_Value * parse_boolean_value(const char **string);
 static JSON_Value * parse_number_value(const char **string);
 static JSON_Value * parse_null_value(const char **string);
-static JSON_Value * parse_value(const char **string, size_t nesting);
+static JSON_Value * parse_value(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Schema_Node *schema);
+static JSON_Value * parse_root_value(const char *string, const JSON_Schema_Node *schema);
+static JSON_Status  lazy_scan_value(JSON_Parser *parser, const char **string, size_t nesting, JSON_Source *source);
+static int          lazy_compare_keys(const void *a, const void *b);
+static JSON_Status  lazy_check_keys(const char *keys, size_t count);
+static JSON_Value * parse_lazy_item(JSON_Parser *parser, const char **string, JSON_Source *source, size_t *next_span);
+static JSON_Value * parse_lazy_root_value(const char *string);
+static JSON_Status  skip_value(const char **string);
+static JSON_Value * parse_projected_object(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Projection *projection, const JSON_Projection *node);
+static int          schema_accepts(const JSON_Schema_Node *schema, JSON_Value_Type type);
+static const JSON_Schema_Node * schema_get_member(const JSON_Schema_Node *schema, const char *name, size_t name_len);
+
+/* Projection */
+static JSON_Projection *       projection_build(const char **paths, size_t paths_count);
+static const JSON_Projection * projection_get_member(const JSON_Projection *projection, const JSON_Projection *node, const char *name, size_t name_len);
+
+/* Schema */
+static void               json_schema_measure(const JSON_Value *schema, size_t *nodes_count, size_t *names_size);
+static JSON_Schema_Node * json_schema_fill(const JSON_Value *schema, JSON_Schema_Node *node, char **names_ptr);
+static JSON_Status        json_schema_run_r(const JSON_Schema_Node *node, const JSON_Value *value);
+
+/* Query */
+static JSON_Query *      json_query_alloc(size_t path_len);
+static JSON_Query_Step * json_query_add_step(JSON_Query *query, int type);
+static void              json_query_set_name(JSON_Query *query, JSON_Query_Step *step, const char *name, size_t name_len);
+static long              json_query_pointer_index(const char *token, size_t len);
+static int               json_query_parse_long(const char **string, long *result);
+static JSON_Status       json_query_parse_quoted(JSON_Query *query, const char **string, const char **name, size_t *name_len);
+static JSON_Status       json_query_parse_filter(JSON_Query *query, JSON_Query_Step *step, const char **string);
+static JSON_Status       json_query_parse_bracket(JSON_Query *query, JSON_Query_Step *step, const char **string);
+static int               json_query_filter_matches(const JSON_Query_Step *step, const JSON_Value *value);
+static JSON_Status       json_query_deliver(JSON_Query_Run *run, JSON_Value *match);
+static JSON_Status       json_query_select(const JSON_Query *query, size_t i, JSON_Value *value, JSON_Query_Run *run);
+static JSON_Status       json_query_apply(const JSON_Query *query, size_t i, JSON_Value *value, JSON_Query_Run *run);
+
+/* Binary formats */
+static int          host_is_little_endian(void);
+static JSON_Status  binary_put(JSON_Binary_Writer *writer, const void *data, size_t len);
+static JSON_Status  binary_flush(JSON_Binary_Writer *writer);
+static int          split_integer(double number, unsigned long *high, unsigned long *low);
+static int          binary_is_integer(const JSON_Value *value, int use_text);
+static JSON_Status  binary_put_integer(JSON_Binary_Writer *writer, unsigned char tag, unsigned long high, unsigned long low, size_t width, int complement);
+static JSON_Status  binary_put_float(JSON_Binary_Writer *writer, unsigned char tag, double number, size_t bytes);
+static JSON_Status  binary_get(JSON_Binary_Reader *reader, void *data, size_t len);
+static JSON_Status  binary_get_uint(JSON_Binary_Reader *reader, size_t bytes, double *result);
+static JSON_Status  binary_get_float(JSON_Binary_Reader *reader, size_t bytes, double *result);
+static char *       binary_get_string(JSON_Binary_Reader *reader, size_t len);
+static JSON_Value * binary_number_value(double number, int is_float);
+
+/* MessagePack */
+static JSON_Status  msgpack_put_header(JSON_Binary_Writer *writer, unsigned char tag, size_t value, size_t bytes);
+static JSON_Status  msgpack_put_sized(JSON_Binary_Writer *writer, unsigned char fix_tag, size_t fix_max, unsigned char tag8, unsigned char tag16, size_t size);
+static JSON_Status  msgpack_put_number(JSON_Binary_Writer *writer, const JSON_Value *value);
+static JSON_Status  msgpack_put_string(JSON_Binary_Writer *writer, const char *string);
+static JSON_Status  msgpack_write_value(JSON_Binary_Writer *writer, const JSON_Value *value);
+static JSON_Status  msgpack_get_int(JSON_Binary_Reader *reader, size_t bytes, double *result);
+static JSON_Value * msgpack_read_value(JSON_Binary_Reader *reader, size_t nesting);
+
+/* CBOR */
+static JSON_Status  cbor_put_header(JSON_Binary_Writer *writer, unsigned char major, unsigned long high, unsigned long low);
+static int          cbor_half_bits(double number, unsigned int *bits);
+static JSON_Status  cbor_put_number(JSON_Binary_Writer *writer, const JSON_Value *value, int canonical);
+static int          cbor_compare_names(const void *a, const void *b);
+static JSON_Status  cbor_put_string(JSON_Binary_Writer *writer, const char *string);
+static JSON_Status  cbor_put_object(JSON_Binary_Writer *writer, const JSON_Object *object, int canonical);
+static JSON_Status  cbor_write_value(JSON_Binary_Writer *writer, const JSON_Value *value, int canonical);
+static unsigned char * cbor_encode(const JSON_Value *value, size_t *size, int canonical);
+static JSON_Status  cbor_get_argument(JSON_Binary_Reader *reader, unsigned char initial, double *result);
+static double       cbor_half_value(unsigned int bits);
+static char *       cbor_get_chunked_string(JSON_Binary_Reader *reader);
+static JSON_Value * cbor_read_item(JSON_Binary_Reader *reader, unsigned char initial, size_t nesting);
+static JSON_Value * cbor_read_value(JSON_Binary_Reader *reader, size_t nesting);
+
+/* Snapshot */
+static unsigned long   snapshot_get_u32(const unsigned char *bytes);
+static JSON_Status     snapshot_put_u32(JSON_Binary_Writer *writer, size_t value);
+static JSON_Status     snapshot_file_write(const void *data, size_t size, void *arg);
+static JSON_Status     snapshot_put_string(JSON_Binary_Writer *writer, const char *string, size_t *offset);
+static JSON_Status     snapshot_put_name(JSON_Binary_Writer *writer, JSON_Object *names, const char *name, size_t *offset);
+static int             snapshot_compare_entries(const void *a, const void *b);
+static JSON_Status     snapshot_put_object(JSON_Binary_Writer *writer, JSON_Object *names, const JSON_Object *object, size_t *offset);
+static JSON_Status     snapshot_put_value(JSON_Binary_Writer *writer, JSON_Object *names, const JSON_Value *value, size_t *offset);
+static const unsigned char * snapshot_child(const unsigned char *node, size_t field);
+static int             snapshot_compare_name(const unsigned char *name_node, const char *name, size_t name_len);
+static JSON_Status     snapshot_validate(const JSON_Snapshot *snapshot, unsigned char *checked, size_t offset, size_t nesting);
+static const JSON_Snapshot_Value * snapshot_getn_value(const JSON_Snapshot_Value *object, const char *name, size_t name_len);
+static JSON_Snapshot * snapshot_init(const unsigned char *data, size_t size);
+
+/* Tape */
+static JSON_Status   tape_push(JSON_Tape *tape, size_t word);
+static JSON_Status   tape_push_number(JSON_Tape *tape, double number);
+static JSON_Status   tape_push_string(JSON_Tape *tape, JSON_Parser *parser, const char **string);
+static JSON_Status   tape_parse_value(JSON_Tape *tape, JSON_Parser *parser, const char **string, size_t nesting);
+static size_t        tape_next(const JSON_Tape *tape, size_t index);
+static JSON_Cursor   tape_cursor(const JSON_Tape *tape, size_t index, size_t name, size_t end);
+static JSON_Cursor   tape_getn_value(JSON_Cursor object, const char *name, size_t name_len);
+
+/* Lines */
+static JSON_Lines *         lines_init(void);
+static size_t               lines_file_read(void *buf, size_t size, void *arg);
+static JSON_Status          lines_file_write(const void *data, size_t size, void *arg);
+#if PARSON_POSIX
+static size_t               lines_fd_read(void *buf, size_t size, void *arg);
+static JSON_Status          lines_fd_write(const void *data, size_t size, void *arg);
+#endif
+static const char *         lines_next_line(JSON_Lines *lines, const char **line_end);
+static JSON_Lines_Writer *  lines_writer_init(JSON_Write_Function write_fun, void *arg);
+static int                  lines_value_ends(const char *string, const char *line_end);
+static JSON_Status          lines_parse_line(JSON_Parser *parser, const char *string, const char *line_end, JSON_Value **value);
+static JSON_Status          lines_parse_sequential(const char *string, JSON_Lines_Callback callback, void *arg);
+static size_t               threads_get_count(size_t requested);
+#if PARSON_THREADS
+static const char *         lines_chunk_end(const char *start, const char *end, size_t chunk_size);
+static size_t               lines_count(const char *start, const char *end);
+static void                 lines_parse_chunk(JSON_Parser *parser, JSON_Lines_Chunk *chunk);
+static void *               lines_worker(void *arg);
+static JSON_Status          lines_deliver(JSON_Lines_Job *job, int ordered, JSON_Lines_Callback callback, void *arg);
+static void                 array_publish(JSON_Array_Job *job, const char *start, const char *end);
+static const char *         array_scan(JSON_Array_Job *job, const char *string, size_t chunk_size);
+static JSON_Status          array_parse_chunk(JSON_Parser *parser, JSON_Array_Chunk *chunk);
+static void *               array_worker(void *arg);
+static JSON_Value *         array_parse_parallel(const char *string, size_t threads_count);
+#endif
+
+/* Batch */
+static JSON_Value * batch_parse_input(JSON_Parser *parser, const JSON_Input *input);
+static void         batch_prefetch(const JSON_Input *input);
+#if PARSON_THREADS
+static int          batch_take(JSON_Batch_Job *job, size_t worker, size_t *index, size_t *prefetch);
+static void *       batch_worker(void *arg);
+#endif
+
+/* Loader */
+static char *       loader_read_file(const char *filename);
+static JSON_Value * loader_parse_file(JSON_Parser *parser, const char *filename);
+static JSON_Load *  loader_request(JSON_Loader *loader, const char *filename, JSON_Load_Callback callback, void *arg);
+static void         loader_finish(JSON_Loader *loader, JSON_Parser *parser, JSON_Load *load);
+static void         loader_free_load(JSON_Load *load);
+#if PARSON_THREADS
+static void *       loader_worker(void *arg);
+#endif
 
 /* Serialization */
 static int    json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty, char *num_buf);
+static int    json_serialize_items_r(const JSON_Value *value, size_t begin, size_t end, char *buf, int level, int is_pretty, char *num_buf);
 static int    json_serialize_string(const char *string, char *buf);
+static int    json_serialize_chars(const char *string, size_t len, char *buf);
+static int    json_serialize_to_segments_r(const JSON_Value *value, JSON_Segment_Writer *writer, char *num_buf);
+static int    json_serialize_string_segments(const char *string, size_t len, JSON_Segment_Writer *writer);
+static char * segments_scratch_end(const JSON_Segment_Writer *writer);
+static void   segments_add_scratch(JSON_Segment_Writer *writer, int len);
+static int    segments_add_text(JSON_Segment_Writer *writer, const char *text);
+static void   segments_add_reference(JSON_Segment_Writer *writer, const char *data, size_t len);
 static int    append_indent(char *buf, int level);
 static int    append_string(char *buf, const char *string);
+static int    append_raw(char *buf, const char *text, size_t len);
+static int    append_key(char *buf, const JSON_Object *object, size_t index);
+static void   serialization_cache_store(char **cache, size_t *cache_len, const char *serialized, int len);
+#if PARSON_THREADS
+static const JSON_Value * serialization_root(const JSON_Value *value);
+static int    serialization_is_expanded(const JSON_Value *value);
+static void * serialization_worker(void *arg);
+static void   serialization_run(JSON_Serialization_Job *job, pthread_t *threads, size_t threads_count);
+static char * serialization_parallel(const JSON_Value *value, int is_pretty, size_t threads_count);
+#endif
 
 /* Various */
 static char * parson_strndup(const char *string, size_t n) {
@@ -265,6 +914,60 @@ static int is_decimal(const char *string, size_t length) {
     return 1;
 }
 
+/* Returns length of number at the start of string (like strtod, but without hex, inf and nan)
+   or 0 if there isn't one. Numbers without exponent that are this short can't overflow.
+   is_strict is set if number also has JSON's form, with digits on both sides of '.' (not 1. or .5). */
+static size_t scan_number(const char *string, int *has_exponent, int *is_strict) {
+    const char *p = string, *exponent = NULL;
+    size_t digits = 0, fraction_digits = 0;
+    *has_exponent = 0;
+    if (*p == '-') {
+        p++;
+    }
+    while (isdigit((unsigned char)*p)) {
+        p++;
+        digits++;
+    }
+    *is_strict = digits > 0;
+    if (*p == '.') {
+        p++;
+        while (isdigit((unsigned char)*p)) {
+            p++;
+            fraction_digits++;
+        }
+        *is_strict = *is_strict && fraction_digits > 0;
+        digits += fraction_digits;
+    }
+    if (digits == 0) {
+        return 0;
+    }
+    if (*p == 'e' || *p == 'E') {
+        exponent = p + 1;
+        if (*exponent == '+' || *exponent == '-') {
+            exponent++;
+        }
+        if (isdigit((unsigned char)*exponent)) { /* otherwise exponent isn't part of the number */
+            p = exponent;
+            while (isdigit((unsigned char)*p)) {
+                p++;
+            }
+            *has_exponent = 1;
+        }
+    }
+    return (size_t)(p - string);
+}
+
+static unsigned long hash_string(const char *string, size_t n) { /* djb2 */
+    unsigned long hash = 5381;
+    unsigned char c;
+    size_t i = 0;
+    for (i = 0; i < n; i++) {
+        c = (unsigned char)string[i];
+        hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    }
+    return hash;
+}
+
 static char * read_file(const char * filename) {
     FILE *fp = fopen(filename, "r");
     size_t size_to_read = 0;
@@ -297,6 +1000,50 @@ static char * read_file(const char * filename) {
     file_contents[size_read] = '\0';
     return file_contents;
 }
+#if PARSON_POSIX
+/* Reads fd until end of input, like read_file the result is null-terminated */
+static char * read_fd(int fd) {
+    struct stat info;
+    char *contents = NULL, *new_contents = NULL;
+    size_t size = 0, capacity = 4096;
+    ssize_t result = 0;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        capacity = (size_t)info.st_size + 1;
+    }
+    contents = (char*)parson_malloc(capacity);
+    if (contents == NULL) {
+        return NULL;
+    }
+    for (;;) {
+        if (size + 1 == capacity) {
+            new_contents = (char*)parson_malloc(capacity * 2);
+            if (new_contents == NULL) {
+                parson_free(contents);
+                return NULL;
+            }
+            memcpy(new_contents, contents, size);
+            parson_free(contents);
+            contents = new_contents;
+            capacity *= 2;
+        }
+        result = read(fd, contents + size, capacity - size - 1);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            parson_free(contents);
+            return NULL;
+        }
+        if (result == 0) {
+            break;
+        }
+        size += (size_t)result;
+    }
+    contents[size] = '\0';
+    return contents;
+}
+#endif
+
 
 static void remove_comments(char *string, const char *start_token, const char *end_token) {
     int in_string = 0, escaped = 0;
@@ -342,8 +1089,16 @@ static JSON_Object * json_object_init(JSON_Value *wrapping_value) {
     new_obj->wrapping_value = wrapping_value;
     new_obj->names = (char**)NULL;
     new_obj->values = (JSON_Value**)NULL;
+    new_obj->hashes = (unsigned long*)NULL;
+    new_obj->keys = (JSON_Object_Key*)NULL;
+    new_obj->cells = (size_t*)NULL;
+    new_obj->cell_capacity = 0;
     new_obj->capacity = 0;
     new_obj->count = 0;
+    new_obj->hash = 0;
+    new_obj->hash_valid = 0;
+    new_obj->serialized = NULL;
+    new_obj->serialized_len = 0;
     return new_obj;
 }
 
@@ -355,33 +1110,93 @@ static JSON_Status json_object_add(JSON_Object *object, const char *name, JSON_V
 }
 
 static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_t name_len, JSON_Value *value) {
-    size_t index = 0;
+    unsigned long hash = 0;
     if (object == NULL || name == NULL || value == NULL) {
         return JSONFailure;
     }
-    if (json_object_getn_value(object, name, name_len) != NULL) {
+    hash = hash_string(name, name_len);
+    if (json_object_find(object, name, name_len, hash) != OBJECT_NOT_FOUND) {
         return JSONFailure;
     }
+    return json_object_addn_unchecked(object, name, name_len, hash, value);
+}
+
+/* Adds name-value pair without checking if name is already used, hash has to be hash_string(name, name_len) */
+static JSON_Status json_object_addn_unchecked(JSON_Object *object, const char *name, size_t name_len, unsigned long hash, JSON_Value *value) {
+    char *name_copy = NULL;
     if (object->count >= object->capacity) {
         size_t new_capacity = MAX(object->capacity * 2, STARTING_CAPACITY);
         if (json_object_resize(object, new_capacity) == JSONFailure) {
             return JSONFailure;
         }
     }
-    index = object->count;
-    object->names[index] = parson_strndup(name, name_len);
-    if (object->names[index] == NULL) {
+    name_copy = parson_strndup(name, name_len);
+    if (name_copy == NULL) {
         return JSONFailure;
     }
-    value->parent = json_object_get_wrapping_value(object);
+    json_object_push(object, name_copy, hash, NULL, value);
+    return JSONSuccess;
+}
+
+/* Appends name-value pair taking ownership of name and its cached key (computed if key is NULL),
+   capacity has to be reserved before */
+static void json_object_push(JSON_Object *object, char *name, unsigned long hash, const JSON_Object_Key *key, JSON_Value *value) {
+    size_t index = object->count;
+    object->names[index] = name;
+    object->hashes[index] = hash;
+    if (key != NULL) {
+        object->keys[index] = *key;
+    } else {
+        json_object_key_init(&object->keys[index], name);
+    }
     object->values[index] = value;
     object->count++;
+    value->parent = json_object_get_wrapping_value(object);
+    if (object->cells != NULL && object->count * 2 <= object->cell_capacity) {
+        json_object_index_insert(object, index);
+    } else if (object->count > OBJECT_INDEX_THRESHOLD) {
+        json_object_index_rebuild(object);
+    }
+}
+
+/* Caches serialized name, so it's written with a single copy. Names that don't need escaping
+   aren't copied, cache is left empty if it can't be allocated. */
+static void json_object_key_init(JSON_Object_Key *key, const char *name) {
+    int length = json_serialize_string(name, NULL);
+    key->escaped = NULL;
+    key->length = 0;
+    if (length < 0) {
+        return;
+    }
+    if ((size_t)length != strlen(name) + 2) { /* escaping makes name longer */
+        key->escaped = (char*)parson_malloc((size_t)length + 1);
+        if (key->escaped == NULL) {
+            return;
+        }
+        json_serialize_string(name, key->escaped);
+    }
+    key->length = (size_t)length;
+}
+
+/* Frees and replaces value with given name or adds new name-value pair, hash has to be hash_string(name, name_len) */
+static JSON_Status json_object_setn_value(JSON_Object *object, const char *name, size_t name_len, unsigned long hash, JSON_Value *value) {
+    size_t i = json_object_find(object, name, name_len, hash);
+    if (i != OBJECT_NOT_FOUND) { /* free and overwrite old value */
+        json_value_free(object->values[i]);
+        value->parent = json_object_get_wrapping_value(object);
+        object->values[i] = value;
+    } else if (json_object_addn_unchecked(object, name, name_len, hash, value) == JSONFailure) {
+        return JSONFailure;
+    }
+    json_value_invalidate(value->parent);
     return JSONSuccess;
 }
 
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity) {
     char **temp_names = NULL;
     JSON_Value **temp_values = NULL;
+    unsigned long *temp_hashes = NULL;
+    JSON_Object_Key *temp_keys = NULL;
 
     if ((object->names == NULL && object->values != NULL) ||
         (object->names != NULL && object->values == NULL) ||
@@ -397,53 +1212,160 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
         parson_free(temp_names);
         return JSONFailure;
     }
+    temp_hashes = (unsigned long*)parson_malloc(new_capacity * sizeof(unsigned long));
+    if (temp_hashes == NULL) {
+        parson_free(temp_names);
+        parson_free(temp_values);
+        return JSONFailure;
+    }
+    temp_keys = (JSON_Object_Key*)parson_malloc(new_capacity * sizeof(JSON_Object_Key));
+    if (temp_keys == NULL) {
+        parson_free(temp_names);
+        parson_free(temp_values);
+        parson_free(temp_hashes);
+        return JSONFailure;
+    }
     if (object->names != NULL && object->values != NULL && object->count > 0) {
         memcpy(temp_names, object->names, object->count * sizeof(char*));
         memcpy(temp_values, object->values, object->count * sizeof(JSON_Value*));
+        memcpy(temp_hashes, object->hashes, object->count * sizeof(unsigned long));
+        memcpy(temp_keys, object->keys, object->count * sizeof(JSON_Object_Key));
     }
     parson_free(object->names);
     parson_free(object->values);
+    parson_free(object->hashes);
+    parson_free(object->keys);
     object->names = temp_names;
     object->values = temp_values;
+    object->hashes = temp_hashes;
+    object->keys = temp_keys;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
 
+/* Returns index of name-value pair or OBJECT_NOT_FOUND, hash has to be hash_string(name, name_len) */
+static size_t json_object_find(const JSON_Object *object, const char *name, size_t name_len, unsigned long hash) {
+    size_t i = 0, cell = 0, mask = 0;
+    if (object == NULL) {
+        return OBJECT_NOT_FOUND;
+    }
+    if (object->cells == NULL) {
+        for (i = 0; i < object->count; i++) {
+            if (object->hashes[i] == hash && strncmp(object->names[i], name, name_len) == 0 &&
+                object->names[i][name_len] == '\0') {
+                return i;
+            }
+        }
+        return OBJECT_NOT_FOUND;
+    }
+    mask = object->cell_capacity - 1;
+    for (cell = hash & mask; object->cells[cell] != 0; cell = (cell + 1) & mask) {
+        i = object->cells[cell] - 1;
+        if (object->hashes[i] == hash && strncmp(object->names[i], name, name_len) == 0 &&
+            object->names[i][name_len] == '\0') {
+            return i;
+        }
+    }
+    return OBJECT_NOT_FOUND;
+}
+
 static JSON_Value * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len) {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != name_len) {
-            continue;
+    size_t index = json_object_find(object, name, name_len, hash_string(name, name_len));
+    return index == OBJECT_NOT_FOUND ? NULL : object->values[index];
+}
+
+/* Rebuilds hash index, so that it's at most half full. Index only speeds up lookups,
+   so if it can't be allocated object falls back to comparing all hashes. */
+static void json_object_index_rebuild(JSON_Object *object) {
+    size_t i = 0, cell_capacity = 2 * OBJECT_INDEX_THRESHOLD;
+    while (cell_capacity < object->count * 2) {
+        cell_capacity *= 2;
+    }
+    parson_free(object->cells);
+    object->cells = (size_t*)parson_malloc(cell_capacity * sizeof(size_t));
+    if (object->cells == NULL) {
+        object->cell_capacity = 0;
+        return;
+    }
+    object->cell_capacity = cell_capacity;
+    for (i = 0; i < cell_capacity; i++) {
+        object->cells[i] = 0;
+    }
+    for (i = 0; i < object->count; i++) {
+        json_object_index_insert(object, i);
+    }
+}
+
+static void json_object_index_insert(JSON_Object *object, size_t index) {
+    size_t mask = object->cell_capacity - 1;
+    size_t cell = object->hashes[index] & mask;
+    while (object->cells[cell] != 0) {
+        cell = (cell + 1) & mask;
+    }
+    object->cells[cell] = index + 1;
+}
+
+static size_t json_object_index_cell(const JSON_Object *object, size_t index) {
+    size_t mask = object->cell_capacity - 1;
+    size_t cell = object->hashes[index] & mask;
+    while (object->cells[cell] != index + 1) {
+        cell = (cell + 1) & mask;
+    }
+    return cell;
+}
+
+/* Removes item from index, following entries are shifted back to keep probe sequences unbroken */
+static void json_object_index_remove(JSON_Object *object, size_t index) {
+    size_t mask = object->cell_capacity - 1;
+    size_t hole = json_object_index_cell(object, index);
+    size_t cell = hole, home = 0;
+    for (;;) {
+        cell = (cell + 1) & mask;
+        if (object->cells[cell] == 0) {
+            break;
         }
-        if (strncmp(object->names[i], name, name_len) == 0) {
-            return object->values[i];
+        home = object->hashes[object->cells[cell] - 1] & mask;
+        /* entry can be moved to hole if its home isn't cyclically in (hole, cell] */
+        if ((cell > hole && (home <= hole || home > cell)) ||
+            (cell < hole && (home <= hole && home > cell))) {
+            object->cells[hole] = object->cells[cell];
+            hole = cell;
         }
     }
-    return NULL;
+    object->cells[hole] = 0;
 }
 
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name, int free_value) {
-    size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL) {
+    size_t i = 0, last_item_index = 0, name_len = 0;
+    if (object == NULL || name == NULL) {
+        return JSONFailure;
+    }
+    name_len = strlen(name);
+    i = json_object_find(object, name, name_len, hash_string(name, name_len));
+    if (i == OBJECT_NOT_FOUND) {
         return JSONFailure;
     }
     last_item_index = json_object_get_count(object) - 1;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        if (strcmp(object->names[i], name) == 0) {
-            parson_free(object->names[i]);
-            if (free_value) {
-                json_value_free(object->values[i]);
-            }
-            if (i != last_item_index) { /* Replace key value pair with one from the end */
-                object->names[i] = object->names[last_item_index];
-                object->values[i] = object->values[last_item_index];
-            }
-            object->count -= 1;
-            return JSONSuccess;
+    if (object->cells != NULL) {
+        json_object_index_remove(object, i);
+    }
+    parson_free(object->names[i]);
+    parson_free(object->keys[i].escaped);
+    if (free_value) {
+        json_value_free(object->values[i]);
+    }
+    if (i != last_item_index) { /* Replace key value pair with one from the end */
+        object->names[i] = object->names[last_item_index];
+        object->values[i] = object->values[last_item_index];
+        object->hashes[i] = object->hashes[last_item_index];
+        object->keys[i] = object->keys[last_item_index];
+        if (object->cells != NULL) {
+            object->cells[json_object_index_cell(object, last_item_index)] = i + 1;
         }
     }
-    return JSONFailure; /* No execution path should end here */
+    object->count -= 1;
+    json_value_invalidate(json_object_get_wrapping_value(object));
+    return JSONSuccess;
 }
 
 static JSON_Status json_object_dotremove_internal(JSON_Object *object, const char *name, int free_value) {
@@ -465,10 +1387,15 @@ static void json_object_free(JSON_Object *object) {
     size_t i;
     for (i = 0; i < object->count; i++) {
         parson_free(object->names[i]);
+        parson_free(object->keys[i].escaped);
         json_value_free(object->values[i]);
     }
     parson_free(object->names);
     parson_free(object->values);
+    parson_free(object->hashes);
+    parson_free(object->keys);
+    parson_free(object->cells);
+    parson_free(object->serialized);
     parson_free(object);
 }
 
@@ -482,6 +1409,10 @@ static JSON_Array * json_array_init(JSON_Value *wrapping_value) {
     new_array->items = (JSON_Value**)NULL;
     new_array->capacity = 0;
     new_array->count = 0;
+    new_array->hash = 0;
+    new_array->hash_valid = 0;
+    new_array->serialized = NULL;
+    new_array->serialized_len = 0;
     return new_array;
 }
 
@@ -522,6 +1453,7 @@ static void json_array_free(JSON_Array *array) {
         json_value_free(array->items[i]);
     }
     parson_free(array->items);
+    parson_free(array->serialized);
     parson_free(array);
 }
 
@@ -532,90 +1464,406 @@ static JSON_Value * json_value_init_string_no_copy(char *string) {
         return NULL;
     }
     new_value->parent = NULL;
+    new_value->storage = JSONStorageOwned;
     new_value->type = JSONString;
     new_value->value.string = string;
     return new_value;
 }
 
-/* Parser */
-static JSON_Status skip_quotes(const char **string) {
-    if (**string != '\"') {
+/* Creates a value referencing source in a shared tree. Scalars other than strings are cheaper to copy. */
+static JSON_Value * json_value_init_shared(JSON_Shared *store, const JSON_Value *source) {
+    JSON_Value *new_value = NULL;
+    if (source->storage == JSONStorageShared) {
+        store = source->value.shared.store;
+        source = source->value.shared.source;
+    }
+    switch (json_value_get_type(source)) {
+        case JSONObject: case JSONArray: case JSONString:
+            break;
+        default:
+            return json_value_deep_copy(source);
+    }
+    new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (new_value == NULL) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageShared;
+    new_value->type = source->type;
+    new_value->value.shared.store = store;
+    new_value->value.shared.source = source;
+    store->refcount++;
+    return new_value;
+}
+
+/* Returns value holding the payload, shared values are read through without detaching
+   and lazy containers are parsed (NULL if that fails) */
+static const JSON_Value * json_value_view(const JSON_Value *value) {
+    if (value != NULL && value->storage == JSONStorageShared) {
+        value = value->value.shared.source;
+    }
+    if (value != NULL && value->storage == JSONStorageLazy && json_value_expand((JSON_Value*)value) == JSONFailure) {
+        return NULL;
+    }
+    return value;
+}
+
+/* Gives shared container its own JSON_Object/JSON_Array, whose members still reference shared tree */
+static JSON_Status json_value_unshare(JSON_Value *value) {
+    JSON_Shared_Ref ref = value->value.shared;
+    const JSON_Value *source = NULL;
+    const JSON_Object *source_object = NULL;
+    const JSON_Array *source_array = NULL;
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    JSON_Value *item = NULL;
+    size_t i = 0, count = 0;
+    source = json_value_view(ref.source);
+    if (source == NULL) {
         return JSONFailure;
     }
-    SKIP_CHAR(string);
-    while (**string != '\"') {
-        if (**string == '\0') {
-            return JSONFailure;
-        } else if (**string == '\\') {
-            SKIP_CHAR(string);
-            if (**string == '\0') {
+    switch (value->type) {
+        case JSONObject:
+            source_object = source->value.object;
+            count = source_object->count;
+            object = json_object_init(value);
+            if (object == NULL) {
                 return JSONFailure;
             }
-        }
-        SKIP_CHAR(string);
+            if (count > 0 && json_object_resize(object, count) == JSONFailure) {
+                json_object_free(object);
+                return JSONFailure;
+            }
+            for (i = 0; i < count; i++) {
+                item = json_value_init_shared(ref.store, source_object->values[i]);
+                if (item == NULL) {
+                    json_object_free(object);
+                    return JSONFailure;
+                }
+                if (json_object_addn_unchecked(object, source_object->names[i], strlen(source_object->names[i]),
+                                               source_object->hashes[i], item) == JSONFailure) {
+                    json_value_free(item);
+                    json_object_free(object);
+                    return JSONFailure;
+                }
+            }
+            value->value.object = object;
+            break;
+        case JSONArray:
+            source_array = source->value.array;
+            count = source_array->count;
+            array = json_array_init(value);
+            if (array == NULL) {
+                return JSONFailure;
+            }
+            if (count > 0 && json_array_resize(array, count) == JSONFailure) {
+                json_array_free(array);
+                return JSONFailure;
+            }
+            for (i = 0; i < count; i++) {
+                item = json_value_init_shared(ref.store, source_array->items[i]);
+                if (item == NULL) {
+                    json_array_free(array);
+                    return JSONFailure;
+                }
+                json_array_add(array, item); /* can't fail, capacity is reserved */
+            }
+            value->value.array = array;
+            break;
+        default:
+            return JSONSuccess; /* strings are never written to, so they stay shared */
     }
-    SKIP_CHAR(string);
+    value->storage = JSONStorageOwned;
+    json_shared_release(ref.store);
     return JSONSuccess;
 }
 
-static int parse_utf16(const char **unprocessed, char **processed) {
-    unsigned int cp, lead, trail;
-    int parse_succeeded = 0;
-    char *processed_ptr = *processed;
-    const char *unprocessed_ptr = *unprocessed;
-    unprocessed_ptr++; /* skips u */
-    parse_succeeded = parse_utf16_hex(unprocessed_ptr, &cp);
-    if (!parse_succeeded) {
-        return JSONFailure;
+static void json_shared_release(JSON_Shared *store) {
+    store->refcount--;
+    if (store->refcount == 0) {
+        json_value_free(store->root);
+        parson_free(store);
     }
-    if (cp < 0x80) {
-        processed_ptr[0] = (char)cp; /* 0xxxxxxx */
-    } else if (cp < 0x800) {
-        processed_ptr[0] = ((cp >> 6) & 0x1F) | 0xC0; /* 110xxxxx */
-        processed_ptr[1] = ((cp)      & 0x3F) | 0x80; /* 10xxxxxx */
-        processed_ptr += 1;
-    } else if (cp < 0xD800 || cp > 0xDFFF) {
-        processed_ptr[0] = ((cp >> 12) & 0x0F) | 0xE0; /* 1110xxxx */
-        processed_ptr[1] = ((cp >> 6)  & 0x3F) | 0x80; /* 10xxxxxx */
-        processed_ptr[2] = ((cp)       & 0x3F) | 0x80; /* 10xxxxxx */
-        processed_ptr += 2;
-    } else if (cp >= 0xD800 && cp <= 0xDBFF) { /* lead surrogate (0xD800..0xDBFF) */
-        lead = cp;
-        unprocessed_ptr += 4; /* should always be within the buffer, otherwise previous sscanf would fail */
-        if (*unprocessed_ptr++ != '\\' || *unprocessed_ptr++ != 'u') {
+}
+
+static JSON_Value * json_value_init_number_text(const char *text, size_t len) {
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (new_value == NULL) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageText;
+    new_value->type = JSONNumber;
+    memcpy(new_value->value.text, text, len);
+    new_value->value.text[len] = '\0';
+    return new_value;
+}
+
+static JSON_Value * json_value_init_lazy(JSON_Source *source, size_t span) {
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (new_value == NULL) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageLazy;
+    new_value->type = source->text[source->spans[span].start] == '{' ? JSONObject : JSONArray;
+    new_value->value.lazy.source = source;
+    new_value->value.lazy.span = span;
+    source->refcount++;
+    return new_value;
+}
+
+/* Parses one level of lazy container, nested containers become lazy values.
+   Source was validated before, only duplicate names and allocations can fail. */
+static JSON_Status json_value_expand(JSON_Value *value) {
+    JSON_Lazy_Ref ref = value->value.lazy;
+    const JSON_Span *span = &ref.source->spans[ref.span];
+    const char *string = ref.source->text + span->start + 1;
+    size_t next_span = ref.span + 1, key_len = 0;
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    JSON_Value *item = NULL;
+    JSON_Status status = JSONSuccess;
+    JSON_Parser parser;
+    if (value->type == JSONObject) {
+        object = json_object_init(value);
+        if (object == NULL) {
             return JSONFailure;
         }
-        parse_succeeded = parse_utf16_hex(unprocessed_ptr, &trail);
-        if (!parse_succeeded || trail < 0xDC00 || trail > 0xDFFF) { /* valid trail surrogate? (0xDC00..0xDFFF) */
+    } else {
+        array = json_array_init(value);
+        if (array == NULL) {
             return JSONFailure;
         }
-        cp = ((((lead - 0xD800) & 0x3FF) << 10) | ((trail - 0xDC00) & 0x3FF)) + 0x010000;
-        processed_ptr[0] = (((cp >> 18) & 0x07) | 0xF0); /* 11110xxx */
-        processed_ptr[1] = (((cp >> 12) & 0x3F) | 0x80); /* 10xxxxxx */
-        processed_ptr[2] = (((cp >> 6)  & 0x3F) | 0x80); /* 10xxxxxx */
-        processed_ptr[3] = (((cp)       & 0x3F) | 0x80); /* 10xxxxxx */
-        processed_ptr += 3;
-    } else { /* trail surrogate before lead surrogate */
-        return JSONFailure;
     }
-    unprocessed_ptr += 3;
-    *processed = processed_ptr;
-    *unprocessed = unprocessed_ptr;
-    return JSONSuccess;
-}
-
-
-/* Copies and processes passed string up to supplied length.
-Example: "\u006Corem ipsum" -> lorem ipsum */
-static char* process_string(const char *input, size_t len) {
+    parser_init(&parser);
+    SKIP_WHITESPACES(&string);
+    while (status == JSONSuccess && *string != '}' && *string != ']') {
+        if (object != NULL) {
+            get_quoted_string(&parser, &string, &key_len);
+            SKIP_WHITESPACES(&string);
+            SKIP_CHAR(&string); /* ':' */
+            SKIP_WHITESPACES(&string);
+            parser.scratch_used = key_len + 1; /* keep the key while its value is parsed */
+        }
+        item = parse_lazy_item(&parser, &string, ref.source, &next_span);
+        parser.scratch_used = 0;
+        if (item == NULL) {
+            status = JSONFailure;
+        } else if (object != NULL) {
+            status = json_object_add(object, parser.scratch, item);
+        } else {
+            status = json_array_add(array, item);
+        }
+        if (status == JSONFailure) {
+            json_value_free(item);
+        }
+        SKIP_WHITESPACES(&string);
+        if (*string == ',') {
+            SKIP_CHAR(&string);
+            SKIP_WHITESPACES(&string);
+        }
+    }
+    parser_deinit(&parser);
+    if (object != NULL) {
+        if (status == JSONFailure || /* Trim object after parsing is over */
+            (object->count > 0 && json_object_resize(object, object->count) == JSONFailure)) {
+            json_object_free(object);
+            return JSONFailure;
+        }
+        value->value.object = object;
+    } else {
+        if (status == JSONFailure || /* Trim array after parsing is over */
+            (array->count > 0 && json_array_resize(array, array->count) == JSONFailure)) {
+            json_array_free(array);
+            return JSONFailure;
+        }
+        value->value.array = array;
+    }
+    value->storage = JSONStorageOwned;
+    json_source_release(ref.source);
+    return JSONSuccess;
+}
+
+/* Returns source with copy of text and no spans, holding one reference */
+static JSON_Source * json_source_init(const char *text, size_t len) {
+    JSON_Source *source = (JSON_Source*)parson_malloc(sizeof(JSON_Source));
+    if (source == NULL) {
+        return NULL;
+    }
+    source->text = (char*)parson_malloc(len + 1);
+    if (source->text == NULL) {
+        parson_free(source);
+        return NULL;
+    }
+    memcpy(source->text, text, len);
+    source->text[len] = '\0';
+    source->spans = NULL;
+    source->spans_count = 0;
+    source->spans_capacity = 0;
+    source->refcount = 1;
+    source->raw = 0;
+    return source;
+}
+
+/* Returns text of a raw fragment that can be written verbatim, or NULL */
+static const char * json_value_raw_text(const JSON_Value *value, size_t *len) {
+    const JSON_Source *source = NULL;
+    const JSON_Span *span = NULL;
+    if (value != NULL && value->storage == JSONStorageShared) {
+        value = value->value.shared.source;
+    }
+    if (value == NULL || value->storage != JSONStorageLazy || !value->value.lazy.source->raw) {
+        return NULL;
+    }
+    source = value->value.lazy.source;
+    span = &source->spans[value->value.lazy.span];
+    *len = span->end - span->start;
+    return source->text + span->start;
+}
+
+static void json_source_release(JSON_Source *source) {
+    source->refcount--;
+    if (source->refcount == 0) {
+        parson_free(source->text);
+        parson_free(source->spans);
+        parson_free(source);
+    }
+}
+
+/* Drops data cached on value and its parents, has to be called after modifying a container */
+static void json_value_invalidate(JSON_Value *value) {
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    while (value != NULL) {
+        if (value->storage == JSONStorageOwned && value->type == JSONObject) {
+            object = value->value.object;
+            object->hash_valid = 0;
+            parson_free(object->serialized);
+            object->serialized = NULL;
+        } else if (value->storage == JSONStorageOwned && value->type == JSONArray) {
+            array = value->value.array;
+            array->hash_valid = 0;
+            parson_free(array->serialized);
+            array->serialized = NULL;
+        }
+        value = value->parent;
+    }
+}
+
+/* Parser */
+static void parser_init(JSON_Parser *parser) {
+    parser->scratch = parser->scratch_stack;
+    parser->scratch_used = 0;
+    parser->scratch_capacity = SCRATCH_SIZE;
+}
+
+static void parser_deinit(JSON_Parser *parser) {
+    if (parser->scratch != parser->scratch_stack) {
+        parson_free(parser->scratch);
+    }
+    parser_init(parser);
+}
+
+/* Makes sure that size bytes are available after scratch_used. Pointers into scratch
+   are invalidated by this call, offsets are not. */
+static JSON_Status parser_reserve(JSON_Parser *parser, size_t size) {
+    size_t new_capacity = 0;
+    char *new_scratch = NULL;
+    if (parser->scratch_capacity - parser->scratch_used >= size) {
+        return JSONSuccess;
+    }
+    new_capacity = MAX(parser->scratch_capacity * 2, parser->scratch_used + size);
+    new_scratch = (char*)parson_malloc(new_capacity);
+    if (new_scratch == NULL) {
+        return JSONFailure;
+    }
+    memcpy(new_scratch, parser->scratch, parser->scratch_used);
+    if (parser->scratch != parser->scratch_stack) {
+        parson_free(parser->scratch);
+    }
+    parser->scratch = new_scratch;
+    parser->scratch_capacity = new_capacity;
+    return JSONSuccess;
+}
+
+static JSON_Status skip_quotes(const char **string) {
+    if (**string != '\"') {
+        return JSONFailure;
+    }
+    SKIP_CHAR(string);
+    while (**string != '\"') {
+        if (**string == '\0') {
+            return JSONFailure;
+        } else if (**string == '\\') {
+            SKIP_CHAR(string);
+            if (**string == '\0') {
+                return JSONFailure;
+            }
+        }
+        SKIP_CHAR(string);
+    }
+    SKIP_CHAR(string);
+    return JSONSuccess;
+}
+
+static int parse_utf16(const char **unprocessed, char **processed) {
+    unsigned int cp, lead, trail;
+    int parse_succeeded = 0;
+    char *processed_ptr = *processed;
+    const char *unprocessed_ptr = *unprocessed;
+    unprocessed_ptr++; /* skips u */
+    parse_succeeded = parse_utf16_hex(unprocessed_ptr, &cp);
+    if (!parse_succeeded) {
+        return JSONFailure;
+    }
+    if (cp < 0x80) {
+        processed_ptr[0] = (char)cp; /* 0xxxxxxx */
+    } else if (cp < 0x800) {
+        processed_ptr[0] = ((cp >> 6) & 0x1F) | 0xC0; /* 110xxxxx */
+        processed_ptr[1] = ((cp)      & 0x3F) | 0x80; /* 10xxxxxx */
+        processed_ptr += 1;
+    } else if (cp < 0xD800 || cp > 0xDFFF) {
+        processed_ptr[0] = ((cp >> 12) & 0x0F) | 0xE0; /* 1110xxxx */
+        processed_ptr[1] = ((cp >> 6)  & 0x3F) | 0x80; /* 10xxxxxx */
+        processed_ptr[2] = ((cp)       & 0x3F) | 0x80; /* 10xxxxxx */
+        processed_ptr += 2;
+    } else if (cp >= 0xD800 && cp <= 0xDBFF) { /* lead surrogate (0xD800..0xDBFF) */
+        lead = cp;
+        unprocessed_ptr += 4; /* should always be within the buffer, otherwise previous sscanf would fail */
+        if (*unprocessed_ptr++ != '\\' || *unprocessed_ptr++ != 'u') {
+            return JSONFailure;
+        }
+        parse_succeeded = parse_utf16_hex(unprocessed_ptr, &trail);
+        if (!parse_succeeded || trail < 0xDC00 || trail > 0xDFFF) { /* valid trail surrogate? (0xDC00..0xDFFF) */
+            return JSONFailure;
+        }
+        cp = ((((lead - 0xD800) & 0x3FF) << 10) | ((trail - 0xDC00) & 0x3FF)) + 0x010000;
+        processed_ptr[0] = (((cp >> 18) & 0x07) | 0xF0); /* 11110xxx */
+        processed_ptr[1] = (((cp >> 12) & 0x3F) | 0x80); /* 10xxxxxx */
+        processed_ptr[2] = (((cp >> 6)  & 0x3F) | 0x80); /* 10xxxxxx */
+        processed_ptr[3] = (((cp)       & 0x3F) | 0x80); /* 10xxxxxx */
+        processed_ptr += 3;
+    } else { /* trail surrogate before lead surrogate */
+        return JSONFailure;
+    }
+    unprocessed_ptr += 3;
+    *processed = processed_ptr;
+    *unprocessed = unprocessed_ptr;
+    return JSONSuccess;
+}
+
+
+/* Processes passed string up to supplied length into parser's scratch at scratch_used,
+   output is null terminated and isn't pushed on the scratch stack.
+Example: "\u006Corem ipsum" -> lorem ipsum */
+static JSON_Status process_string(JSON_Parser *parser, const char *input, size_t len, size_t *output_len) {
     const char *input_ptr = input;
-    size_t initial_size = (len + 1) * sizeof(char);
-    size_t final_size = 0;
-    char *output = NULL, *output_ptr = NULL, *resized_output = NULL;
-    output = (char*)parson_malloc(initial_size);
-    if (output == NULL) {
-        goto error;
+    char *output = NULL, *output_ptr = NULL;
+    if (parser_reserve(parser, len + 1) == JSONFailure) {
+        return JSONFailure;
     }
+    output = parser->scratch + parser->scratch_used;
     output_ptr = output;
     while ((*input_ptr != '\0') && (size_t)(input_ptr - input) < len) {
         if (*input_ptr == '\\') {
@@ -631,14 +1879,14 @@ static char* process_string(const char *input, size_t len) {
                 case 't':  *output_ptr = '\t'; break;
                 case 'u':
                     if (parse_utf16(&input_ptr, &output_ptr) == JSONFailure) {
-                        goto error;
+                        return JSONFailure;
                     }
                     break;
                 default:
-                    goto error;
+                    return JSONFailure;
             }
         } else if ((unsigned char)*input_ptr < 0x20) {
-            goto error; /* 0x00-0x19 are invalid characters for json string (http://www.ietf.org/rfc/rfc4627.txt) */
+            return JSONFailure; /* 0x00-0x19 are invalid characters for json string (http://www.ietf.org/rfc/rfc4627.txt) */
         } else {
             *output_ptr = *input_ptr;
         }
@@ -646,69 +1894,260 @@ static char* process_string(const char *input, size_t len) {
         input_ptr++;
     }
     *output_ptr = '\0';
-    /* resize to new length */
-    final_size = (size_t)(output_ptr-output) + 1;
-    /* todo: don't resize if final_size == initial_size */
-    resized_output = (char*)parson_malloc(final_size);
-    if (resized_output == NULL) {
-        goto error;
-    }
-    memcpy(resized_output, output, final_size);
-    parson_free(output);
-    return resized_output;
-error:
-    parson_free(output);
-    return NULL;
+    *output_len = (size_t)(output_ptr - output);
+    return JSONSuccess;
 }
 
-/* Return processed contents of a string between quotes and
-   skips passed argument to a matching quote. */
-static char * get_quoted_string(const char **string) {
+/* Processes contents of a string between quotes into parser's scratch (see process_string)
+   and skips passed argument to a matching quote. */
+static JSON_Status get_quoted_string(JSON_Parser *parser, const char **string, size_t *output_len) {
     const char *string_start = *string;
     size_t string_len = 0;
     JSON_Status status = skip_quotes(string);
     if (status != JSONSuccess) {
-        return NULL;
+        return JSONFailure;
     }
     string_len = *string - string_start - 2; /* length without quotes */
-    return process_string(string_start + 1, string_len);
+    return process_string(parser, string_start + 1, string_len, output_len);
+}
+
+static int lazy_compare_keys(const void *a, const void *b) {
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/* Fails if count null-terminated keys stored one after another have duplicates */
+static JSON_Status lazy_check_keys(const char *keys, size_t count) {
+    const char **sorted = NULL, *key = keys, *other = NULL;
+    JSON_Status status = JSONSuccess;
+    size_t i = 0, j = 0;
+    if (count <= 8) { /* small objects are compared pairwise */
+        for (i = 0; i < count; i++, key += strlen(key) + 1) {
+            for (j = i + 1, other = key + strlen(key) + 1; j < count; j++, other += strlen(other) + 1) {
+                if (strcmp(key, other) == 0) {
+                    return JSONFailure;
+                }
+            }
+        }
+        return JSONSuccess;
+    }
+    sorted = (const char**)parson_malloc(count * sizeof(const char*));
+    if (sorted == NULL) {
+        return JSONFailure;
+    }
+    for (i = 0; i < count; i++, key += strlen(key) + 1) {
+        sorted[i] = key;
+    }
+    qsort(sorted, count, sizeof(const char*), lazy_compare_keys);
+    for (i = 1; i < count && status == JSONSuccess; i++) {
+        if (strcmp(sorted[i - 1], sorted[i]) == 0) {
+            status = JSONFailure;
+        }
+    }
+    parson_free(sorted);
+    return status;
 }
 
-static JSON_Value * parse_value(const char **string, size_t nesting) {
+/* Checks syntax of a value like parse_value does, but instead of building containers
+   records their spans in source. Strings are decoded into scratch and dropped, except for
+   keys of objects being scanned, which are kept to find duplicates. */
+static JSON_Status lazy_scan_value(JSON_Parser *parser, const char **string, size_t nesting, JSON_Source *source) {
+    JSON_Span *new_spans = NULL;
+    size_t span = 0, new_capacity = 0, string_len = 0, keys_offset = parser->scratch_used, keys_count = 0;
+    const char *token = NULL;
+    int has_exponent = 0, is_strict = 0;
+    char close = '}';
+    char *end = NULL;
     if (nesting > MAX_NESTING) {
-        return NULL;
+        return JSONFailure;
     }
     SKIP_WHITESPACES(string);
     switch (**string) {
-        case '{':
-            return parse_object_value(string, nesting + 1);
-        case '[':
-            return parse_array_value(string, nesting + 1);
+        case '{': case '[':
+            break;
         case '\"':
-            return parse_string_value(string);
-        case 'f': case 't':
-            return parse_boolean_value(string);
-        case '-':
-        case '0': case '1': case '2': case '3': case '4':
+            return get_quoted_string(parser, string, &string_len);
+        case 't': case 'f': case 'n':
+            token = **string == 't' ? "true" : (**string == 'f' ? "false" : "null");
+            if (strncmp(token, *string, strlen(token)) != 0) {
+                return JSONFailure;
+            }
+            *string += strlen(token);
+            return JSONSuccess;
+        case '-': case '0': case '1': case '2': case '3': case '4':
         case '5': case '6': case '7': case '8': case '9':
-            return parse_number_value(string);
-        case 'n':
-            return parse_null_value(string);
+            string_len = scan_number(*string, &has_exponent, &is_strict);
+            if (string_len == 0 || !is_decimal(*string, string_len) || (source->raw && !is_strict)) {
+                return JSONFailure; /* raw fragments are written verbatim, so their numbers have to be valid JSON */
+            }
+            if (has_exponent || string_len >= NUMBER_TEXT_SIZE) { /* range has to be checked */
+                errno = 0;
+                strtod(*string, &end);
+                if (errno) {
+                    return JSONFailure;
+                }
+            }
+            *string += string_len;
+            return JSONSuccess;
         default:
-            return NULL;
+            return JSONFailure;
+    }
+    if (source->spans_count == source->spans_capacity) {
+        new_capacity = MAX(source->spans_capacity * 2, STARTING_CAPACITY);
+        new_spans = (JSON_Span*)parson_malloc(new_capacity * sizeof(JSON_Span));
+        if (new_spans == NULL) {
+            return JSONFailure;
+        }
+        if (source->spans != NULL) {
+            memcpy(new_spans, source->spans, source->spans_count * sizeof(JSON_Span));
+            parson_free(source->spans);
+        }
+        source->spans = new_spans;
+        source->spans_capacity = new_capacity;
+    }
+    span = source->spans_count++;
+    source->spans[span].start = (size_t)(*string - source->text);
+    close = **string == '{' ? '}' : ']';
+    SKIP_CHAR(string);
+    SKIP_WHITESPACES(string);
+    while (**string != close && **string != '\0') {
+        if (close == '}') {
+            if (get_quoted_string(parser, string, &string_len) == JSONFailure) {
+                return JSONFailure;
+            }
+            parser->scratch_used += strlen(parser->scratch + parser->scratch_used) + 1; /* names end at null like in objects */
+            keys_count++;
+            SKIP_WHITESPACES(string);
+            if (**string != ':') {
+                return JSONFailure;
+            }
+            SKIP_CHAR(string);
+        }
+        if (lazy_scan_value(parser, string, nesting + 1, source) == JSONFailure) {
+            return JSONFailure;
+        }
+        SKIP_WHITESPACES(string);
+        if (**string != ',') {
+            break;
+        }
+        SKIP_CHAR(string);
+        SKIP_WHITESPACES(string);
+        if (**string == close) {
+            return JSONFailure; /* trailing comma */
+        }
+    }
+    if (**string != close || (keys_count > 1 && lazy_check_keys(parser->scratch + keys_offset, keys_count) == JSONFailure)) {
+        return JSONFailure;
+    }
+    parser->scratch_used = keys_offset;
+    SKIP_CHAR(string);
+    source->spans[span].end = (size_t)(*string - source->text);
+    source->spans[span].size = source->spans_count - span;
+    return JSONSuccess;
+}
+
+/* Parses member of a lazy container, which was already validated. Containers are skipped
+   using their spans and become lazy values, next_span is the span of the next container. */
+static JSON_Value * parse_lazy_item(JSON_Parser *parser, const char **string, JSON_Source *source, size_t *next_span) {
+    JSON_Value *item = NULL;
+    const JSON_Span *span = NULL;
+    if (**string != '{' && **string != '[') {
+        return parse_value(parser, string, 0, NULL);
+    }
+    item = json_value_init_lazy(source, *next_span);
+    if (item == NULL) {
+        return NULL;
+    }
+    span = &source->spans[*next_span];
+    *string = source->text + span->end;
+    *next_span += span->size;
+    return item;
+}
+
+static JSON_Value * parse_lazy_root_value(const char *string) {
+    JSON_Source *source = NULL;
+    JSON_Value *result = NULL;
+    JSON_Parser parser;
+    const char *text = NULL;
+    SKIP_WHITESPACES(&string);
+    if (*string != '{' && *string != '[') {
+        return parse_root_value(string, NULL); /* nothing to defer */
+    }
+    source = json_source_init(string, strlen(string));
+    if (source == NULL) {
+        return NULL;
+    }
+    parser_init(&parser);
+    text = source->text;
+    if (lazy_scan_value(&parser, &text, 0, source) == JSONSuccess) {
+        result = json_value_init_lazy(source, 0);
+    }
+    parser_deinit(&parser);
+    json_source_release(source); /* values hold their own references */
+    return result;
+}
+
+/* Skips value without allocating or decoding strings. Only brackets, quotes and
+   nesting are checked, so skipped parts aren't fully validated. */
+static JSON_Status skip_value(const char **string) {
+    unsigned char arrays[MAX_NESTING / 8 + 1]; /* bit for each open bracket, set if it's '[' */
+    size_t depth = 0;
+    const char *start = NULL;
+    SKIP_WHITESPACES(string);
+    if (**string != '{' && **string != '[' && **string != '\"') { /* scalar */
+        start = *string;
+        while (**string != '\0' && **string != ',' && **string != '}' && **string != ']' &&
+               !isspace((unsigned char)**string)) {
+            SKIP_CHAR(string);
+        }
+        return *string == start ? JSONFailure : JSONSuccess;
     }
+    do {
+        switch (**string) {
+            case '\"':
+                if (skip_quotes(string) == JSONFailure) {
+                    return JSONFailure;
+                }
+                break;
+            case '{': case '[':
+                if (depth >= MAX_NESTING) {
+                    return JSONFailure;
+                }
+                if (**string == '[') {
+                    arrays[depth / 8] |= (unsigned char)(1 << (depth % 8));
+                } else {
+                    arrays[depth / 8] &= (unsigned char)~(1 << (depth % 8));
+                }
+                depth++;
+                SKIP_CHAR(string);
+                break;
+            case '}': case ']':
+                depth--;
+                if (((arrays[depth / 8] >> (depth % 8)) & 1) != (**string == ']')) {
+                    return JSONFailure;
+                }
+                SKIP_CHAR(string);
+                break;
+            case '\0':
+                return JSONFailure;
+            default:
+                SKIP_CHAR(string);
+                break;
+        }
+    } while (depth > 0);
+    return JSONSuccess;
 }
 
-static JSON_Value * parse_object_value(const char **string, size_t nesting) {
+/* Parses only members of an object that are on requested paths, other values are skipped */
+static JSON_Value * parse_projected_object(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Projection *projection, const JSON_Projection *node) {
     JSON_Value *output_value = NULL, *new_value = NULL;
     JSON_Object *output_object = NULL;
-    char *new_key = NULL;
-    output_value = json_value_init_object();
-    if (output_value == NULL) {
+    const JSON_Projection *member = NULL;
+    size_t key_offset = 0, key_len = 0;
+    if (nesting > MAX_NESTING || **string != '{') {
         return NULL;
     }
-    if (**string != '{') {
-        json_value_free(output_value);
+    output_value = json_value_init_object();
+    if (output_value == NULL) {
         return NULL;
     }
     output_object = json_value_get_object(output_value);
@@ -719,31 +2158,42 @@ static JSON_Value * parse_object_value(const char **string, size_t nesting) {
         return output_value;
     }
     while (**string != '\0') {
-        new_key = get_quoted_string(string);
-        if (new_key == NULL) {
+        key_offset = parser->scratch_used;
+        if (get_quoted_string(parser, string, &key_len) == JSONFailure) {
             json_value_free(output_value);
             return NULL;
         }
         SKIP_WHITESPACES(string);
         if (**string != ':') {
-            parson_free(new_key);
             json_value_free(output_value);
             return NULL;
         }
         SKIP_CHAR(string);
-        new_value = parse_value(string, nesting);
-        if (new_value == NULL) {
-            parson_free(new_key);
-            json_value_free(output_value);
-            return NULL;
-        }
-        if (json_object_add(output_object, new_key, new_value) == JSONFailure) {
-            parson_free(new_key);
-            json_value_free(new_value);
-            json_value_free(output_value);
-            return NULL;
+        SKIP_WHITESPACES(string);
+        member = projection_get_member(projection, node, parser->scratch + key_offset, key_len);
+        if (member == NULL || (!member->whole && **string != '{')) { /* not requested or not an object on a path */
+            if (skip_value(string) == JSONFailure) {
+                json_value_free(output_value);
+                return NULL;
+            }
+        } else {
+            parser->scratch_used += key_len + 1; /* keep the key while its value is parsed */
+            if (member->whole) {
+                new_value = parse_value(parser, string, nesting, NULL);
+            } else {
+                new_value = parse_projected_object(parser, string, nesting + 1, projection, member);
+            }
+            parser->scratch_used = key_offset;
+            if (new_value == NULL) {
+                json_value_free(output_value);
+                return NULL;
+            }
+            if (json_object_add(output_object, parser->scratch + key_offset, new_value) == JSONFailure) {
+                json_value_free(new_value);
+                json_value_free(output_value);
+                return NULL;
+            }
         }
-        parson_free(new_key);
         SKIP_WHITESPACES(string);
         if (**string != ',') {
             break;
@@ -761,18 +2211,157 @@ static JSON_Value * parse_object_value(const char **string, size_t nesting) {
     return output_value;
 }
 
-static JSON_Value * parse_array_value(const char **string, size_t nesting) {
-    JSON_Value *output_value = NULL, *new_array_value = NULL;
-    JSON_Array *output_array = NULL;
-    output_value = json_value_init_array();
-    if (output_value == NULL) {
-        return NULL;
+/* Schema passed to parse_value functions (NULL if there's none) is checked while parsing,
+   so that values which fail validation are rejected without being built. */
+static int schema_accepts(const JSON_Schema_Node *schema, JSON_Value_Type type) {
+    return schema == NULL || schema->type == JSONNull || schema->type == type;
+}
+
+static const JSON_Schema_Node * schema_get_member(const JSON_Schema_Node *schema, const char *name, size_t name_len) {
+    const JSON_Schema_Node *member = schema + 1;
+    unsigned long hash = hash_string(name, name_len);
+    size_t i = 0;
+    for (i = 0; i < schema->count; i++) {
+        if (member->name_hash == hash && member->name_len == name_len &&
+            memcmp(member->name, name, name_len) == 0) {
+            return member;
+        }
+        member += member->size;
     }
-    if (**string != '[') {
-        json_value_free(output_value);
+    return NULL;
+}
+
+static JSON_Value * parse_value(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Schema_Node *schema) {
+    if (nesting > MAX_NESTING) {
         return NULL;
     }
-    output_array = json_value_get_array(output_value);
+    SKIP_WHITESPACES(string);
+    switch (**string) {
+        case '{':
+            if (!schema_accepts(schema, JSONObject)) {
+                return NULL;
+            }
+            return parse_object_value(parser, string, nesting + 1, schema);
+        case '[':
+            if (!schema_accepts(schema, JSONArray)) {
+                return NULL;
+            }
+            return parse_array_value(parser, string, nesting + 1, schema);
+        case '\"':
+            if (!schema_accepts(schema, JSONString)) {
+                return NULL;
+            }
+            return parse_string_value(parser, string);
+        case 'f': case 't':
+            if (!schema_accepts(schema, JSONBoolean)) {
+                return NULL;
+            }
+            return parse_boolean_value(string);
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            if (!schema_accepts(schema, JSONNumber)) {
+                return NULL;
+            }
+            return parse_number_value(string);
+        case 'n':
+            if (!schema_accepts(schema, JSONNull)) {
+                return NULL;
+            }
+            return parse_null_value(string);
+        default:
+            return NULL;
+    }
+}
+
+static JSON_Value * parse_object_value(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Schema_Node *schema) {
+    JSON_Value *output_value = NULL, *new_value = NULL;
+    JSON_Object *output_object = NULL;
+    const JSON_Schema_Node *member_schema = NULL;
+    size_t key_offset = 0, key_len = 0, schema_matches = 0;
+    JSON_Status status = JSONFailure;
+    if (schema != NULL && (schema->type != JSONObject || schema->count == 0)) {
+        schema = NULL; /* all objects are valid */
+    }
+    output_value = json_value_init_object();
+    if (output_value == NULL) {
+        return NULL;
+    }
+    if (**string != '{') {
+        json_value_free(output_value);
+        return NULL;
+    }
+    output_object = json_value_get_object(output_value);
+    SKIP_CHAR(string);
+    SKIP_WHITESPACES(string);
+    if (**string == '}' && schema == NULL) { /* empty object */
+        SKIP_CHAR(string);
+        return output_value;
+    }
+    while (**string != '\0') {
+        key_offset = parser->scratch_used;
+        if (get_quoted_string(parser, string, &key_len) == JSONFailure) {
+            json_value_free(output_value);
+            return NULL;
+        }
+        SKIP_WHITESPACES(string);
+        if (**string != ':') {
+            json_value_free(output_value);
+            return NULL;
+        }
+        SKIP_CHAR(string);
+        member_schema = NULL;
+        if (schema != NULL) {
+            member_schema = schema_get_member(schema, parser->scratch + key_offset, key_len);
+            schema_matches += member_schema != NULL;
+        }
+        parser->scratch_used += key_len + 1; /* keep the key while its value is parsed */
+        new_value = parse_value(parser, string, nesting, member_schema);
+        parser->scratch_used = key_offset;
+        if (new_value == NULL) {
+            json_value_free(output_value);
+            return NULL;
+        }
+        status = json_object_add(output_object, parser->scratch + key_offset, new_value);
+        if (status == JSONFailure) {
+            json_value_free(new_value);
+            json_value_free(output_value);
+            return NULL;
+        }
+        SKIP_WHITESPACES(string);
+        if (**string != ',') {
+            break;
+        }
+        SKIP_CHAR(string);
+        SKIP_WHITESPACES(string);
+    }
+    SKIP_WHITESPACES(string);
+    if (**string != '}' || /* Trim object after parsing is over */
+        (schema != NULL && schema_matches < schema->count) || /* names are unique, so all were found */
+        json_object_resize(output_object, json_object_get_count(output_object)) == JSONFailure) {
+            json_value_free(output_value);
+            return NULL;
+    }
+    SKIP_CHAR(string);
+    return output_value;
+}
+
+static JSON_Value * parse_array_value(JSON_Parser *parser, const char **string, size_t nesting, const JSON_Schema_Node *schema) {
+    JSON_Value *output_value = NULL, *new_array_value = NULL;
+    JSON_Array *output_array = NULL;
+    const JSON_Schema_Node *item_schema = NULL;
+    if (schema != NULL && schema->type == JSONArray && schema->count > 0) {
+        item_schema = schema + 1;
+    }
+    output_value = json_value_init_array();
+    if (output_value == NULL) {
+        return NULL;
+    }
+    if (**string != '[') {
+        json_value_free(output_value);
+        return NULL;
+    }
+    output_array = json_value_get_array(output_value);
     SKIP_CHAR(string);
     SKIP_WHITESPACES(string);
     if (**string == ']') { /* empty array */
@@ -780,7 +2369,7 @@ static JSON_Value * parse_array_value(const char **string, size_t nesting) {
         return output_value;
     }
     while (**string != '\0') {
-        new_array_value = parse_value(string, nesting);
+        new_array_value = parse_value(parser, string, nesting, item_schema);
         if (new_array_value == NULL) {
             json_value_free(output_value);
             return NULL;
@@ -807,12 +2396,18 @@ static JSON_Value * parse_array_value(const char **string, size_t nesting) {
     return output_value;
 }
 
-static JSON_Value * parse_string_value(const char **string) {
+static JSON_Value * parse_string_value(JSON_Parser *parser, const char **string) {
     JSON_Value *value = NULL;
-    char *new_string = get_quoted_string(string);
+    char *new_string = NULL;
+    size_t string_len = 0;
+    if (get_quoted_string(parser, string, &string_len) == JSONFailure) {
+        return NULL;
+    }
+    new_string = (char*)parson_malloc(string_len + 1);
     if (new_string == NULL) {
         return NULL;
     }
+    memcpy(new_string, parser->scratch + parser->scratch_used, string_len + 1);
     value = json_value_init_string_no_copy(new_string);
     if (value == NULL) {
         parson_free(new_string);
@@ -835,8 +2430,28 @@ static JSON_Value * parse_boolean_value(const char **string) {
 }
 
 static JSON_Value * parse_number_value(const char **string) {
+    JSON_Value *value = NULL;
     char *end;
     double number = 0;
+    size_t len = 0;
+    int has_exponent = 0, is_strict = 0;
+    if (parson_lazy_numbers) {
+        len = scan_number(*string, &has_exponent, &is_strict);
+        if (len > 0 && len < NUMBER_TEXT_SIZE && is_strict && is_decimal(*string, len)) {
+            if (has_exponent) { /* range check */
+                errno = 0;
+                number = strtod(*string, &end);
+                if (errno || (number * 0.0) != 0.0) {
+                    return NULL;
+                }
+            }
+            value = json_value_init_number_text(*string, len);
+            if (value != NULL) {
+                *string += len;
+            }
+            return value;
+        }
+    }
     errno = 0;
     number = strtod(*string, &end);
     if (errno || !is_decimal(*string, end - *string)) {
@@ -855,762 +2470,5305 @@ static JSON_Value * parse_null_value(const char **string) {
     return NULL;
 }
 
-/* Serialization */
-#define APPEND_STRING(str) do { written = append_string(buf, (str));\
-                                if (written < 0) { return -1; }\
-                                if (buf != NULL) { buf += written; }\
-                                written_total += written; } while(0)
+static JSON_Value * parse_root_value(const char *string, const JSON_Schema_Node *schema) {
+    JSON_Parser parser;
+    JSON_Value *result = NULL;
+    if (parson_lazy_parsing && schema == NULL && (*string == '{' || *string == '[' || isspace((unsigned char)*string))) {
+        return parse_lazy_root_value(string);
+    }
+    parser_init(&parser);
+    result = parse_value(&parser, &string, 0, schema);
+    parser_deinit(&parser);
+    return result;
+}
 
-#define APPEND_INDENT(level) do { written = append_indent(buf, (level));\
-                                  if (written < 0) { return -1; }\
-                                  if (buf != NULL) { buf += written; }\
-                                  written_total += written; } while(0)
+/* Tape */
+static JSON_Status tape_push(JSON_Tape *tape, size_t word) {
+    size_t new_capacity = 0;
+    size_t *new_words = NULL;
+    if (tape->words_count == tape->words_capacity) {
+        new_capacity = MAX(tape->words_capacity * 2, STARTING_CAPACITY);
+        new_words = (size_t*)parson_malloc(new_capacity * sizeof(size_t));
+        if (new_words == NULL) {
+            return JSONFailure;
+        }
+        if (tape->words != NULL) {
+            memcpy(new_words, tape->words, tape->words_count * sizeof(size_t));
+            parson_free(tape->words);
+        }
+        tape->words = new_words;
+        tape->words_capacity = new_capacity;
+    }
+    tape->words[tape->words_count++] = word;
+    return JSONSuccess;
+}
 
-static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty, char *num_buf)
-{
-    const char *key = NULL, *string = NULL;
-    JSON_Value *temp_value = NULL;
-    JSON_Array *array = NULL;
-    JSON_Object *object = NULL;
-    size_t i = 0, count = 0;
-    double num = 0.0;
-    int written = -1, written_total = 0;
+static JSON_Status tape_push_number(JSON_Tape *tape, double number) {
+    size_t new_capacity = 0;
+    double *new_numbers = NULL;
+    if (tape->numbers_count == tape->numbers_capacity) {
+        new_capacity = MAX(tape->numbers_capacity * 2, STARTING_CAPACITY);
+        new_numbers = (double*)parson_malloc(new_capacity * sizeof(double));
+        if (new_numbers == NULL) {
+            return JSONFailure;
+        }
+        if (tape->numbers != NULL) {
+            memcpy(new_numbers, tape->numbers, tape->numbers_count * sizeof(double));
+            parson_free(tape->numbers);
+        }
+        tape->numbers = new_numbers;
+        tape->numbers_capacity = new_capacity;
+    }
+    tape->numbers[tape->numbers_count] = number;
+    return tape_push(tape, TapeNumber | (tape->numbers_count++ << TAPE_TAG_BITS));
+}
 
-    switch (json_value_get_type(value)) {
-        case JSONArray:
-            array = json_value_get_array(value);
-            count = json_array_get_count(array);
-            APPEND_STRING("[");
-            if (count > 0 && is_pretty) {
-                APPEND_STRING("\n");
-            }
-            for (i = 0; i < count; i++) {
-                if (is_pretty) {
-                    APPEND_INDENT(level+1);
-                }
-                temp_value = json_array_get_value(array, i);
-                written = json_serialize_to_buffer_r(temp_value, buf, level+1, is_pretty, num_buf);
-                if (written < 0) {
-                    return -1;
-                }
-                if (buf != NULL) {
-                    buf += written;
-                }
-                written_total += written;
-                if (i < (count - 1)) {
-                    APPEND_STRING(",");
-                }
-                if (is_pretty) {
-                    APPEND_STRING("\n");
-                }
-            }
-            if (count > 0 && is_pretty) {
-                APPEND_INDENT(level);
-            }
-            APPEND_STRING("]");
-            return written_total;
-        case JSONObject:
-            object = json_value_get_object(value);
-            count  = json_object_get_count(object);
-            APPEND_STRING("{");
-            if (count > 0 && is_pretty) {
-                APPEND_STRING("\n");
-            }
-            for (i = 0; i < count; i++) {
-                key = json_object_get_name(object, i);
-                if (key == NULL) {
-                    return -1;
-                }
-                if (is_pretty) {
-                    APPEND_INDENT(level+1);
-                }
-                written = json_serialize_string(key, buf);
-                if (written < 0) {
-                    return -1;
-                }
-                if (buf != NULL) {
-                    buf += written;
-                }
-                written_total += written;
-                APPEND_STRING(":");
-                if (is_pretty) {
-                    APPEND_STRING(" ");
-                }
-                temp_value = json_object_get_value(object, key);
-                written = json_serialize_to_buffer_r(temp_value, buf, level+1, is_pretty, num_buf);
-                if (written < 0) {
-                    return -1;
-                }
-                if (buf != NULL) {
-                    buf += written;
-                }
-                written_total += written;
-                if (i < (count - 1)) {
-                    APPEND_STRING(",");
-                }
-                if (is_pretty) {
-                    APPEND_STRING("\n");
-                }
-            }
-            if (count > 0 && is_pretty) {
-                APPEND_INDENT(level);
-            }
-            APPEND_STRING("}");
-            return written_total;
-        case JSONString:
-            string = json_value_get_string(value);
-            if (string == NULL) {
-                return -1;
-            }
-            written = json_serialize_string(string, buf);
-            if (written < 0) {
-                return -1;
-            }
-            if (buf != NULL) {
-                buf += written;
-            }
-            written_total += written;
-            return written_total;
-        case JSONBoolean:
-            if (json_value_get_boolean(value)) {
-                APPEND_STRING("true");
-            } else {
-                APPEND_STRING("false");
-            }
-            return written_total;
-        case JSONNumber:
-            num = json_value_get_number(value);
-            if (buf != NULL) {
-                num_buf = buf;
-            }
-            written = sprintf(num_buf, FLOAT_FORMAT, num);
-            if (written < 0) {
-                return -1;
+/* Strings are decoded into parser's scratch and kept there, scratch becomes tape's strings */
+static JSON_Status tape_push_string(JSON_Tape *tape, JSON_Parser *parser, const char **string) {
+    size_t offset = parser->scratch_used, len = 0;
+    if (get_quoted_string(parser, string, &len) != JSONSuccess) {
+        return JSONFailure;
+    }
+    parser->scratch_used += len + 1;
+    if (tape_push(tape, TapeString | (offset << TAPE_TAG_BITS)) != JSONSuccess) {
+        return JSONFailure;
+    }
+    return tape_push(tape, len);
+}
+
+/* Accepts the same grammar as parse_value */
+static JSON_Status tape_parse_value(JSON_Tape *tape, JSON_Parser *parser, const char **string, size_t nesting) {
+    const char *token = NULL;
+    char *end = NULL;
+    double number = 0.0;
+    size_t start = 0, count = 0;
+    char close = '}';
+    if (nesting > MAX_NESTING) {
+        return JSONFailure;
+    }
+    SKIP_WHITESPACES(string);
+    switch (**string) {
+        case '{': case '[':
+            break;
+        case '\"':
+            return tape_push_string(tape, parser, string);
+        case 't': case 'f': case 'n':
+            token = **string == 't' ? "true" : (**string == 'f' ? "false" : "null");
+            if (strncmp(token, *string, strlen(token)) != 0) {
+                return JSONFailure;
             }
-            if (buf != NULL) {
-                buf += written;
+            *string += strlen(token);
+            return tape_push(tape, *token == 't' ? TapeTrue : (*token == 'f' ? TapeFalse : TapeNull));
+        case '-':
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            errno = 0;
+            number = strtod(*string, &end);
+            if (errno || !is_decimal(*string, end - *string)) {
+                return JSONFailure;
             }
-            written_total += written;
-            return written_total;
-        case JSONNull:
-            APPEND_STRING("null");
-            return written_total;
-        case JSONError:
-            return -1;
+            *string = end;
+            return tape_push_number(tape, number);
         default:
-            return -1;
+            return JSONFailure;
     }
-}
-
-static int json_serialize_string(const char *string, char *buf) {
-    size_t i = 0, len = strlen(string);
-    char c = '\0';
-    int written = -1, written_total = 0;
-    APPEND_STRING("\"");
-    for (i = 0; i < len; i++) {
-        c = string[i];
-        switch (c) {
-            case '\"': APPEND_STRING("\\\""); break;
-            case '\\': APPEND_STRING("\\\\"); break;
-            case '/':  APPEND_STRING("\\/"); break; /* to make json embeddable in xml\/html */
-            case '\b': APPEND_STRING("\\b"); break;
-            case '\f': APPEND_STRING("\\f"); break;
-            case '\n': APPEND_STRING("\\n"); break;
-            case '\r': APPEND_STRING("\\r"); break;
-            case '\t': APPEND_STRING("\\t"); break;
-            case '\x00': APPEND_STRING("\\u0000"); break;
-            case '\x01': APPEND_STRING("\\u0001"); break;
-            case '\x02': APPEND_STRING("\\u0002"); break;
-            case '\x03': APPEND_STRING("\\u0003"); break;
-            case '\x04': APPEND_STRING("\\u0004"); break;
-            case '\x05': APPEND_STRING("\\u0005"); break;
-            case '\x06': APPEND_STRING("\\u0006"); break;
-            case '\x07': APPEND_STRING("\\u0007"); break;
-            /* '\x08' duplicate: '\b' */
-            /* '\x09' duplicate: '\t' */
-            /* '\x0a' duplicate: '\n' */
-            case '\x0b': APPEND_STRING("\\u000b"); break;
-            /* '\x0c' duplicate: '\f' */
-            /* '\x0d' duplicate: '\r' */
-            case '\x0e': APPEND_STRING("\\u000e"); break;
-            case '\x0f': APPEND_STRING("\\u000f"); break;
-            case '\x10': APPEND_STRING("\\u0010"); break;
-            case '\x11': APPEND_STRING("\\u0011"); break;
-            case '\x12': APPEND_STRING("\\u0012"); break;
-            case '\x13': APPEND_STRING("\\u0013"); break;
-            case '\x14': APPEND_STRING("\\u0014"); break;
-            case '\x15': APPEND_STRING("\\u0015"); break;
-            case '\x16': APPEND_STRING("\\u0016"); break;
-            case '\x17': APPEND_STRING("\\u0017"); break;
-            case '\x18': APPEND_STRING("\\u0018"); break;
-            case '\x19': APPEND_STRING("\\u0019"); break;
-            case '\x1a': APPEND_STRING("\\u001a"); break;
-            case '\x1b': APPEND_STRING("\\u001b"); break;
-            case '\x1c': APPEND_STRING("\\u001c"); break;
-            case '\x1d': APPEND_STRING("\\u001d"); break;
-            case '\x1e': APPEND_STRING("\\u001e"); break;
-            case '\x1f': APPEND_STRING("\\u001f"); break;
-            default:
-                if (buf != NULL) {
-                    buf[0] = c;
-                    buf += 1;
+    start = tape->words_count;
+    close = **string == '{' ? '}' : ']';
+    if (tape_push(tape, 0) != JSONSuccess || tape_push(tape, 0) != JSONSuccess) { /* filled when closed */
+        return JSONFailure;
+    }
+    SKIP_CHAR(string);
+    SKIP_WHITESPACES(string);
+    while (**string != close && **string != '\0') {
+        if (close == '}') {
+            if (tape_push_string(tape, parser, string) != JSONSuccess) {
+                return JSONFailure;
+            }
+            SKIP_WHITESPACES(string);
+            if (**string != ':') {
+                return JSONFailure;
+            }
+            SKIP_CHAR(string);
+        }
+        if (tape_parse_value(tape, parser, string, nesting + 1) != JSONSuccess) {
+            return JSONFailure;
+        }
+        count++;
+        SKIP_WHITESPACES(string);
+        if (**string != ',') {
+            break;
+        }
+        SKIP_CHAR(string);
+        SKIP_WHITESPACES(string);
+        if (**string == close) {
+            return JSONFailure; /* trailing comma */
+        }
+    }
+    if (**string != close) {
+        return JSONFailure;
+    }
+    SKIP_CHAR(string);
+    tape->words[start] = (size_t)(close == '}' ? TapeObject : TapeArray) | (tape->words_count << TAPE_TAG_BITS);
+    tape->words[start + 1] = count;
+    return JSONSuccess;
+}
+
+/* Returns index of word after value starting at index */
+static size_t tape_next(const JSON_Tape *tape, size_t index) {
+    switch (TAPE_TAG(tape->words[index])) {
+        case TapeString:
+            return index + 2;
+        case TapeArray: case TapeObject:
+            return TAPE_PAYLOAD(tape->words[index]);
+        default:
+            return index + 1;
+    }
+}
+
+static JSON_Cursor tape_cursor(const JSON_Tape *tape, size_t index, size_t name, size_t end) {
+    JSON_Cursor cursor;
+    cursor.tape = tape;
+    cursor.index = index;
+    cursor.name = name;
+    cursor.end = end;
+    return cursor;
+}
+
+static JSON_Cursor tape_getn_value(JSON_Cursor object, const char *name, size_t name_len) {
+    const size_t *words = NULL;
+    if (json_cursor_get_type(object) != JSONObject || name == NULL) {
+        return tape_cursor(NULL, 0, 0, 0);
+    }
+    words = object.tape->words;
+    for (object = json_cursor_first(object); object.tape != NULL; object = json_cursor_next(object)) {
+        if (words[object.name + 1] == name_len
+            && memcmp(object.tape->strings + TAPE_PAYLOAD(words[object.name]), name, name_len) == 0) {
+            return object;
+        }
+    }
+    return object;
+}
+
+/* Lines */
+static JSON_Lines * lines_init(void) {
+    JSON_Lines *lines = (JSON_Lines*)parson_malloc(sizeof(JSON_Lines));
+    if (lines == NULL) {
+        return NULL;
+    }
+    memset(lines, 0, sizeof(JSON_Lines));
+    parser_init(&lines->parser);
+    lines->fd = -1;
+    return lines;
+}
+
+static size_t lines_file_read(void *buf, size_t size, void *arg) {
+    return fread(buf, 1, size, (FILE*)arg);
+}
+
+static JSON_Status lines_file_write(const void *data, size_t size, void *arg) {
+    return fwrite(data, 1, size, (FILE*)arg) == size ? JSONSuccess : JSONFailure;
+}
+
+#if PARSON_POSIX
+static size_t lines_fd_read(void *buf, size_t size, void *arg) {
+    ssize_t result = -1;
+    do {
+        result = read(*(int*)arg, buf, size);
+    } while (result < 0 && errno == EINTR);
+    return result < 0 ? 0 : (size_t)result;
+}
+
+static JSON_Status lines_fd_write(const void *data, size_t size, void *arg) {
+    const char *bytes = (const char*)data;
+    ssize_t result = -1;
+    while (size > 0) {
+        result = write(*(int*)arg, bytes, size);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return JSONFailure;
+        }
+        bytes += result;
+        size -= (size_t)result;
+    }
+    return JSONSuccess;
+}
+#endif
+
+/* Returns start of next line and sets line_end to its newline (or terminating null), NULL at
+   end of input. Lines read with read_fun are null-terminated in place, lines of strings aren't. */
+static const char * lines_next_line(JSON_Lines *lines, const char **line_end) {
+    const char *line = NULL, *newline = NULL;
+    char *new_buf = NULL;
+    size_t new_capacity = 0, read_size = 0;
+    if (lines->string != NULL) {
+        if (*lines->string == '\0') {
+            return NULL;
+        }
+        line = lines->string;
+        newline = strchr(line, '\n');
+        *line_end = newline != NULL ? newline : line + strlen(line);
+        lines->string = newline != NULL ? newline + 1 : *line_end;
+        return line;
+    }
+    for (;;) {
+        newline = NULL;
+        if (lines->buf_len > lines->buf_pos + lines->buf_scanned) {
+            newline = (const char*)memchr(lines->buf + lines->buf_pos + lines->buf_scanned, '\n',
+                                          lines->buf_len - lines->buf_pos - lines->buf_scanned);
+        }
+        if (newline != NULL || (lines->eof && lines->buf_pos < lines->buf_len)) {
+            line = lines->buf + lines->buf_pos;
+            *line_end = newline != NULL ? newline : lines->buf + lines->buf_len;
+            lines->buf[*line_end - lines->buf] = '\0';
+            lines->buf_pos = (size_t)(*line_end - lines->buf) + (newline != NULL ? 1 : 0);
+            lines->buf_scanned = 0;
+            return line;
+        }
+        if (lines->eof) {
+            return NULL;
+        }
+        lines->buf_scanned = lines->buf_len - lines->buf_pos;
+        if (lines->buf_pos > 0) { /* line being read is moved to the start */
+            memmove(lines->buf, lines->buf + lines->buf_pos, lines->buf_scanned);
+            lines->buf_len = lines->buf_scanned;
+            lines->buf_pos = 0;
+        }
+        if (lines->buf_capacity - lines->buf_len < LINES_BUFFER_SIZE / 2 + 1) {
+            new_capacity = MAX(lines->buf_capacity * 2, LINES_BUFFER_SIZE);
+            new_buf = (char*)parson_malloc(new_capacity);
+            if (new_buf == NULL) {
+                return NULL;
+            }
+            if (lines->buf != NULL) {
+                memcpy(new_buf, lines->buf, lines->buf_len);
+                parson_free(lines->buf);
+            }
+            lines->buf = new_buf;
+            lines->buf_capacity = new_capacity;
+        }
+        read_size = lines->read_fun(lines->buf + lines->buf_len, lines->buf_capacity - lines->buf_len - 1, lines->arg);
+        if (read_size == 0) {
+            lines->eof = 1;
+        }
+        lines->buf_len += read_size;
+    }
+}
+
+static JSON_Lines_Writer * lines_writer_init(JSON_Write_Function write_fun, void *arg) {
+    JSON_Lines_Writer *writer = NULL;
+    if (write_fun == NULL) {
+        return NULL;
+    }
+    writer = (JSON_Lines_Writer*)parson_malloc(sizeof(JSON_Lines_Writer));
+    if (writer == NULL) {
+        return NULL;
+    }
+    memset(writer, 0, sizeof(JSON_Lines_Writer));
+    writer->write_fun = write_fun;
+    writer->arg = arg;
+    writer->fd = -1;
+    writer->status = JSONSuccess;
+    return writer;
+}
+
+/* Parses line ending at line_end (which parser may read past), value is NULL for blank lines */
+/* Checks that string or container starting at string closes before line_end, so parsing it
+   doesn't read past the line (lines opening a container would each read to the end of input) */
+static int lines_value_ends(const char *string, const char *line_end) {
+    size_t depth = 0;
+    int in_string = 0;
+    for (; string < line_end; string++) {
+        if (in_string) {
+            if (*string == '\\') {
+                string++;
+                if (string == line_end) {
+                    return 0;
                 }
-                written_total += 1;
+            } else if (*string == '\"') {
+                in_string = 0;
+                if (depth == 0) {
+                    return 1;
+                }
+            }
+        } else if (*string == '\"') {
+            in_string = 1;
+        } else if (*string == '{' || *string == '[') {
+            depth++;
+        } else if (depth == 0 || ((*string == '}' || *string == ']') && --depth == 0)) {
+            return 1; /* scalars end at whitespace, stray brackets fail parsing */
+        }
+    }
+    return 0;
+}
+
+static JSON_Status lines_parse_line(JSON_Parser *parser, const char *string, const char *line_end, JSON_Value **value) {
+    *value = NULL;
+    while (string < line_end && isspace((unsigned char)*string)) {
+        string++;
+    }
+    if (string == line_end) {
+        return JSONSuccess;
+    } else if (!lines_value_ends(string, line_end)) {
+        return JSONFailure;
+    }
+    parser->scratch_used = 0;
+    *value = parse_value(parser, &string, 0, NULL);
+    while (*value != NULL && string < line_end && isspace((unsigned char)*string)) {
+        string++;
+    }
+    if (*value != NULL && string == line_end) {
+        return JSONSuccess;
+    }
+    json_value_free(*value); /* value spanning more lines or followed by other content */
+    *value = NULL;
+    return JSONFailure;
+}
+
+static JSON_Status lines_parse_sequential(const char *string, JSON_Lines_Callback callback, void *arg) {
+    JSON_Parser parser;
+    JSON_Value *value = NULL;
+    JSON_Status status = JSONSuccess;
+    const char *line_end = NULL;
+    size_t line = 0;
+    parser_init(&parser);
+    while (status == JSONSuccess && *string != '\0') {
+        line++;
+        line_end = strchr(string, '\n');
+        if (line_end == NULL) {
+            line_end = string + strlen(string);
+        }
+        if (lines_parse_line(&parser, string, line_end, &value) != JSONSuccess || value != NULL) {
+            status = callback(value, line, arg);
+        }
+        string = *line_end == '\n' ? line_end + 1 : line_end;
+    }
+    parser_deinit(&parser);
+    return status;
+}
+
+/* Returns number of worker threads to use, 0 means one per online processor */
+static size_t threads_get_count(size_t requested) {
+#if PARSON_THREADS && PARSON_POSIX && defined(_SC_NPROCESSORS_ONLN)
+    long online = 0;
+    if (requested == 0) {
+        online = sysconf(_SC_NPROCESSORS_ONLN);
+        requested = online > 0 ? (size_t)online : 1;
+    }
+#endif
+    return requested == 0 ? 1 : requested;
+}
+
+#if PARSON_THREADS
+/* Returns end of chunk starting at start, chunks end after a newline */
+static const char * lines_chunk_end(const char *start, const char *end, size_t chunk_size) {
+    const char *newline = NULL;
+    if ((size_t)(end - start) <= chunk_size) {
+        return end;
+    }
+    newline = (const char*)memchr(start + chunk_size, '\n', (size_t)(end - start) - chunk_size);
+    return newline != NULL ? newline + 1 : end;
+}
+
+static size_t lines_count(const char *start, const char *end) {
+    size_t count = 0;
+    while (start < end && (start = (const char*)memchr(start, '\n', (size_t)(end - start))) != NULL) {
+        start++;
+        count++;
+    }
+    return start != NULL && start < end ? count + 1 : count; /* last line without newline */
+}
+
+static void lines_parse_chunk(JSON_Parser *parser, JSON_Lines_Chunk *chunk) {
+    const char *line = chunk->start, *line_end = NULL;
+    JSON_Lines_Item *new_items = NULL;
+    JSON_Value *value = NULL;
+    JSON_Status status = JSONSuccess;
+    size_t index = 0, new_capacity = 0;
+    chunk->items_count = 0;
+    chunk->status = JSONSuccess;
+    for (index = 0; line < chunk->end; index++) {
+        line_end = (const char*)memchr(line, '\n', (size_t)(chunk->end - line));
+        if (line_end == NULL) {
+            line_end = chunk->end;
+        }
+        status = lines_parse_line(parser, line, line_end, &value);
+        line = line_end + 1;
+        if (status == JSONSuccess && value == NULL) {
+            continue;
+        }
+        if (chunk->items_count == chunk->items_capacity) {
+            new_capacity = MAX(chunk->items_capacity * 2, STARTING_CAPACITY);
+            new_items = (JSON_Lines_Item*)parson_malloc(new_capacity * sizeof(JSON_Lines_Item));
+            if (new_items == NULL) {
+                json_value_free(value);
+                chunk->status = JSONFailure;
+                return;
+            }
+            if (chunk->items != NULL) {
+                memcpy(new_items, chunk->items, chunk->items_count * sizeof(JSON_Lines_Item));
+                parson_free(chunk->items);
+            }
+            chunk->items = new_items;
+            chunk->items_capacity = new_capacity;
+        }
+        chunk->items[chunk->items_count].value = value;
+        chunk->items[chunk->items_count].line = index;
+        chunk->items_count++;
+    }
+}
+
+static void * lines_worker(void *arg) {
+    JSON_Lines_Job *job = (JSON_Lines_Job*)arg;
+    JSON_Lines_Chunk *chunk = NULL;
+    JSON_Parser parser; /* scratch is reused for all chunks parsed by this thread */
+    size_t lines = 0;
+    parser_init(&parser);
+    pthread_mutex_lock(&job->mutex);
+    for (;;) {
+        while (!job->stop && job->next < job->end && job->claimed >= job->delivered + job->window) {
+            pthread_cond_wait(&job->cond, &job->mutex);
+        }
+        if (job->stop || job->next >= job->end) {
+            break;
+        }
+        chunk = &job->chunks[job->claimed % job->window];
+        chunk->start = job->next;
+        chunk->end = lines_chunk_end(job->next, job->end, job->chunk_size);
+        chunk->state = ChunkClaimed;
+        job->next = chunk->end;
+        job->claimed++;
+        pthread_mutex_unlock(&job->mutex);
+        lines = lines_count(chunk->start, chunk->end); /* counted first, so unordered delivery knows line numbers early */
+        pthread_mutex_lock(&job->mutex);
+        chunk->lines = lines;
+        chunk->state = ChunkCounted;
+        pthread_cond_broadcast(&job->cond);
+        pthread_mutex_unlock(&job->mutex);
+        lines_parse_chunk(&parser, chunk);
+        pthread_mutex_lock(&job->mutex);
+        chunk->state = ChunkParsed;
+        pthread_cond_broadcast(&job->cond);
+    }
+    pthread_mutex_unlock(&job->mutex);
+    parser_deinit(&parser);
+    return NULL;
+}
+
+/* Runs on calling thread and passes parsed chunks to callback (in order of chunks if ordered) */
+static JSON_Status lines_deliver(JSON_Lines_Job *job, int ordered, JSON_Lines_Callback callback, void *arg) {
+    JSON_Lines_Chunk *chunk = NULL;
+    JSON_Status status = JSONSuccess;
+    size_t i = 0;
+    pthread_mutex_lock(&job->mutex);
+    while (status == JSONSuccess) {
+        while (job->counted < job->claimed && job->chunks[job->counted % job->window].state >= ChunkCounted) {
+            chunk = &job->chunks[job->counted % job->window];
+            chunk->first_line = job->lines;
+            job->lines += chunk->lines;
+            job->counted++;
+        }
+        chunk = NULL;
+        for (i = job->delivered; i < job->counted; i++) {
+            if (job->chunks[i % job->window].state == ChunkParsed) {
+                chunk = &job->chunks[i % job->window];
+                break;
+            }
+            if (ordered) {
+                break;
+            }
+        }
+        if (chunk == NULL) {
+            if (job->delivered == job->claimed && job->next >= job->end) {
+                break;
+            }
+            pthread_cond_wait(&job->cond, &job->mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&job->mutex);
+        status = chunk->status;
+        for (i = 0; i < chunk->items_count; i++) {
+            if (status == JSONSuccess) {
+                status = callback(chunk->items[i].value, chunk->first_line + chunk->items[i].line + 1, arg);
+            } else {
+                json_value_free(chunk->items[i].value);
+            }
+        }
+        chunk->items_count = 0;
+        pthread_mutex_lock(&job->mutex);
+        chunk->state = ChunkDelivered;
+        while (job->delivered < job->claimed && job->chunks[job->delivered % job->window].state == ChunkDelivered) {
+            job->chunks[job->delivered % job->window].state = ChunkFree;
+            job->delivered++;
+        }
+        pthread_cond_broadcast(&job->cond);
+    }
+    job->stop = 1;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+    return status;
+}
+
+static void array_publish(JSON_Array_Job *job, const char *start, const char *end) {
+    pthread_mutex_lock(&job->mutex);
+    job->chunks[job->chunks_count].start = start;
+    job->chunks[job->chunks_count].end = end;
+    job->chunks_count++;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+/* Splits array's items (string points after opening bracket) at top-level commas that are at least
+   chunk_size bytes apart, skipping strings and nested values. Returns closing bracket or NULL if
+   it wasn't found. Only structure is tracked here, items are checked when chunks are parsed. */
+static const char * array_scan(JSON_Array_Job *job, const char *string, size_t chunk_size) {
+    const char *start = string;
+    size_t depth = 0;
+    for (;; string++) {
+        switch (*string) {
+            case '\0':
+                return NULL;
+            case '\"':
+                for (string++; *string != '\"'; string++) {
+                    if (*string == '\0') {
+                        return NULL;
+                    }
+                    if (*string == '\\' && string[1] != '\0') {
+                        string++;
+                    }
+                }
+                break;
+            case '[': case '{':
+                depth++;
+                break;
+            case ']': case '}':
+                if (depth == 0) {
+                    array_publish(job, start, string);
+                    return string;
+                }
+                depth--;
+                break;
+            case ',':
+                if (depth == 0 && (size_t)(string - start) >= chunk_size) {
+                    array_publish(job, start, string);
+                    start = string + 1;
+                }
+                break;
+            default:
                 break;
         }
     }
-    APPEND_STRING("\"");
-    return written_total;
 }
 
-static int append_indent(char *buf, int level) {
-    int i;
-    int written = -1, written_total = 0;
-    for (i = 0; i < level; i++) {
-        APPEND_STRING("    ");
+/* Parses items of chunk like parse_array_value, but items can't continue past chunk's end */
+static JSON_Status array_parse_chunk(JSON_Parser *parser, JSON_Array_Chunk *chunk) {
+    const char *string = chunk->start;
+    JSON_Value *item = NULL;
+    chunk->items = json_value_init_array();
+    if (chunk->items == NULL) {
+        return JSONFailure;
+    }
+    for (;;) {
+        parser->scratch_used = 0;
+        item = parse_value(parser, &string, 1, NULL);
+        if (item == NULL) {
+            return JSONFailure;
+        }
+        if (json_array_add(json_array(chunk->items), item) != JSONSuccess) {
+            json_value_free(item);
+            return JSONFailure;
+        }
+        SKIP_WHITESPACES(&string);
+        if (string == chunk->end) {
+            return JSONSuccess;
+        }
+        if (string > chunk->end || *string != ',') {
+            return JSONFailure;
+        }
+        SKIP_CHAR(&string);
+    }
+}
+
+static void * array_worker(void *arg) {
+    JSON_Array_Job *job = (JSON_Array_Job*)arg;
+    JSON_Array_Chunk *chunk = NULL;
+    JSON_Parser parser; /* scratch is reused for all chunks parsed by this thread */
+    JSON_Status status = JSONSuccess;
+    parser_init(&parser);
+    pthread_mutex_lock(&job->mutex);
+    for (;;) {
+        while (!job->failed && !job->scanned && job->next == job->chunks_count) {
+            pthread_cond_wait(&job->cond, &job->mutex);
+        }
+        if (job->failed || job->next == job->chunks_count) {
+            break;
+        }
+        chunk = &job->chunks[job->next++];
+        pthread_mutex_unlock(&job->mutex);
+        status = array_parse_chunk(&parser, chunk);
+        pthread_mutex_lock(&job->mutex);
+        if (status != JSONSuccess) {
+            job->failed = 1;
+            pthread_cond_broadcast(&job->cond);
+        }
+    }
+    pthread_mutex_unlock(&job->mutex);
+    parser_deinit(&parser);
+    return NULL;
+}
+
+/* Parses items of a non-empty array (string points after opening bracket), calling thread scans
+   for chunks and then parses with workers. Items are moved to result in order of chunks. */
+static JSON_Value * array_parse_parallel(const char *string, size_t threads_count) {
+    JSON_Array_Job job;
+    JSON_Value *result = NULL;
+    pthread_t *threads = NULL;
+    const char *end = NULL;
+    size_t size = strlen(string), chunk_size = 0, started = 0, count = 0, i = 0, j = 0;
+    chunk_size = MIN(MAX(size / (threads_count * ARRAY_CHUNKS_PER_THREAD), PARALLEL_CHUNK_MIN), PARALLEL_CHUNK_MAX);
+    memset(&job, 0, sizeof(JSON_Array_Job));
+    job.chunks = (JSON_Array_Chunk*)parson_malloc((size / chunk_size + 2) * sizeof(JSON_Array_Chunk));
+    threads = (pthread_t*)parson_malloc((threads_count - 1) * sizeof(pthread_t));
+    if (job.chunks == NULL || threads == NULL) {
+        parson_free(job.chunks);
+        parson_free(threads);
+        return NULL;
+    }
+    memset(job.chunks, 0, (size / chunk_size + 2) * sizeof(JSON_Array_Chunk));
+    if (pthread_mutex_init(&job.mutex, NULL) != 0) {
+        job.failed = 1;
+    } else if (pthread_cond_init(&job.cond, NULL) != 0) {
+        pthread_mutex_destroy(&job.mutex);
+        job.failed = 1;
+    } else {
+        for (started = 0; started < threads_count - 1; started++) {
+            if (pthread_create(&threads[started], NULL, array_worker, &job) != 0) {
+                break;
+            }
+        }
+        end = array_scan(&job, string, chunk_size);
+        pthread_mutex_lock(&job.mutex);
+        job.scanned = 1;
+        job.failed = job.failed || end == NULL || *end != ']'; /* "[1}" */
+        pthread_cond_broadcast(&job.cond);
+        pthread_mutex_unlock(&job.mutex);
+        array_worker(&job); /* calling thread helps after scanning */
+        for (i = 0; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        pthread_cond_destroy(&job.cond);
+        pthread_mutex_destroy(&job.mutex);
+    }
+    for (i = 0; i < job.chunks_count; i++) {
+        count += json_array_get_count(json_array(job.chunks[i].items));
+    }
+    if (!job.failed) {
+        result = json_value_init_array();
+    }
+    if (result != NULL && json_array_resize(json_array(result), count) != JSONSuccess) {
+        json_value_free(result);
+        result = NULL;
+    }
+    for (i = 0; i < job.chunks_count; i++) {
+        for (j = 0; result != NULL && j < json_array_get_count(json_array(job.chunks[i].items)); j++) {
+            json_array_add(json_array(result), json_array_get_value(json_array(job.chunks[i].items), j));
+        }
+        if (result != NULL) {
+            json_array(job.chunks[i].items)->count = 0; /* items were moved */
+        }
+        json_value_free(job.chunks[i].items);
+    }
+    parson_free(job.chunks);
+    parson_free(threads);
+    return result;
+}
+#endif
+
+/* Batch */
+static JSON_Value * batch_parse_input(JSON_Parser *parser, const JSON_Input *input) {
+    JSON_Value *result = NULL;
+    char *contents = NULL;
+    const char *string = NULL;
+    switch (input->type) {
+        case JSONInputString:
+            string = input->data;
+            break;
+        case JSONInputFile:
+            string = contents = input->data != NULL ? read_file(input->data) : NULL;
+            break;
+#if PARSON_POSIX
+        case JSONInputFd:
+            string = contents = input->fd >= 0 ? read_fd(input->fd) : NULL;
+            break;
+#endif
+        default:
+            break;
+    }
+    if (string == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    if (parson_lazy_parsing) {
+        result = parse_root_value(string, NULL);
+    } else {
+        parser->scratch_used = 0;
+        result = parse_value(parser, &string, 0, NULL);
+    }
+    parson_free(contents);
+    return result;
+}
+
+/* Asks system to start reading file that will be parsed next, so reading overlaps parsing */
+static void batch_prefetch(const JSON_Input *input) {
+#if PARSON_POSIX && defined(POSIX_FADV_WILLNEED)
+    int fd = -1;
+    if (input->type != JSONInputFile || input->data == NULL) {
+        return;
+    }
+    fd = open(input->data, O_RDONLY);
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#else
+    (void)input;
+#endif
+}
+
+#if PARSON_THREADS
+/* Takes next input from worker's range, or steals back half of another worker's range. Prefetch
+   is set to input that will probably be taken next (count if there isn't one). */
+static int batch_take(JSON_Batch_Job *job, size_t worker, size_t *index, size_t *prefetch) {
+    JSON_Batch_Range *own = &job->ranges[worker], *victim = NULL;
+    size_t i = 0, next = 0, end = 0, middle = 0;
+    pthread_mutex_lock(&own->mutex);
+    if (own->next < own->end) {
+        *index = own->next++;
+        *prefetch = own->next < own->end ? own->next : job->count;
+        pthread_mutex_unlock(&own->mutex);
+        return 1;
+    }
+    pthread_mutex_unlock(&own->mutex); /* empty ranges aren't touched by other workers */
+    for (i = 1; i < job->workers; i++) {
+        victim = &job->ranges[(worker + i) % job->workers];
+        pthread_mutex_lock(&victim->mutex);
+        next = victim->next;
+        end = victim->end;
+        middle = next + (end - next) / 2;
+        if (next < end) {
+            victim->end = middle;
+        }
+        pthread_mutex_unlock(&victim->mutex);
+        if (next < end) {
+            pthread_mutex_lock(&own->mutex);
+            own->next = middle + 1;
+            own->end = end;
+            pthread_mutex_unlock(&own->mutex);
+            *index = middle;
+            *prefetch = middle + 1 < end ? middle + 1 : job->count;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void * batch_worker(void *arg) {
+    JSON_Batch_Worker *worker = (JSON_Batch_Worker*)arg;
+    JSON_Batch_Job *job = worker->job;
+    JSON_Parser parser; /* scratch is reused for all inputs parsed by this thread */
+    size_t index = 0, prefetch = 0;
+    parser_init(&parser);
+    while (batch_take(job, worker->index, &index, &prefetch)) {
+        if (prefetch < job->count) {
+            batch_prefetch(&job->inputs[prefetch]);
+        }
+        job->results[index] = batch_parse_input(&parser, &job->inputs[index]);
+    }
+    parser_deinit(&parser);
+    return NULL;
+}
+#endif
+
+/* Loader */
+/* Reads whole file with pread where available, so reading doesn't depend on file position */
+static char * loader_read_file(const char *filename) {
+#if PARSON_POSIX
+    struct stat info;
+    char *contents = NULL;
+    size_t size = 0;
+    ssize_t result = 0;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        contents = read_fd(fd);
+        close(fd);
+        return contents;
+    }
+    contents = (char*)parson_malloc((size_t)info.st_size + 1);
+    while (contents != NULL && size < (size_t)info.st_size) {
+        result = pread(fd, contents + size, (size_t)info.st_size - size, (off_t)size);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < 0) {
+            parson_free(contents);
+            contents = NULL;
+        } else if (result == 0) {
+            break; /* file was truncated */
+        } else {
+            size += (size_t)result;
+        }
+    }
+    close(fd);
+    if (contents != NULL) {
+        contents[size] = '\0';
+    }
+    return contents;
+#else
+    return read_file(filename);
+#endif
+}
+
+static JSON_Value * loader_parse_file(JSON_Parser *parser, const char *filename) {
+    JSON_Input input;
+    JSON_Value *value = NULL;
+    char *contents = loader_read_file(filename);
+    if (contents == NULL) {
+        return NULL;
+    }
+    input.type = JSONInputString;
+    input.data = contents;
+    input.fd = -1;
+    value = batch_parse_input(parser, &input);
+    parson_free(contents);
+    return value;
+}
+
+/* Creates request, handles (requests without callback) are added to loader's list */
+static JSON_Load * loader_request(JSON_Loader *loader, const char *filename, JSON_Load_Callback callback, void *arg) {
+    JSON_Load *load = NULL;
+    if (loader == NULL || filename == NULL) {
+        return NULL;
+    }
+    load = (JSON_Load*)parson_malloc(sizeof(JSON_Load));
+    if (load == NULL) {
+        return NULL;
+    }
+    memset(load, 0, sizeof(JSON_Load));
+    load->filename = parson_strdup(filename);
+    if (load->filename == NULL) {
+        parson_free(load);
+        return NULL;
+    }
+    load->loader = loader;
+    load->callback = callback;
+    load->arg = arg;
+    if (callback != NULL) {
+        return load;
+    }
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_lock(&loader->mutex);
+    }
+#endif
+    load->next = loader->loads;
+    if (loader->loads != NULL) {
+        loader->loads->prev = load;
+    }
+    loader->loads = load;
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_unlock(&loader->mutex);
+    }
+#endif
+    return load;
+}
+
+/* Loads and parses file of request, then calls its callback or marks its handle as done.
+   Called by a worker (without holding mutex) or on calling thread if there aren't workers. */
+static void loader_finish(JSON_Loader *loader, JSON_Parser *parser, JSON_Load *load) {
+    JSON_Value *value = loader_parse_file(parser, load->filename);
+    if (load->callback != NULL) {
+        load->callback(load->filename, value, load->arg);
+        loader_free_load(load);
+        return;
+    }
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_lock(&loader->mutex);
+        load->value = value;
+        load->done = 1;
+        pthread_cond_broadcast(&loader->done_cond);
+        pthread_mutex_unlock(&loader->mutex);
+        return;
+    }
+#else
+    (void)loader;
+#endif
+    load->value = value;
+    load->done = 1;
+}
+
+static void loader_free_load(JSON_Load *load) {
+    json_value_free(load->value);
+    parson_free(load->filename);
+    parson_free(load);
+}
+
+#if PARSON_THREADS
+static void * loader_worker(void *arg) {
+    JSON_Loader *loader = (JSON_Loader*)arg;
+    JSON_Load *load = NULL;
+    JSON_Parser parser; /* scratch is reused for all files parsed by this thread */
+    parser_init(&parser);
+    pthread_mutex_lock(&loader->mutex);
+    for (;;) {
+        while (loader->queue == NULL && !loader->stop) {
+            pthread_cond_wait(&loader->cond, &loader->mutex);
+        }
+        if (loader->queue == NULL) { /* stopped and all requests were taken */
+            break;
+        }
+        load = loader->queue;
+        loader->queue = load->queue_next;
+        if (loader->queue == NULL) {
+            loader->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&loader->mutex);
+        loader_finish(loader, &parser, load);
+        pthread_mutex_lock(&loader->mutex);
+    }
+    pthread_mutex_unlock(&loader->mutex);
+    parser_deinit(&parser);
+    return NULL;
+}
+#endif
+
+/* Snapshot */
+static unsigned long snapshot_get_u32(const unsigned char *bytes) {
+    return (unsigned long)bytes[0] | ((unsigned long)bytes[1] << 8)
+         | ((unsigned long)bytes[2] << 16) | ((unsigned long)bytes[3] << 24);
+}
+
+static JSON_Status snapshot_put_u32(JSON_Binary_Writer *writer, size_t value) {
+    unsigned char bytes[4];
+    bytes[0] = (unsigned char)(value & 0xff);
+    bytes[1] = (unsigned char)((value >> 8) & 0xff);
+    bytes[2] = (unsigned char)((value >> 16) & 0xff);
+    bytes[3] = (unsigned char)((value >> 24) & 0xff);
+    return binary_put(writer, bytes, 4);
+}
+
+static JSON_Status snapshot_file_write(const void *data, size_t size, void *arg) {
+    return fwrite(data, 1, size, (FILE*)arg) == size ? JSONSuccess : JSONFailure;
+}
+
+static JSON_Status snapshot_put_string(JSON_Binary_Writer *writer, const char *string, size_t *offset) {
+    const unsigned char padding[4] = { 0, 0, 0, 0 };
+    size_t len = strlen(string);
+    *offset = writer->len;
+    if (snapshot_put_u32(writer, JSONString) != JSONSuccess || snapshot_put_u32(writer, len) != JSONSuccess
+        || binary_put(writer, string, len) != JSONSuccess) {
+        return JSONFailure;
+    }
+    return binary_put(writer, padding, 4 - len % 4); /* terminator and alignment */
+}
+
+/* Each distinct name is written once, names maps it to its offset */
+static JSON_Status snapshot_put_name(JSON_Binary_Writer *writer, JSON_Object *names, const char *name, size_t *offset) {
+    JSON_Value *known = json_object_get_value(names, name);
+    if (known != NULL) {
+        *offset = (size_t)json_value_get_number(known);
+        return JSONSuccess;
+    }
+    if (snapshot_put_string(writer, name, offset) != JSONSuccess) {
+        return JSONFailure;
+    }
+    return json_object_set_number(names, name, (double)*offset);
+}
+
+static int snapshot_compare_entries(const void *a, const void *b) {
+    return strcmp(((const JSON_Snapshot_Entry*)a)->name, ((const JSON_Snapshot_Entry*)b)->name);
+}
+
+static JSON_Status snapshot_put_object(JSON_Binary_Writer *writer, JSON_Object *names, const JSON_Object *object, size_t *offset) {
+    size_t i = 0, count = json_object_get_count(object);
+    size_t *children = NULL;
+    JSON_Snapshot_Entry *entries = NULL;
+    JSON_Status status = JSONSuccess;
+    if (count > 0) {
+        children = (size_t*)parson_malloc(count * 2 * sizeof(size_t));
+        entries = (JSON_Snapshot_Entry*)parson_malloc(count * sizeof(JSON_Snapshot_Entry));
+        if (children == NULL || entries == NULL) {
+            status = JSONFailure;
+        }
+    }
+    for (i = 0; i < count && status == JSONSuccess; i++) {
+        entries[i].name = json_object_get_name(object, i);
+        entries[i].index = i;
+        status = snapshot_put_name(writer, names, entries[i].name, &children[i * 2]);
+        if (status == JSONSuccess) {
+            status = snapshot_put_value(writer, names, json_object_get_value_at(object, i), &children[i * 2 + 1]);
+        }
+    }
+    if (status == JSONSuccess) {
+        if (count > 1) {
+            qsort(entries, count, sizeof(JSON_Snapshot_Entry), snapshot_compare_entries);
+        }
+        *offset = writer->len;
+        if (snapshot_put_u32(writer, JSONObject) != JSONSuccess || snapshot_put_u32(writer, count) != JSONSuccess) {
+            status = JSONFailure;
+        }
+    }
+    for (i = 0; i < count * 2 && status == JSONSuccess; i++) {
+        status = snapshot_put_u32(writer, *offset - children[i]);
+    }
+    for (i = 0; i < count && status == JSONSuccess; i++) {
+        status = snapshot_put_u32(writer, entries[i].index);
+    }
+    parson_free(children);
+    parson_free(entries);
+    return status;
+}
+
+/* Children are written before their parent, offset is set to where value's node starts */
+static JSON_Status snapshot_put_value(JSON_Binary_Writer *writer, JSON_Object *names, const JSON_Value *value, size_t *offset) {
+    JSON_Array *array = NULL;
+    size_t i = 0, count = 0, *items = NULL;
+    double number = 0.0;
+    unsigned char bytes[8];
+    const unsigned char *raw = (const unsigned char*)&number;
+    int little_endian = host_is_little_endian();
+    JSON_Status status = JSONSuccess;
+    if (writer->len > SNAPSHOT_MAX_SIZE - 64) {
+        return JSONFailure;
+    }
+    value = json_value_view(value);
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            array = json_value_get_array(value);
+            count = json_array_get_count(array);
+            if (count > 0) {
+                items = (size_t*)parson_malloc(count * sizeof(size_t));
+                if (items == NULL) {
+                    return JSONFailure;
+                }
+            }
+            for (i = 0; i < count && status == JSONSuccess; i++) {
+                status = snapshot_put_value(writer, names, json_array_get_value(array, i), &items[i]);
+            }
+            *offset = writer->len;
+            if (status == JSONSuccess && (snapshot_put_u32(writer, JSONArray) != JSONSuccess
+                                          || snapshot_put_u32(writer, count) != JSONSuccess)) {
+                status = JSONFailure;
+            }
+            for (i = 0; i < count && status == JSONSuccess; i++) {
+                status = snapshot_put_u32(writer, *offset - items[i]);
+            }
+            parson_free(items);
+            return status;
+        case JSONObject:
+            return snapshot_put_object(writer, names, json_value_get_object(value), offset);
+        case JSONString:
+            return snapshot_put_string(writer, json_value_get_string(value), offset);
+        case JSONNumber:
+            *offset = writer->len;
+            number = json_value_get_number(value);
+            for (i = 0; i < 8; i++) {
+                bytes[i] = raw[little_endian ? i : 7 - i];
+            }
+            if (snapshot_put_u32(writer, JSONNumber) != JSONSuccess) {
+                return JSONFailure;
+            }
+            return binary_put(writer, bytes, 8);
+        case JSONBoolean:
+            *offset = writer->len;
+            return snapshot_put_u32(writer, JSONBoolean | (json_value_get_boolean(value) ? 0x100 : 0));
+        case JSONNull:
+            *offset = writer->len;
+            return snapshot_put_u32(writer, JSONNull);
+        default:
+            return JSONFailure;
+    }
+}
+
+/* Returns node referenced by distance stored at given byte offset of node */
+static const unsigned char * snapshot_child(const unsigned char *node, size_t field) {
+    return node - snapshot_get_u32(node + field);
+}
+
+/* Orders name like snapshot_compare_entries does */
+static int snapshot_compare_name(const unsigned char *name_node, const char *name, size_t name_len) {
+    size_t len = snapshot_get_u32(name_node + 4);
+    int result = memcmp(name_node + 8, name, MIN(len, name_len));
+    if (result != 0) {
+        return result;
+    }
+    return len == name_len ? 0 : (len < name_len ? -1 : 1);
+}
+
+/* Checks node at offset and everything it references. Checked has a bit for every 4 byte slot, so
+   nodes referenced many times (names) are checked once, only containers can't be shared. */
+static JSON_Status snapshot_validate(const JSON_Snapshot *snapshot, unsigned char *checked, size_t offset, size_t nesting) {
+    const unsigned char *node = snapshot->data + offset;
+    const unsigned char *name = NULL, *previous = NULL;
+    size_t available = snapshot->size - offset, count = 0, i = 0, distance = 0, len = 0, entry = 0;
+    unsigned long header = 0;
+    if (nesting > MAX_NESTING || offset < SNAPSHOT_HEADER_SIZE || offset % 4 != 0 || available < 4) {
+        return JSONFailure;
+    }
+    header = snapshot_get_u32(node);
+    if (checked[offset / 32] & (1 << (offset / 4 % 8))) {
+        return (header & 0xff) == JSONArray || (header & 0xff) == JSONObject ? JSONFailure : JSONSuccess;
+    }
+    checked[offset / 32] |= (unsigned char)(1 << (offset / 4 % 8));
+    switch (header & 0xff) {
+        case JSONNull:
+            return header == JSONNull ? JSONSuccess : JSONFailure;
+        case JSONBoolean:
+            return (header & ~0x100UL) == JSONBoolean ? JSONSuccess : JSONFailure;
+        case JSONNumber:
+            return header == JSONNumber && available >= 12 ? JSONSuccess : JSONFailure;
+        case JSONString:
+            if (header != JSONString || available < 8) {
+                return JSONFailure;
+            }
+            len = snapshot_get_u32(node + 4);
+            if (len >= available - 8 || node[8 + len] != '\0' || memchr(node + 8, '\0', len) != NULL
+                || !is_valid_utf8((const char*)node + 8, len)) {
+                return JSONFailure;
+            }
+            return JSONSuccess;
+        case JSONArray: case JSONObject:
+            if ((header != JSONArray && header != JSONObject) || available < 8) {
+                return JSONFailure;
+            }
+            count = snapshot_get_u32(node + 4);
+            if (count > (available - 8) / (header == JSONArray ? 4 : 12)) {
+                return JSONFailure;
+            }
+            for (i = 0; i < (header == JSONArray ? count : count * 2); i++) {
+                distance = snapshot_get_u32(node + 8 + i * 4);
+                if (distance == 0 || distance > offset
+                    || snapshot_validate(snapshot, checked, offset - distance, nesting + 1) != JSONSuccess
+                    || (header == JSONObject && i % 2 == 0 && snapshot_get_u32(node - distance) != JSONString)) {
+                    return JSONFailure;
+                }
+            }
+            for (i = 0; header == JSONObject && i < count; i++) { /* names are strictly increasing */
+                entry = snapshot_get_u32(node + 8 + count * 8 + i * 4);
+                if (entry >= count) {
+                    return JSONFailure;
+                }
+                name = snapshot_child(node, 8 + entry * 8);
+                if (previous != NULL && snapshot_compare_name(previous, (const char*)name + 8, snapshot_get_u32(name + 4)) >= 0) {
+                    return JSONFailure;
+                }
+                previous = name;
+            }
+            return JSONSuccess;
+        default:
+            return JSONFailure;
+    }
+}
+
+/* Binary search in object's sorted entries */
+static const JSON_Snapshot_Value * snapshot_getn_value(const JSON_Snapshot_Value *object, const char *name, size_t name_len) {
+    const unsigned char *node = (const unsigned char*)object;
+    size_t count = 0, low = 0, high = 0, middle = 0, entry = 0;
+    int result = 0;
+    if (json_snapshot_get_type(object) != JSONObject || name == NULL) {
+        return NULL;
+    }
+    count = snapshot_get_u32(node + 4);
+    high = count;
+    while (low < high) {
+        middle = low + (high - low) / 2;
+        entry = snapshot_get_u32(node + 8 + count * 8 + middle * 4);
+        result = snapshot_compare_name(snapshot_child(node, 8 + entry * 8), name, name_len);
+        if (result == 0) {
+            return (const JSON_Snapshot_Value*)snapshot_child(node, 12 + entry * 8);
+        } else if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+static JSON_Snapshot * snapshot_init(const unsigned char *data, size_t size) {
+    JSON_Snapshot *snapshot = NULL;
+    unsigned char *checked = NULL;
+    JSON_Status status = JSONFailure;
+    if (data == NULL || size < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, 4) != 0
+        || snapshot_get_u32(data + 4) != SNAPSHOT_VERSION || snapshot_get_u32(data + 8) != size) {
+        return NULL;
+    }
+    snapshot = (JSON_Snapshot*)parson_malloc(sizeof(JSON_Snapshot));
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    snapshot->data = data;
+    snapshot->size = size;
+    snapshot->mapped = 0;
+    snapshot->owned = 0;
+    checked = (unsigned char*)parson_malloc(size / 32 + 1);
+    if (checked != NULL) {
+        memset(checked, 0, size / 32 + 1);
+        status = snapshot_validate(snapshot, checked, snapshot_get_u32(data + 12), 0);
+    }
+    parson_free(checked);
+    if (status != JSONSuccess) {
+        parson_free(snapshot);
+        return NULL;
+    }
+    return snapshot;
+}
+
+/* Serialization */
+#define APPEND_STRING(str) do { written = append_string(buf, (str));\
+                                if (written < 0) { return -1; }\
+                                if (buf != NULL) { buf += written; }\
+                                written_total += written; } while(0)
+
+#define APPEND_INDENT(level) do { written = append_indent(buf, (level));\
+                                  if (written < 0) { return -1; }\
+                                  if (buf != NULL) { buf += written; }\
+                                  written_total += written; } while(0)
+
+static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty, char *num_buf)
+{
+    const char *string = NULL;
+    JSON_Array *array = NULL;
+    JSON_Object *object = NULL;
+    size_t count = 0;
+    double num = 0.0;
+    int written = -1, written_total = 0;
+    const char *raw = NULL;
+    size_t raw_len = 0;
+    int use_cache = parson_serialization_cache && !is_pretty;
+
+    raw = json_value_raw_text(value, &raw_len);
+    if (raw != NULL) { /* unparsed raw fragment */
+        return append_raw(buf, raw, raw_len);
+    }
+    value = json_value_view(value);
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            array = json_value_get_array(value);
+            if (use_cache && array->serialized != NULL) {
+                return append_raw(buf, array->serialized, array->serialized_len);
+            }
+            count = json_array_get_count(array);
+            APPEND_STRING("[");
+            if (count > 0 && is_pretty) {
+                APPEND_STRING("\n");
+            }
+            written = json_serialize_items_r(value, 0, count, buf, level, is_pretty, num_buf);
+            if (written < 0) {
+                return -1;
+            }
+            if (buf != NULL) {
+                buf += written;
+            }
+            written_total += written;
+            if (count > 0 && is_pretty) {
+                APPEND_INDENT(level);
+            }
+            APPEND_STRING("]");
+            if (use_cache && buf != NULL) {
+                serialization_cache_store(&array->serialized, &array->serialized_len, buf - written_total, written_total);
+            }
+            return written_total;
+        case JSONObject:
+            object = json_value_get_object(value);
+            if (use_cache && object->serialized != NULL) {
+                return append_raw(buf, object->serialized, object->serialized_len);
+            }
+            count  = json_object_get_count(object);
+            APPEND_STRING("{");
+            if (count > 0 && is_pretty) {
+                APPEND_STRING("\n");
+            }
+            written = json_serialize_items_r(value, 0, count, buf, level, is_pretty, num_buf);
+            if (written < 0) {
+                return -1;
+            }
+            if (buf != NULL) {
+                buf += written;
+            }
+            written_total += written;
+            if (count > 0 && is_pretty) {
+                APPEND_INDENT(level);
+            }
+            APPEND_STRING("}");
+            if (use_cache && buf != NULL) {
+                serialization_cache_store(&object->serialized, &object->serialized_len, buf - written_total, written_total);
+            }
+            return written_total;
+        case JSONString:
+            string = json_value_get_string(value);
+            if (string == NULL) {
+                return -1;
+            }
+            written = json_serialize_string(string, buf);
+            if (written < 0) {
+                return -1;
+            }
+            if (buf != NULL) {
+                buf += written;
+            }
+            written_total += written;
+            return written_total;
+        case JSONBoolean:
+            if (json_value_get_boolean(value)) {
+                APPEND_STRING("true");
+            } else {
+                APPEND_STRING("false");
+            }
+            return written_total;
+        case JSONNumber:
+            if (value->storage == JSONStorageText) { /* original text */
+                APPEND_STRING(value->value.text);
+                return written_total;
+            }
+            num = json_value_get_number(value);
+            if (buf != NULL) {
+                num_buf = buf;
+            }
+            written = sprintf(num_buf, FLOAT_FORMAT, num);
+            if (written < 0) {
+                return -1;
+            }
+            if (buf != NULL) {
+                buf += written;
+            }
+            written_total += written;
+            return written_total;
+        case JSONNull:
+            APPEND_STRING("null");
+            return written_total;
+        case JSONError:
+            return -1;
+        default:
+            return -1;
+    }
+}
+
+/* Writes items begin to end - 1 of an array or object (value has to be a view) the way they
+   appear between its brackets, including their separators */
+static int json_serialize_items_r(const JSON_Value *value, size_t begin, size_t end, char *buf, int level, int is_pretty, char *num_buf) {
+    JSON_Array *array = NULL;
+    JSON_Object *object = NULL;
+    JSON_Value *temp_value = NULL;
+    size_t i = 0, count = 0;
+    int written = -1, written_total = 0;
+    if (json_value_get_type(value) == JSONObject) {
+        object = json_value_get_object(value);
+        count = json_object_get_count(object);
+    } else {
+        array = json_value_get_array(value);
+        count = json_array_get_count(array);
+    }
+    for (i = begin; i < end; i++) {
+        if (is_pretty) {
+            APPEND_INDENT(level+1);
+        }
+        if (object != NULL) {
+            if (json_object_get_name(object, i) == NULL) {
+                return -1;
+            }
+            written = append_key(buf, object, i);
+            if (written < 0) {
+                return -1;
+            }
+            if (buf != NULL) {
+                buf += written;
+            }
+            written_total += written;
+            APPEND_STRING(":");
+            if (is_pretty) {
+                APPEND_STRING(" ");
+            }
+            temp_value = json_object_get_value_at(object, i);
+        } else {
+            temp_value = json_array_get_value(array, i);
+        }
+        written = json_serialize_to_buffer_r(temp_value, buf, level+1, is_pretty, num_buf);
+        if (written < 0) {
+            return -1;
+        }
+        if (buf != NULL) {
+            buf += written;
+        }
+        written_total += written;
+        if (i < (count - 1)) {
+            APPEND_STRING(",");
+        }
+        if (is_pretty) {
+            APPEND_STRING("\n");
+        }
+    }
+    return written_total;
+}
+
+static int json_serialize_string(const char *string, char *buf) {
+    int written = -1, written_total = 0;
+    APPEND_STRING("\"");
+    written = json_serialize_chars(string, strlen(string), buf);
+    if (buf != NULL) {
+        buf += written;
+    }
+    written_total += written;
+    APPEND_STRING("\"");
+    return written_total;
+}
+
+/* Writes escaped characters without surrounding quotes */
+static int json_serialize_chars(const char *string, size_t len, char *buf) {
+    size_t i = 0;
+    char c = '\0';
+    int written = -1, written_total = 0;
+    for (i = 0; i < len; i++) {
+        c = string[i];
+        switch (c) {
+            case '\"': APPEND_STRING("\\\""); break;
+            case '\\': APPEND_STRING("\\\\"); break;
+            case '/':  APPEND_STRING("\\/"); break; /* to make json embeddable in xml\/html */
+            case '\b': APPEND_STRING("\\b"); break;
+            case '\f': APPEND_STRING("\\f"); break;
+            case '\n': APPEND_STRING("\\n"); break;
+            case '\r': APPEND_STRING("\\r"); break;
+            case '\t': APPEND_STRING("\\t"); break;
+            case '\x00': APPEND_STRING("\\u0000"); break;
+            case '\x01': APPEND_STRING("\\u0001"); break;
+            case '\x02': APPEND_STRING("\\u0002"); break;
+            case '\x03': APPEND_STRING("\\u0003"); break;
+            case '\x04': APPEND_STRING("\\u0004"); break;
+            case '\x05': APPEND_STRING("\\u0005"); break;
+            case '\x06': APPEND_STRING("\\u0006"); break;
+            case '\x07': APPEND_STRING("\\u0007"); break;
+            /* '\x08' duplicate: '\b' */
+            /* '\x09' duplicate: '\t' */
+            /* '\x0a' duplicate: '\n' */
+            case '\x0b': APPEND_STRING("\\u000b"); break;
+            /* '\x0c' duplicate: '\f' */
+            /* '\x0d' duplicate: '\r' */
+            case '\x0e': APPEND_STRING("\\u000e"); break;
+            case '\x0f': APPEND_STRING("\\u000f"); break;
+            case '\x10': APPEND_STRING("\\u0010"); break;
+            case '\x11': APPEND_STRING("\\u0011"); break;
+            case '\x12': APPEND_STRING("\\u0012"); break;
+            case '\x13': APPEND_STRING("\\u0013"); break;
+            case '\x14': APPEND_STRING("\\u0014"); break;
+            case '\x15': APPEND_STRING("\\u0015"); break;
+            case '\x16': APPEND_STRING("\\u0016"); break;
+            case '\x17': APPEND_STRING("\\u0017"); break;
+            case '\x18': APPEND_STRING("\\u0018"); break;
+            case '\x19': APPEND_STRING("\\u0019"); break;
+            case '\x1a': APPEND_STRING("\\u001a"); break;
+            case '\x1b': APPEND_STRING("\\u001b"); break;
+            case '\x1c': APPEND_STRING("\\u001c"); break;
+            case '\x1d': APPEND_STRING("\\u001d"); break;
+            case '\x1e': APPEND_STRING("\\u001e"); break;
+            case '\x1f': APPEND_STRING("\\u001f"); break;
+            default:
+                if (buf != NULL) {
+                    buf[0] = c;
+                    buf += 1;
+                }
+                written_total += 1;
+                break;
+        }
+    }
+    return written_total;
+}
+
+static int append_indent(char *buf, int level) {
+    int i;
+    int written = -1, written_total = 0;
+    for (i = 0; i < level; i++) {
+        APPEND_STRING("    ");
+    }
+    return written_total;
+}
+
+static int append_raw(char *buf, const char *text, size_t len) {
+    if (len > INT_MAX) {
+        return -1;
+    }
+    if (buf != NULL) {
+        memcpy(buf, text, len);
+        buf[len] = '\0';
+    }
+    return (int)len;
+}
+
+static int json_serialize_to_segments_r(const JSON_Value *value, JSON_Segment_Writer *writer, char *num_buf) {
+    JSON_Array *array = NULL;
+    JSON_Object *object = NULL;
+    const char *string = NULL;
+    const char *raw = NULL;
+    size_t i = 0, count = 0, raw_len = 0;
+    int written = -1;
+
+    raw = json_value_raw_text(value, &raw_len); /* copied, its text is freed when it's accessed */
+    if (raw == NULL) {
+        value = json_value_view(value);
+    }
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            if (raw != NULL) {
+                break;
+            }
+            array = json_value_get_array(value);
+            count = json_array_get_count(array);
+            if (segments_add_text(writer, "[") < 0) {
+                return -1;
+            }
+            for (i = 0; i < count; i++) {
+                if (i > 0 && segments_add_text(writer, ",") < 0) {
+                    return -1;
+                }
+                if (json_serialize_to_segments_r(json_array_get_value(array, i), writer, num_buf) < 0) {
+                    return -1;
+                }
+            }
+            return segments_add_text(writer, "]");
+        case JSONObject:
+            if (raw != NULL) {
+                break;
+            }
+            object = json_value_get_object(value);
+            count = json_object_get_count(object);
+            if (segments_add_text(writer, "{") < 0) {
+                return -1;
+            }
+            for (i = 0; i < count; i++) {
+                if (i > 0 && segments_add_text(writer, ",") < 0) {
+                    return -1;
+                }
+                written = append_key(segments_scratch_end(writer), object, i);
+                if (written < 0) {
+                    return -1;
+                }
+                segments_add_scratch(writer, written);
+                if (segments_add_text(writer, ":") < 0) {
+                    return -1;
+                }
+                if (json_serialize_to_segments_r(json_object_get_value_at(object, i), writer, num_buf) < 0) {
+                    return -1;
+                }
+            }
+            return segments_add_text(writer, "}");
+        case JSONString:
+            string = json_value_get_string(value);
+            if (string == NULL) {
+                return -1;
+            }
+            return json_serialize_string_segments(string, strlen(string), writer);
+        case JSONError:
+            return -1;
+        default:
+            break;
+    }
+    /* raw fragments and other scalars are written by regular serializer */
+    written = json_serialize_to_buffer_r(value, segments_scratch_end(writer), 0, 0, num_buf);
+    if (written < 0) {
+        return -1;
+    }
+    segments_add_scratch(writer, written);
+    return 0;
+}
+
+/* Long runs of characters that don't need escaping are referenced, everything else is escaped into scratch */
+static int json_serialize_string_segments(const char *string, size_t len, JSON_Segment_Writer *writer) {
+    size_t i = 0, run_end = 0, copied = 0;
+    unsigned char c = 0;
+    if (segments_add_text(writer, "\"") < 0) {
+        return -1;
+    }
+    while (i < len) {
+        run_end = i;
+        while (run_end < len) {
+            c = (unsigned char)string[run_end];
+            if (c < 0x20 || c == '\"' || c == '\\' || c == '/') {
+                break;
+            }
+            run_end++;
+        }
+        if (run_end - i >= SEGMENT_MIN_REFERENCE) {
+            segments_add_scratch(writer, json_serialize_chars(string + copied, i - copied, segments_scratch_end(writer)));
+            segments_add_reference(writer, string + i, run_end - i);
+            copied = run_end;
+        }
+        i = run_end == i ? i + 1 : run_end;
+    }
+    segments_add_scratch(writer, json_serialize_chars(string + copied, len - copied, segments_scratch_end(writer)));
+    return segments_add_text(writer, "\"");
+}
+
+static char * segments_scratch_end(const JSON_Segment_Writer *writer) {
+    return writer->segments != NULL ? writer->scratch + writer->scratch_len : NULL;
+}
+
+/* Accounts for len bytes just written at segments_scratch_end */
+static void segments_add_scratch(JSON_Segment_Writer *writer, int len) {
+    if (len <= 0) {
+        return;
+    }
+    if (!writer->last_is_scratch) {
+        if (writer->segments != NULL) {
+            writer->segments[writer->count].data = writer->scratch + writer->scratch_len;
+            writer->segments[writer->count].length = 0;
+        }
+        writer->count++;
+        writer->last_is_scratch = 1;
+    }
+    if (writer->segments != NULL) {
+        writer->segments[writer->count - 1].length += (size_t)len;
+    }
+    writer->scratch_len += (size_t)len;
+}
+
+static int segments_add_text(JSON_Segment_Writer *writer, const char *text) {
+    int written = append_string(segments_scratch_end(writer), text);
+    if (written < 0) {
+        return -1;
+    }
+    segments_add_scratch(writer, written);
+    return 0;
+}
+
+static void segments_add_reference(JSON_Segment_Writer *writer, const char *data, size_t len) {
+    if (writer->segments != NULL) {
+        writer->segments[writer->count].data = data;
+        writer->segments[writer->count].length = len;
+    }
+    writer->count++;
+    writer->last_is_scratch = 0;
+}
+
+/* Keeps copy of container's compact serialization, it's dropped by json_value_invalidate */
+static void serialization_cache_store(char **cache, size_t *cache_len, const char *serialized, int len) {
+    if (*cache != NULL) {
+        return;
+    }
+    *cache = (char*)parson_malloc((size_t)len + 1);
+    if (*cache == NULL) {
+        return; /* cache is optional */
+    }
+    memcpy(*cache, serialized, (size_t)len);
+    (*cache)[len] = '\0';
+    *cache_len = (size_t)len;
+}
+
+/* Writes name of object's item using its cached serialized form */
+static int append_key(char *buf, const JSON_Object *object, size_t index) {
+    const JSON_Object_Key *key = &object->keys[index];
+    if (key->length == 0) { /* not cached */
+        return json_serialize_string(object->names[index], buf);
+    }
+    if (buf != NULL) {
+        if (key->escaped != NULL) {
+            memcpy(buf, key->escaped, key->length);
+        } else {
+            buf[0] = '\"';
+            memcpy(buf + 1, object->names[index], key->length - 2);
+            buf[key->length - 1] = '\"';
+        }
+        buf[key->length] = '\0';
+    }
+    return (int)key->length;
+}
+
+static int append_string(char *buf, const char *string) {
+    if (buf == NULL) {
+        return (int)strlen(string);
+    }
+    return sprintf(buf, "%s", string);
+}
+
+#undef APPEND_STRING
+#undef APPEND_INDENT
+
+#if PARSON_THREADS
+/* Returns view of value if it's an array or object with items that can be split between threads */
+static const JSON_Value * serialization_root(const JSON_Value *value) {
+    size_t raw_len = 0;
+    if (json_value_raw_text(value, &raw_len) != NULL) { /* copied verbatim */
+        return NULL;
+    }
+    value = json_value_view(value);
+    if (value == NULL) {
+        return NULL;
+    }
+    if ((value->type == JSONArray && value->value.array->count > 1) ||
+        (value->type == JSONObject && value->value.object->count > 1)) {
+        return value;
+    }
+    return NULL;
+}
+
+/* Returns 0 if serializing value would parse lazy containers, which isn't safe to do on several
+   threads since they share their source */
+static int serialization_is_expanded(const JSON_Value *value) {
+    size_t raw_len = 0, i = 0;
+    if (value == NULL || json_value_raw_text(value, &raw_len) != NULL) {
+        return 1;
+    }
+    if (value->storage == JSONStorageShared) {
+        value = value->value.shared.source;
+    }
+    if (value->storage == JSONStorageLazy) {
+        return 0;
+    }
+    if (value->type == JSONArray) {
+        for (i = 0; i < value->value.array->count; i++) {
+            if (!serialization_is_expanded(value->value.array->items[i])) {
+                return 0;
+            }
+        }
+    } else if (value->type == JSONObject) {
+        for (i = 0; i < value->value.object->count; i++) {
+            if (!serialization_is_expanded(value->value.object->values[i])) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void * serialization_worker(void *arg) {
+    JSON_Serialization_Job *job = (JSON_Serialization_Job*)arg;
+    JSON_Serialization_Chunk *chunk = NULL;
+    const JSON_Value *value = job->value;
+    char num_buf[NUM_BUF_SIZE];
+    char *buf = NULL; /* serialization null-terminates what it writes, so chunks are written here first */
+    size_t buf_size = 0, i = 0;
+    for (;;) {
+        pthread_mutex_lock(&job->mutex);
+        chunk = job->next < job->chunks_count ? &job->chunks[job->next++] : NULL;
+        pthread_mutex_unlock(&job->mutex);
+        if (chunk == NULL) {
+            break;
+        }
+        if (job->output == NULL) {
+            for (i = chunk->begin; i < chunk->end && !chunk->deferred; i++) {
+                chunk->deferred = !serialization_is_expanded(value->type == JSONArray ?
+                    value->value.array->items[i] : value->value.object->values[i]);
+            }
+            if (!chunk->deferred) {
+                chunk->size = json_serialize_items_r(value, chunk->begin, chunk->end, NULL, 0, job->is_pretty, num_buf);
+            }
+            continue;
+        }
+        if ((size_t)chunk->size + 1 > buf_size) {
+            parson_free(buf);
+            buf_size = (size_t)chunk->size + 1;
+            buf = (char*)parson_malloc(buf_size);
+            if (buf == NULL) {
+                buf_size = 0;
+                chunk->size = -1;
+                continue;
+            }
+        }
+        if (json_serialize_items_r(value, chunk->begin, chunk->end, buf, 0, job->is_pretty, NULL) != chunk->size) {
+            chunk->size = -1;
+            continue;
+        }
+        memcpy(job->output + chunk->offset, buf, (size_t)chunk->size);
+    }
+    parson_free(buf);
+    return NULL;
+}
+
+/* Processes all chunks with workers, calling thread is one of them */
+static void serialization_run(JSON_Serialization_Job *job, pthread_t *threads, size_t threads_count) {
+    size_t started = 0, i = 0;
+    job->next = 0;
+    for (started = 0; started < threads_count - 1; started++) {
+        if (pthread_create(&threads[started], NULL, serialization_worker, job) != 0) {
+            break;
+        }
+    }
+    serialization_worker(job);
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/* Serializes items of root array or object in chunks, sizes of chunks are computed in parallel,
+   then every chunk is written at its offset. Brackets are written like json_serialize_to_buffer_r
+   writes them at level 0. Returns NULL on fail. */
+static char * serialization_parallel(const JSON_Value *value, int is_pretty, size_t threads_count) {
+    JSON_Serialization_Job job;
+    pthread_t *threads = NULL;
+    char num_buf[NUM_BUF_SIZE];
+    size_t count = 0, per_chunk = 0, extra = 0, size = 0, i = 0;
+    int failed = 0;
+    memset(&job, 0, sizeof(JSON_Serialization_Job));
+    job.value = value;
+    job.is_pretty = is_pretty;
+    count = value->type == JSONArray ? value->value.array->count : value->value.object->count;
+    job.chunks_count = MIN(count, threads_count * SERIALIZATION_CHUNKS_PER_THREAD);
+    threads_count = MIN(threads_count, job.chunks_count);
+    job.chunks = (JSON_Serialization_Chunk*)parson_malloc(job.chunks_count * sizeof(JSON_Serialization_Chunk));
+    threads = (pthread_t*)parson_malloc((threads_count - 1) * sizeof(pthread_t));
+    if (job.chunks == NULL || threads == NULL || pthread_mutex_init(&job.mutex, NULL) != 0) {
+        parson_free(job.chunks);
+        parson_free(threads);
+        return NULL;
+    }
+    per_chunk = count / job.chunks_count;
+    extra = count % job.chunks_count;
+    for (i = 0; i < job.chunks_count; i++) {
+        job.chunks[i].begin = i * per_chunk + MIN(i, extra);
+        job.chunks[i].end = job.chunks[i].begin + per_chunk + (i < extra ? 1 : 0);
+        job.chunks[i].size = 0;
+        job.chunks[i].deferred = 0;
+    }
+    serialization_run(&job, threads, threads_count);
+    size = is_pretty ? 2 : 1; /* opening bracket and newline */
+    for (i = 0; i < job.chunks_count; i++) {
+        if (job.chunks[i].deferred) { /* lazy values are parsed here, on one thread */
+            job.chunks[i].size = json_serialize_items_r(value, job.chunks[i].begin, job.chunks[i].end, NULL, 0, is_pretty, num_buf);
+        }
+        if (job.chunks[i].size < 0) {
+            failed = 1;
+            break;
+        }
+        job.chunks[i].offset = size;
+        size += (size_t)job.chunks[i].size;
+    }
+    if (!failed) {
+        job.output = (char*)parson_malloc(size + 2); /* closing bracket and null */
+        failed = job.output == NULL;
+    }
+    if (!failed) {
+        serialization_run(&job, threads, threads_count);
+        for (i = 0; i < job.chunks_count; i++) {
+            failed = failed || job.chunks[i].size < 0;
+        }
+    }
+    if (!failed) {
+        job.output[0] = value->type == JSONArray ? '[' : '{';
+        if (is_pretty) {
+            job.output[1] = '\n';
+        }
+        job.output[size] = value->type == JSONArray ? ']' : '}';
+        job.output[size + 1] = '\0';
+    } else {
+        parson_free(job.output);
+        job.output = NULL;
+    }
+    pthread_mutex_destroy(&job.mutex);
+    parson_free(job.chunks);
+    parson_free(threads);
+    return job.output;
+}
+#endif
+
+/* Binary formats */
+static int host_is_little_endian(void) {
+    const unsigned int one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+static JSON_Status binary_put(JSON_Binary_Writer *writer, const void *data, size_t len) {
+    if (writer->write_fun == NULL) {
+        if (writer->buf != NULL) {
+            memcpy(writer->buf + writer->len, data, len);
+        }
+        writer->len += len;
+        return JSONSuccess;
+    }
+    if (writer->staged + len > BINARY_BUFFER_SIZE && binary_flush(writer) != JSONSuccess) {
+        return JSONFailure;
+    }
+    if (len >= BINARY_BUFFER_SIZE) { /* large strings skip staging */
+        writer->len += len;
+        return writer->write_fun(data, len, writer->arg);
+    }
+    memcpy(writer->stage + writer->staged, data, len);
+    writer->staged += len;
+    writer->len += len;
+    return JSONSuccess;
+}
+
+static JSON_Status binary_flush(JSON_Binary_Writer *writer) {
+    size_t staged = writer->staged;
+    writer->staged = 0;
+    if (staged == 0) {
+        return JSONSuccess;
+    }
+    return writer->write_fun(writer->stage, staged, writer->arg);
+}
+
+/* Splits non-negative integral number up to 2^53 into 32 bit halves, returns 0 for other numbers */
+static int split_integer(double number, unsigned long *high, unsigned long *low) {
+    double low_part = 0.0;
+    if (number < 0 || number > MAX_SAFE_INTEGER) {
+        return 0;
+    }
+    *high = (unsigned long)(number / 4294967296.0);
+    low_part = number - (double)*high * 4294967296.0;
+    *low = (unsigned long)low_part;
+    return (double)*low == low_part;
+}
+
+/* Integral numbers that are exact in a double (other than negative zero) are written as integers.
+   With use_text, lazy numbers written with a fraction or exponent are floats even if integral. */
+static int binary_is_integer(const JSON_Value *value, int use_text) {
+    double number = json_value_get_number(value), zero = 0.0;
+    unsigned long high = 0, low = 0;
+    if (use_text && value->storage == JSONStorageText && strpbrk(value->value.text, ".eE") != NULL) {
+        return 0;
+    }
+    if (number == 0.0 && memcmp(&number, &zero, sizeof(double)) != 0) {
+        return 0;
+    }
+    return split_integer(fabs(number), &high, &low);
+}
+
+/* Writes tag followed by width (1, 2, 4 or 8) bytes of big-endian integer, complement inverts them */
+static JSON_Status binary_put_integer(JSON_Binary_Writer *writer, unsigned char tag, unsigned long high, unsigned long low, size_t width, int complement) {
+    unsigned char bytes[9];
+    size_t i = 0;
+    bytes[0] = tag;
+    for (i = 0; i < width; i++) {
+        bytes[width - i] = (unsigned char)((i < 4 ? low >> (8 * i) : high >> (8 * (i - 4))) & 0xff);
+        if (complement) {
+            bytes[width - i] = (unsigned char)~bytes[width - i];
+        }
+    }
+    return binary_put(writer, bytes, width + 1);
+}
+
+/* Writes tag followed by big-endian IEEE 754 single (bytes is 4) or double precision number */
+static JSON_Status binary_put_float(JSON_Binary_Writer *writer, unsigned char tag, double number, size_t bytes) {
+    unsigned char data[9];
+    float single = (float)number;
+    const unsigned char *raw = bytes == 4 ? (const unsigned char*)&single : (const unsigned char*)&number;
+    int little_endian = host_is_little_endian();
+    size_t i = 0;
+    data[0] = tag;
+    for (i = 0; i < bytes; i++) {
+        data[i + 1] = raw[little_endian ? bytes - 1 - i : i];
+    }
+    return binary_put(writer, data, bytes + 1);
+}
+
+static JSON_Status binary_get(JSON_Binary_Reader *reader, void *data, size_t len) {
+    size_t read = 0, total = 0;
+    if (reader->read_fun == NULL) {
+        if (len > reader->size - reader->pos) {
+            return JSONFailure;
+        }
+        memcpy(data, reader->data + reader->pos, len);
+        reader->pos += len;
+        return JSONSuccess;
+    }
+    while (total < len) {
+        read = reader->read_fun((char*)data + total, len - total, reader->arg);
+        if (read == 0) {
+            return JSONFailure;
+        }
+        total += read;
+    }
+    reader->pos += len;
+    return JSONSuccess;
+}
+
+static JSON_Status binary_get_uint(JSON_Binary_Reader *reader, size_t bytes, double *result) {
+    unsigned char data[8];
+    size_t i = 0;
+    if (binary_get(reader, data, bytes) != JSONSuccess) {
+        return JSONFailure;
+    }
+    *result = 0.0;
+    for (i = 0; i < bytes; i++) {
+        *result = *result * 256.0 + data[i];
+    }
+    return JSONSuccess;
+}
+
+static JSON_Status binary_get_float(JSON_Binary_Reader *reader, size_t bytes, double *result) {
+    unsigned char data[8], raw[8];
+    int little_endian = host_is_little_endian();
+    float single = 0.0f;
+    size_t i = 0;
+    if (binary_get(reader, data, bytes) != JSONSuccess) {
+        return JSONFailure;
+    }
+    for (i = 0; i < bytes; i++) {
+        raw[i] = data[little_endian ? bytes - 1 - i : i];
+    }
+    if (bytes == 4) {
+        memcpy(&single, raw, sizeof(float));
+        *result = single;
+    } else {
+        memcpy(result, raw, sizeof(double));
+    }
+    return JSONSuccess;
+}
+
+/* Length of streamed strings isn't known to be backed by data, so their buffer is doubled
+   as pieces arrive instead of being allocated for the whole length up front */
+static char * binary_get_string(JSON_Binary_Reader *reader, size_t len) {
+    char *string = NULL, *new_string = NULL;
+    size_t capacity = len, used = 0;
+    if (reader->read_fun == NULL && len > reader->size - reader->pos) {
+        return NULL; /* don't allocate for truncated input */
+    }
+    if (reader->read_fun != NULL) {
+        capacity = MIN(len, BINARY_STRING_PIECE);
+    }
+    string = (char*)parson_malloc(capacity + 1);
+    if (string == NULL) {
+        return NULL;
+    }
+    for (;;) {
+        if (binary_get(reader, string + used, capacity - used) != JSONSuccess) {
+            parson_free(string);
+            return NULL;
+        }
+        used = capacity;
+        if (used == len) {
+            break;
+        }
+        capacity = len - used > used ? used * 2 : len;
+        new_string = (char*)parson_malloc(capacity + 1);
+        if (new_string == NULL) {
+            parson_free(string);
+            return NULL;
+        }
+        memcpy(new_string, string, used);
+        parson_free(string);
+        string = new_string;
+    }
+    if (memchr(string, '\0', len) != NULL || !is_valid_utf8(string, len)) {
+        parson_free(string);
+        return NULL;
+    }
+    string[len] = '\0';
+    return string;
+}
+
+/* Integral floats keep a fraction in their text so they're written back as floats */
+static JSON_Value * binary_number_value(double number, int is_float) {
+    char text[NUM_BUF_SIZE];
+    unsigned long high = 0, low = 0;
+    int len = 0;
+    if (is_float && split_integer(fabs(number), &high, &low)) {
+        len = sprintf(text, "%1.17g", number);
+        if (len > 0 && (size_t)len + 2 < NUMBER_TEXT_SIZE && strpbrk(text, ".eE") == NULL) {
+            memcpy(text + len, ".0", 3);
+            return json_value_init_number_text(text, (size_t)len + 2);
+        }
+    }
+    return json_value_init_number(number);
+}
+
+/* MessagePack */
+/* Writes tag followed by value as big-endian unsigned integer of given width */
+static JSON_Status msgpack_put_header(JSON_Binary_Writer *writer, unsigned char tag, size_t value, size_t bytes) {
+    unsigned char header[9];
+    size_t i = 0;
+    header[0] = tag;
+    for (i = bytes; i > 0; i--) {
+        header[i] = (unsigned char)(value & 0xff);
+        value >>= 8;
+    }
+    return binary_put(writer, header, bytes + 1);
+}
+
+/* Writes fix_tag|size when it fits fix_max, otherwise tag8 (if not 0), tag16 or tag16 + 1 with 8, 16 or 32 bit size */
+static JSON_Status msgpack_put_sized(JSON_Binary_Writer *writer, unsigned char fix_tag, size_t fix_max, unsigned char tag8, unsigned char tag16, size_t size) {
+    if (size <= fix_max) {
+        return msgpack_put_header(writer, (unsigned char)(fix_tag | size), 0, 0);
+    } else if (size <= 0xff && tag8 != 0) {
+        return msgpack_put_header(writer, tag8, size, 1);
+    } else if (size <= 0xffff) {
+        return msgpack_put_header(writer, tag16, size, 2);
+    } else if (size <= 0xffffffffUL) {
+        return msgpack_put_header(writer, (unsigned char)(tag16 + 1), size, 4);
+    }
+    return JSONFailure;
+}
+
+/* Integers are written using the shortest encoding, other numbers as float 64 */
+static JSON_Status msgpack_put_number(JSON_Binary_Writer *writer, const JSON_Value *value) {
+    double number = json_value_get_number(value);
+    unsigned long high = 0, low = 0;
+    size_t width = 0;
+    if (!binary_is_integer(value, 1)) {
+        return binary_put_float(writer, 0xcb, number, 8);
+    }
+    if (number >= 0 && number < 128) {
+        return binary_put_integer(writer, (unsigned char)number, 0, 0, 0, 0);
+    } else if (number < 0 && number >= -32) {
+        return binary_put_integer(writer, (unsigned char)(256 + (int)number), 0, 0, 0, 0);
+    }
+    /* negative numbers are written as complement of -number - 1 */
+    split_integer(number >= 0 ? number : -number - 1, &high, &low);
+    if (high != 0 || (number < 0 && low > 0x7fffffffUL)) {
+        width = 8;
+    } else if (low > (number >= 0 ? 0xffffUL : 0x7fffUL)) {
+        width = 4;
+    } else if (low > (number >= 0 ? 0xffUL : 0x7fUL)) {
+        width = 2;
+    } else {
+        width = 1;
+    }
+    return binary_put_integer(writer, (unsigned char)((number >= 0 ? 0xcc : 0xd0) + (width == 1 ? 0 : width == 2 ? 1 : width == 4 ? 2 : 3)),
+                              high, low, width, number < 0);
+}
+
+static JSON_Status msgpack_put_string(JSON_Binary_Writer *writer, const char *string) {
+    size_t len = strlen(string);
+    if (msgpack_put_sized(writer, 0xa0, 31, 0xd9, 0xda, len) != JSONSuccess) {
+        return JSONFailure;
+    }
+    return binary_put(writer, string, len);
+}
+
+static JSON_Status msgpack_write_value(JSON_Binary_Writer *writer, const JSON_Value *value) {
+    JSON_Array *array = NULL;
+    JSON_Object *object = NULL;
+    size_t i = 0, count = 0;
+    unsigned char tag = 0;
+    value = json_value_view(value);
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            array = json_value_get_array(value);
+            count = json_array_get_count(array);
+            if (msgpack_put_sized(writer, 0x90, 15, 0, 0xdc, count) != JSONSuccess) {
+                return JSONFailure;
+            }
+            for (i = 0; i < count; i++) {
+                if (msgpack_write_value(writer, json_array_get_value(array, i)) != JSONSuccess) {
+                    return JSONFailure;
+                }
+            }
+            return JSONSuccess;
+        case JSONObject:
+            object = json_value_get_object(value);
+            count = json_object_get_count(object);
+            if (msgpack_put_sized(writer, 0x80, 15, 0, 0xde, count) != JSONSuccess) {
+                return JSONFailure;
+            }
+            for (i = 0; i < count; i++) {
+                if (msgpack_put_string(writer, json_object_get_name(object, i)) != JSONSuccess
+                    || msgpack_write_value(writer, json_object_get_value_at(object, i)) != JSONSuccess) {
+                    return JSONFailure;
+                }
+            }
+            return JSONSuccess;
+        case JSONString:
+            return msgpack_put_string(writer, json_value_get_string(value));
+        case JSONNumber:
+            return msgpack_put_number(writer, value);
+        case JSONBoolean:
+            tag = json_value_get_boolean(value) ? 0xc3 : 0xc2;
+            return binary_put(writer, &tag, 1);
+        case JSONNull:
+            tag = 0xc0;
+            return binary_put(writer, &tag, 1);
+        default:
+            return JSONFailure;
+    }
+}
+
+/* Negative numbers are read as complement, so small magnitudes stay exact */
+static JSON_Status msgpack_get_int(JSON_Binary_Reader *reader, size_t bytes, double *result) {
+    unsigned char data[8];
+    size_t i = 0;
+    if (binary_get(reader, data, bytes) != JSONSuccess) {
+        return JSONFailure;
+    }
+    *result = 0.0;
+    for (i = 0; i < bytes; i++) {
+        *result = *result * 256.0 + (data[0] & 0x80 ? (unsigned char)~data[i] : data[i]);
+    }
+    if (data[0] & 0x80) {
+        *result = -*result - 1.0;
+    }
+    return JSONSuccess;
+}
+
+static JSON_Value * msgpack_read_value(JSON_Binary_Reader *reader, size_t nesting) {
+    unsigned char tag = 0;
+    double number = 0.0, size = 0.0;
+    size_t i = 0, count = 0;
+    char *string = NULL;
+    JSON_Value *value = NULL, *item = NULL, *name = NULL;
+    if (nesting > MAX_NESTING || binary_get(reader, &tag, 1) != JSONSuccess) {
+        return NULL;
+    }
+    if (tag <= 0x7f) {
+        return json_value_init_number(tag);
+    } else if (tag >= 0xe0) {
+        return json_value_init_number((double)tag - 256.0);
+    } else if (tag >= 0xa0 && tag <= 0xbf) {
+        count = tag & 0x1f;
+    } else if (tag >= 0x90 && tag <= 0x9f) {
+        count = tag & 0x0f;
+    } else if (tag >= 0x80 && tag <= 0x8f) {
+        count = tag & 0x0f;
+    } else {
+        switch (tag) {
+            case 0xc0: return json_value_init_null();
+            case 0xc2: return json_value_init_boolean(0);
+            case 0xc3: return json_value_init_boolean(1);
+            case 0xca: case 0xcb:
+                if (binary_get_float(reader, tag == 0xca ? 4 : 8, &number) != JSONSuccess) {
+                    return NULL;
+                }
+                return binary_number_value(number, 1);
+            case 0xcc: case 0xcd: case 0xce: case 0xcf:
+                if (binary_get_uint(reader, (size_t)1 << (tag - 0xcc), &number) != JSONSuccess) {
+                    return NULL;
+                }
+                return json_value_init_number(number);
+            case 0xd0: case 0xd1: case 0xd2: case 0xd3:
+                if (msgpack_get_int(reader, (size_t)1 << (tag - 0xd0), &number) != JSONSuccess) {
+                    return NULL;
+                }
+                return json_value_init_number(number);
+            case 0xd9: case 0xda: case 0xdb:
+                if (binary_get_uint(reader, (size_t)1 << (tag - 0xd9), &size) != JSONSuccess) {
+                    return NULL;
+                }
+                count = (size_t)size;
+                tag = 0xa0;
+                break;
+            case 0xdc: case 0xdd:
+                if (binary_get_uint(reader, tag == 0xdc ? 2 : 4, &size) != JSONSuccess) {
+                    return NULL;
+                }
+                count = (size_t)size;
+                tag = 0x90;
+                break;
+            case 0xde: case 0xdf:
+                if (binary_get_uint(reader, tag == 0xde ? 2 : 4, &size) != JSONSuccess) {
+                    return NULL;
+                }
+                count = (size_t)size;
+                tag = 0x80;
+                break;
+            default: /* bin, ext and reserved types have no JSON equivalent */
+                return NULL;
+        }
+    }
+    if (tag >= 0xa0) {
+        string = binary_get_string(reader, count);
+        if (string == NULL) {
+            return NULL;
+        }
+        value = json_value_init_string_no_copy(string);
+        if (value == NULL) {
+            parson_free(string);
+        }
+        return value;
+    }
+    value = tag >= 0x90 ? json_value_init_array() : json_value_init_object();
+    for (i = 0; value != NULL && i < count; i++) {
+        if (tag >= 0x90) {
+            item = msgpack_read_value(reader, nesting + 1);
+            if (item == NULL || json_array_append_value(json_array(value), item) != JSONSuccess) {
+                json_value_free(item);
+                json_value_free(value);
+                return NULL;
+            }
+            continue;
+        }
+        name = msgpack_read_value(reader, nesting + 1);
+        item = json_value_get_type(name) == JSONString ? msgpack_read_value(reader, nesting + 1) : NULL;
+        if (item == NULL || json_object_add(json_object(value), json_value_get_string(name), item) != JSONSuccess) {
+            json_value_free(name);
+            json_value_free(item);
+            json_value_free(value);
+            return NULL;
+        }
+        json_value_free(name);
+    }
+    return value;
+}
+
+/* CBOR */
+/* Writes major type with argument using the shortest encoding */
+static JSON_Status cbor_put_header(JSON_Binary_Writer *writer, unsigned char major, unsigned long high, unsigned long low) {
+    unsigned char tag = (unsigned char)(major << 5);
+    if (high != 0) {
+        return binary_put_integer(writer, (unsigned char)(tag | 27), high, low, 8, 0);
+    } else if (low > 0xffffUL) {
+        return binary_put_integer(writer, (unsigned char)(tag | 26), 0, low, 4, 0);
+    } else if (low > 0xffUL) {
+        return binary_put_integer(writer, (unsigned char)(tag | 25), 0, low, 2, 0);
+    } else if (low >= 24) {
+        return binary_put_integer(writer, (unsigned char)(tag | 24), 0, low, 1, 0);
+    }
+    return binary_put_integer(writer, (unsigned char)(tag | low), 0, 0, 0, 0);
+}
+
+/* Sets bits of IEEE 754 half precision number, returns 0 if number can't be represented exactly */
+static int cbor_half_bits(double number, unsigned int *bits) {
+    double magnitude = fabs(number), zero = 0.0;
+    unsigned long high = 0, mantissa = 0;
+    unsigned int sign = number < 0 || (number == 0.0 && memcmp(&number, &zero, sizeof(double)) != 0) ? 0x8000 : 0;
+    int exponent = 0;
+    if (magnitude == 0.0) {
+        *bits = sign;
+        return 1;
+    } else if (magnitude > 65504.0) {
+        return 0;
+    } else if (magnitude < 1.0 / 16384.0) { /* subnormal, multiple of 2^-24 */
+        if (!split_integer(magnitude * 16777216.0, &high, &mantissa) || mantissa >= 1024) {
+            return 0;
+        }
+        *bits = sign | (unsigned int)mantissa;
+        return 1;
+    }
+    while (magnitude >= 2.0) {
+        magnitude /= 2.0;
+        exponent++;
+    }
+    while (magnitude < 1.0) {
+        magnitude *= 2.0;
+        exponent--;
+    }
+    if (!split_integer((magnitude - 1.0) * 1024.0, &high, &mantissa)) {
+        return 0;
+    }
+    *bits = sign | (unsigned int)((exponent + 15) << 10) | (unsigned int)mantissa;
+    return 1;
+}
+
+/* Non-canonical floats are always double precision, canonical ones use the shortest exact form */
+static JSON_Status cbor_put_number(JSON_Binary_Writer *writer, const JSON_Value *value, int canonical) {
+    double number = json_value_get_number(value);
+    unsigned long high = 0, low = 0;
+    unsigned int half = 0;
+    if (binary_is_integer(value, !canonical)) {
+        split_integer(number >= 0 ? number : -number - 1, &high, &low);
+        return cbor_put_header(writer, number >= 0 ? 0 : 1, high, low);
+    }
+    if (canonical && cbor_half_bits(number, &half)) {
+        return binary_put_integer(writer, 0xf9, 0, half, 2, 0);
+    } else if (canonical && fabs(number) <= FLT_MAX && (double)(float)number == number) {
+        return binary_put_float(writer, 0xfa, number, 4);
+    }
+    return binary_put_float(writer, 0xfb, number, 8);
+}
+
+/* Orders names like their encodings: shorter first, then bytewise */
+static int cbor_compare_names(const void *a, const void *b) {
+    const char *name_a = *(const char * const *)a, *name_b = *(const char * const *)b;
+    size_t len_a = strlen(name_a), len_b = strlen(name_b);
+    if (len_a != len_b) {
+        return len_a < len_b ? -1 : 1;
+    }
+    return memcmp(name_a, name_b, len_a);
+}
+
+static JSON_Status cbor_put_string(JSON_Binary_Writer *writer, const char *string) {
+    size_t len = strlen(string);
+    if (cbor_put_header(writer, 3, 0, (unsigned long)len) != JSONSuccess) {
+        return JSONFailure;
+    }
+    return binary_put(writer, string, len);
+}
+
+/* Canonical objects are written with sorted names */
+static JSON_Status cbor_put_object(JSON_Binary_Writer *writer, const JSON_Object *object, int canonical) {
+    size_t i = 0, count = json_object_get_count(object);
+    const char **names = NULL;
+    JSON_Status status = JSONSuccess;
+    if (cbor_put_header(writer, 5, 0, (unsigned long)count) != JSONSuccess) {
+        return JSONFailure;
+    }
+    if (canonical && count > 1) {
+        names = (const char**)parson_malloc(count * sizeof(char*));
+        if (names == NULL) {
+            return JSONFailure;
+        }
+        for (i = 0; i < count; i++) {
+            names[i] = json_object_get_name(object, i);
+        }
+        qsort(names, count, sizeof(char*), cbor_compare_names);
+    }
+    for (i = 0; i < count && status == JSONSuccess; i++) {
+        status = cbor_put_string(writer, names != NULL ? names[i] : json_object_get_name(object, i));
+        if (status == JSONSuccess) {
+            status = cbor_write_value(writer, names != NULL ? json_object_get_value(object, names[i])
+                                                            : json_object_get_value_at(object, i), canonical);
+        }
+    }
+    parson_free(names);
+    return status;
+}
+
+static JSON_Status cbor_write_value(JSON_Binary_Writer *writer, const JSON_Value *value, int canonical) {
+    JSON_Array *array = NULL;
+    size_t i = 0, count = 0;
+    value = json_value_view(value);
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            array = json_value_get_array(value);
+            count = json_array_get_count(array);
+            if (cbor_put_header(writer, 4, 0, (unsigned long)count) != JSONSuccess) {
+                return JSONFailure;
+            }
+            for (i = 0; i < count; i++) {
+                if (cbor_write_value(writer, json_array_get_value(array, i), canonical) != JSONSuccess) {
+                    return JSONFailure;
+                }
+            }
+            return JSONSuccess;
+        case JSONObject:
+            return cbor_put_object(writer, json_value_get_object(value), canonical);
+        case JSONString:
+            return cbor_put_string(writer, json_value_get_string(value));
+        case JSONNumber:
+            return cbor_put_number(writer, value, canonical);
+        case JSONBoolean:
+            return binary_put_integer(writer, json_value_get_boolean(value) ? 0xf5 : 0xf4, 0, 0, 0, 0);
+        case JSONNull:
+            return binary_put_integer(writer, 0xf6, 0, 0, 0, 0);
+        default:
+            return JSONFailure;
+    }
+}
+
+static unsigned char * cbor_encode(const JSON_Value *value, size_t *size, int canonical) {
+    JSON_Binary_Writer writer;
+    unsigned char *data = NULL;
+    if (size == NULL) {
+        return NULL;
+    }
+    *size = 0;
+    memset(&writer, 0, sizeof(writer));
+    if (cbor_write_value(&writer, value, canonical) != JSONSuccess) {
+        return NULL;
+    }
+    data = (unsigned char*)parson_malloc(writer.len);
+    if (data == NULL) {
+        return NULL;
+    }
+    writer.buf = data;
+    writer.len = 0;
+    if (cbor_write_value(&writer, value, canonical) != JSONSuccess) {
+        parson_free(data);
+        return NULL;
+    }
+    *size = writer.len;
+    return data;
+}
+
+/* Reads argument of initial byte (which must not be indefinite length) */
+static JSON_Status cbor_get_argument(JSON_Binary_Reader *reader, unsigned char initial, double *result) {
+    unsigned char info = (unsigned char)(initial & 0x1f);
+    if (info < 24) {
+        *result = info;
+        return JSONSuccess;
+    } else if (info > 27) {
+        return JSONFailure;
+    }
+    return binary_get_uint(reader, (size_t)1 << (info - 24), result);
+}
+
+static double cbor_half_value(unsigned int bits) {
+    unsigned int exponent = (bits >> 10) & 0x1f;
+    double value = (double)(bits & 0x3ff);
+    if (exponent == 0) {
+        value /= 16777216.0; /* subnormal, mantissa * 2^-24 */
+    } else {
+        value = (value + 1024.0) / 33554432.0; /* (1024 + mantissa) * 2^(exponent - 25) */
+        while (exponent-- > 0) {
+            value *= 2.0;
+        }
+    }
+    return bits & 0x8000 ? -value : value;
+}
+
+/* Reads chunks of indefinite length string until break */
+static char * cbor_get_chunked_string(JSON_Binary_Reader *reader) {
+    char *string = NULL, *grown = NULL;
+    size_t len = 0, chunk_len = 0;
+    unsigned char initial = 0;
+    double size = 0.0;
+    string = (char*)parson_malloc(1);
+    while (string != NULL) {
+        if (binary_get(reader, &initial, 1) != JSONSuccess) {
+            break;
+        } else if (initial == 0xff) {
+            if (memchr(string, '\0', len) != NULL || !is_valid_utf8(string, len)) {
+                break;
+            }
+            string[len] = '\0';
+            return string;
+        } else if ((initial >> 5) != 3 || cbor_get_argument(reader, initial, &size) != JSONSuccess
+                   || size > (double)(reader->size - reader->pos)) {
+            break;
+        }
+        chunk_len = (size_t)size;
+        grown = (char*)parson_malloc(len + chunk_len + 1);
+        if (grown == NULL) {
+            break;
+        }
+        memcpy(grown, string, len);
+        parson_free(string);
+        string = grown;
+        if (binary_get(reader, string + len, chunk_len) != JSONSuccess) {
+            break;
+        }
+        len += chunk_len;
+    }
+    parson_free(string);
+    return NULL;
+}
+
+/* Tags are skipped, their content is decoded as is */
+static JSON_Value * cbor_read_item(JSON_Binary_Reader *reader, unsigned char initial, size_t nesting) {
+    unsigned char major = (unsigned char)(initial >> 5), info = (unsigned char)(initial & 0x1f);
+    int indefinite = info == 31;
+    double argument = 0.0;
+    size_t i = 0;
+    char *string = NULL;
+    JSON_Value *value = NULL, *item = NULL, *name = NULL;
+    if (nesting > MAX_NESTING) {
+        return NULL;
+    }
+    if (major == 7) {
+        switch (info) {
+            case 20: return json_value_init_boolean(0);
+            case 21: return json_value_init_boolean(1);
+            case 22: return json_value_init_null();
+            case 25:
+                if (binary_get_uint(reader, 2, &argument) != JSONSuccess
+                    || ((unsigned int)argument & 0x7c00) == 0x7c00) {
+                    return NULL; /* infinity and nan */
+                }
+                return binary_number_value(cbor_half_value((unsigned int)argument), 1);
+            case 26: case 27:
+                if (binary_get_float(reader, info == 26 ? 4 : 8, &argument) != JSONSuccess) {
+                    return NULL;
+                }
+                return binary_number_value(argument, 1);
+            default: /* undefined, other simple values and unexpected break */
+                return NULL;
+        }
+    }
+    if (indefinite && (major < 3 || major > 5)) {
+        return NULL;
+    } else if (!indefinite && cbor_get_argument(reader, initial, &argument) != JSONSuccess) {
+        return NULL;
+    }
+    switch (major) {
+        case 0:
+            return json_value_init_number(argument);
+        case 1:
+            return json_value_init_number(-1.0 - argument);
+        case 3:
+            if (!indefinite && argument > (double)(reader->size - reader->pos)) {
+                return NULL; /* checked before conversion, lengths above SIZE_MAX don't fit size_t */
+            }
+            string = indefinite ? cbor_get_chunked_string(reader) : binary_get_string(reader, (size_t)argument);
+            if (string == NULL) {
+                return NULL;
+            }
+            value = json_value_init_string_no_copy(string);
+            if (value == NULL) {
+                parson_free(string);
+            }
+            return value;
+        case 4: case 5:
+            if (!indefinite && argument > (double)(reader->size - reader->pos)) {
+                return NULL; /* every item takes at least a byte */
+            }
+            value = major == 4 ? json_value_init_array() : json_value_init_object();
+            for (i = 0; value != NULL && (indefinite || i < (size_t)argument); i++) {
+                if (binary_get(reader, &initial, 1) != JSONSuccess) {
+                    break;
+                } else if (indefinite && initial == 0xff) {
+                    return value;
+                }
+                if (major == 4) {
+                    item = cbor_read_item(reader, initial, nesting + 1);
+                    if (item == NULL || json_array_append_value(json_array(value), item) != JSONSuccess) {
+                        break;
+                    }
+                    item = NULL;
+                    continue;
+                }
+                name = cbor_read_item(reader, initial, nesting + 1);
+                item = json_value_get_type(name) == JSONString ? cbor_read_value(reader, nesting + 1) : NULL;
+                if (item == NULL || json_object_add(json_object(value), json_value_get_string(name), item) != JSONSuccess) {
+                    break;
+                }
+                json_value_free(name);
+                name = NULL;
+                item = NULL;
+            }
+            if (!indefinite && value != NULL && i == (size_t)argument) {
+                return value;
+            }
+            json_value_free(name);
+            json_value_free(item);
+            json_value_free(value);
+            return NULL;
+        case 6:
+            return cbor_read_value(reader, nesting + 1);
+        default: /* byte strings have no JSON equivalent */
+            return NULL;
+    }
+}
+
+static JSON_Value * cbor_read_value(JSON_Binary_Reader *reader, size_t nesting) {
+    unsigned char initial = 0;
+    if (binary_get(reader, &initial, 1) != JSONSuccess) {
+        return NULL;
+    }
+    return cbor_read_item(reader, initial, nesting);
+}
+
+/* Parser API */
+JSON_Value * json_parse_file(const char *filename) {
+    char *file_contents = read_file(filename);
+    JSON_Value *output_value = NULL;
+    if (file_contents == NULL) {
+        return NULL;
+    }
+    output_value = json_parse_string(file_contents);
+    parson_free(file_contents);
+    return output_value;
+}
+
+JSON_Value * json_parse_file_with_comments(const char *filename) {
+    char *file_contents = read_file(filename);
+    JSON_Value *output_value = NULL;
+    if (file_contents == NULL) {
+        return NULL;
+    }
+    output_value = json_parse_string_with_comments(file_contents);
+    parson_free(file_contents);
+    return output_value;
+}
+
+JSON_Value * json_parse_string(const char *string) {
+    if (string == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    return parse_root_value(string, NULL);
+}
+
+JSON_Value * json_parse_file_parallel(const char *filename, size_t threads_count) {
+    char *file_contents = read_file(filename);
+    JSON_Value *output_value = NULL;
+    if (file_contents == NULL) {
+        return NULL;
+    }
+    output_value = json_parse_string_parallel(file_contents, threads_count);
+    parson_free(file_contents);
+    return output_value;
+}
+
+JSON_Value * json_parse_string_parallel(const char *string, size_t threads_count) {
+#if PARSON_THREADS
+    const char *items = NULL;
+#endif
+    if (string == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    threads_count = threads_get_count(threads_count);
+#if PARSON_THREADS
+    items = string;
+    SKIP_WHITESPACES(&items);
+    if (threads_count > 1 && !parson_lazy_parsing && *items == '[') {
+        SKIP_CHAR(&items);
+        SKIP_WHITESPACES(&items);
+        if (*items != ']') {
+            return array_parse_parallel(items, threads_count);
+        }
+    }
+#endif
+    return parse_root_value(string, NULL);
+}
+
+JSON_Status json_parse_batch(const JSON_Input *inputs, size_t count, JSON_Value **results, size_t threads_count) {
+    JSON_Parser parser;
+    size_t i = 0;
+#if PARSON_THREADS
+    JSON_Batch_Job job;
+    JSON_Batch_Worker *workers = NULL;
+    pthread_t *threads = NULL;
+    size_t started = 0;
+#endif
+    if (inputs == NULL || results == NULL) {
+        return JSONFailure;
+    }
+    for (i = 0; i < count; i++) {
+        results[i] = NULL;
+    }
+    threads_count = MIN(threads_get_count(threads_count), count);
+#if PARSON_THREADS
+    if (threads_count > 1) {
+        memset(&job, 0, sizeof(JSON_Batch_Job));
+        job.inputs = inputs;
+        job.results = results;
+        job.count = count;
+        job.ranges = (JSON_Batch_Range*)parson_malloc(threads_count * sizeof(JSON_Batch_Range));
+        workers = (JSON_Batch_Worker*)parson_malloc(threads_count * sizeof(JSON_Batch_Worker));
+        threads = (pthread_t*)parson_malloc(threads_count * sizeof(pthread_t));
+        if (job.ranges == NULL || workers == NULL || threads == NULL) {
+            parson_free(job.ranges);
+            parson_free(workers);
+            parson_free(threads);
+            return JSONFailure;
+        }
+        for (job.workers = 0; job.workers < threads_count; job.workers++) {
+            if (pthread_mutex_init(&job.ranges[job.workers].mutex, NULL) != 0) {
+                break;
+            }
+        }
+        for (i = 0; i < job.workers; i++) { /* inputs are split evenly, stealing balances the rest */
+            job.ranges[i].next = count * i / job.workers;
+            job.ranges[i].end = count * (i + 1) / job.workers;
+            workers[i].job = &job;
+            workers[i].index = i;
+        }
+        for (started = 1; started < job.workers; started++) { /* calling thread is worker 0 */
+            if (pthread_create(&threads[started], NULL, batch_worker, &workers[started]) != 0) {
+                break;
+            }
+        }
+        if (job.workers > 0) {
+            batch_worker(&workers[0]);
+        }
+        for (i = 1; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        for (i = 0; i < job.workers; i++) {
+            pthread_mutex_destroy(&job.ranges[i].mutex);
+        }
+        threads_count = job.workers > 0 ? threads_count : 1; /* parses on calling thread if there were no workers */
+        parson_free(job.ranges);
+        parson_free(workers);
+        parson_free(threads);
+    }
+    if (threads_count < 2) {
+#endif
+        parser_init(&parser);
+        for (i = 0; i < count; i++) {
+            if (i + 1 < count) {
+                batch_prefetch(&inputs[i + 1]);
+            }
+            results[i] = batch_parse_input(&parser, &inputs[i]);
+        }
+        parser_deinit(&parser);
+#if PARSON_THREADS
+    }
+#endif
+    for (i = 0; i < count; i++) {
+        if (results[i] == NULL) {
+            return JSONFailure;
+        }
+    }
+    return JSONSuccess;
+}
+
+JSON_Loader * json_loader_create(size_t threads_count) {
+    JSON_Loader *loader = (JSON_Loader*)parson_malloc(sizeof(JSON_Loader));
+    if (loader == NULL) {
+        return NULL;
+    }
+    memset(loader, 0, sizeof(JSON_Loader));
+#if PARSON_THREADS
+    threads_count = threads_get_count(threads_count);
+    loader->threads = (pthread_t*)parson_malloc(threads_count * sizeof(pthread_t));
+    if (loader->threads == NULL) {
+        parson_free(loader);
+        return NULL;
+    }
+    if (pthread_mutex_init(&loader->mutex, NULL) != 0) {
+        threads_count = 0;
+    } else if (pthread_cond_init(&loader->cond, NULL) != 0) {
+        pthread_mutex_destroy(&loader->mutex);
+        threads_count = 0;
+    } else if (pthread_cond_init(&loader->done_cond, NULL) != 0) {
+        pthread_cond_destroy(&loader->cond);
+        pthread_mutex_destroy(&loader->mutex);
+        threads_count = 0;
+    }
+    for (loader->threads_count = 0; loader->threads_count < threads_count; loader->threads_count++) {
+        if (pthread_create(&loader->threads[loader->threads_count], NULL, loader_worker, loader) != 0) {
+            break;
+        }
+    }
+    if (loader->threads_count == 0 && threads_count > 0) { /* requests are loaded on calling thread */
+        pthread_cond_destroy(&loader->done_cond);
+        pthread_cond_destroy(&loader->cond);
+        pthread_mutex_destroy(&loader->mutex);
+    }
+#else
+    (void)threads_count;
+#endif
+    return loader;
+}
+
+JSON_Status json_loader_submit(JSON_Loader *loader, const char *filename, JSON_Load_Callback callback, void *arg) {
+    JSON_Load *load = NULL;
+    JSON_Parser parser;
+    if (callback == NULL) {
+        return JSONFailure;
+    }
+    load = loader_request(loader, filename, callback, arg);
+    if (load == NULL) {
+        return JSONFailure;
+    }
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_lock(&loader->mutex);
+        if (loader->queue_tail != NULL) {
+            loader->queue_tail->queue_next = load;
+        } else {
+            loader->queue = load;
+        }
+        loader->queue_tail = load;
+        pthread_cond_signal(&loader->cond);
+        pthread_mutex_unlock(&loader->mutex);
+        return JSONSuccess;
+    }
+#endif
+    parser_init(&parser);
+    loader_finish(loader, &parser, load);
+    parser_deinit(&parser);
+    return JSONSuccess;
+}
+
+JSON_Load * json_loader_load(JSON_Loader *loader, const char *filename) {
+    JSON_Load *load = loader_request(loader, filename, NULL, NULL);
+    JSON_Parser parser;
+    if (load == NULL) {
+        return NULL;
+    }
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_lock(&loader->mutex);
+        if (loader->queue_tail != NULL) {
+            loader->queue_tail->queue_next = load;
+        } else {
+            loader->queue = load;
+        }
+        loader->queue_tail = load;
+        pthread_cond_signal(&loader->cond);
+        pthread_mutex_unlock(&loader->mutex);
+        return load;
+    }
+#endif
+    parser_init(&parser);
+    loader_finish(loader, &parser, load);
+    parser_deinit(&parser);
+    return load;
+}
+
+int json_load_is_ready(JSON_Load *load) {
+    int done = 0;
+    if (load == NULL) {
+        return 0;
+    }
+#if PARSON_THREADS
+    if (load->loader->threads_count > 0) {
+        pthread_mutex_lock(&load->loader->mutex);
+        done = load->done;
+        pthread_mutex_unlock(&load->loader->mutex);
+        return done;
+    }
+#endif
+    done = load->done;
+    return done;
+}
+
+JSON_Value * json_load_get(JSON_Load *load) {
+    JSON_Loader *loader = NULL;
+    JSON_Value *value = NULL;
+    if (load == NULL) {
+        return NULL;
+    }
+    loader = load->loader;
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_lock(&loader->mutex);
+        while (!load->done) {
+            pthread_cond_wait(&loader->done_cond, &loader->mutex);
+        }
+    }
+#endif
+    if (load->prev != NULL) {
+        load->prev->next = load->next;
+    } else {
+        loader->loads = load->next;
+    }
+    if (load->next != NULL) {
+        load->next->prev = load->prev;
+    }
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_unlock(&loader->mutex);
+    }
+#endif
+    value = load->value;
+    load->value = NULL;
+    loader_free_load(load);
+    return value;
+}
+
+void json_loader_free(JSON_Loader *loader) {
+    JSON_Load *load = NULL;
+#if PARSON_THREADS
+    size_t i = 0;
+#endif
+    if (loader == NULL) {
+        return;
+    }
+#if PARSON_THREADS
+    if (loader->threads_count > 0) {
+        pthread_mutex_lock(&loader->mutex);
+        loader->stop = 1;
+        pthread_cond_broadcast(&loader->cond);
+        pthread_mutex_unlock(&loader->mutex);
+        for (i = 0; i < loader->threads_count; i++) {
+            pthread_join(loader->threads[i], NULL);
+        }
+        pthread_cond_destroy(&loader->done_cond);
+        pthread_cond_destroy(&loader->cond);
+        pthread_mutex_destroy(&loader->mutex);
+    }
+    parson_free(loader->threads);
+#endif
+    while (loader->loads != NULL) { /* handles that weren't collected */
+        load = loader->loads;
+        loader->loads = load->next;
+        loader_free_load(load);
+    }
+    parson_free(loader);
+}
+
+JSON_Value * json_parse_file_with_schema(const char *filename, const JSON_Schema *schema) {
+    char *file_contents = read_file(filename);
+    JSON_Value *output_value = NULL;
+    if (file_contents == NULL) {
+        return NULL;
+    }
+    output_value = json_parse_string_with_schema(file_contents, schema);
+    parson_free(file_contents);
+    return output_value;
+}
+
+JSON_Value * json_parse_string_with_schema(const char *string, const JSON_Schema *schema) {
+    if (string == NULL || schema == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    return parse_root_value(string, schema->nodes);
+}
+
+JSON_Value * json_parse_file_projected(const char *filename, const char **paths, size_t paths_count) {
+    char *file_contents = read_file(filename);
+    JSON_Value *output_value = NULL;
+    if (file_contents == NULL) {
+        return NULL;
+    }
+    output_value = json_parse_string_projected(file_contents, paths, paths_count);
+    parson_free(file_contents);
+    return output_value;
+}
+
+JSON_Value * json_parse_string_projected(const char *string, const char **paths, size_t paths_count) {
+    JSON_Projection *projection = NULL;
+    JSON_Parser parser;
+    JSON_Value *result = NULL;
+    if (string == NULL || (paths == NULL && paths_count > 0)) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    projection = projection_build(paths, paths_count);
+    if (projection == NULL) {
+        return NULL;
+    }
+    parser_init(&parser);
+    SKIP_WHITESPACES(&string);
+    result = parse_projected_object(&parser, &string, 1, projection, projection);
+    parser_deinit(&parser);
+    parson_free(projection);
+    return result;
+}
+
+JSON_Value * json_parse_string_with_comments(const char *string) {
+    JSON_Value *result = NULL;
+    char *string_mutable_copy = NULL;
+    string_mutable_copy = parson_strdup(string);
+    if (string_mutable_copy == NULL) {
+        return NULL;
+    }
+    remove_comments(string_mutable_copy, "/*", "*/");
+    remove_comments(string_mutable_copy, "//", "\n");
+    result = parse_root_value(string_mutable_copy, NULL);
+    parson_free(string_mutable_copy);
+    return result;
+}
+
+/* JSON Object API */
+
+JSON_Value * json_object_get_value(const JSON_Object *object, const char *name) {
+    if (object == NULL || name == NULL) {
+        return NULL;
+    }
+    return json_object_getn_value(object, name, strlen(name));
+}
+
+const char * json_object_get_string(const JSON_Object *object, const char *name) {
+    return json_value_get_string(json_object_get_value(object, name));
+}
+
+double json_object_get_number(const JSON_Object *object, const char *name) {
+    return json_value_get_number(json_object_get_value(object, name));
+}
+
+JSON_Object * json_object_get_object(const JSON_Object *object, const char *name) {
+    return json_value_get_object(json_object_get_value(object, name));
+}
+
+JSON_Array * json_object_get_array(const JSON_Object *object, const char *name) {
+    return json_value_get_array(json_object_get_value(object, name));
+}
+
+int json_object_get_boolean(const JSON_Object *object, const char *name) {
+    return json_value_get_boolean(json_object_get_value(object, name));
+}
+
+JSON_Value * json_object_dotget_value(const JSON_Object *object, const char *name) {
+    const char *dot_position = strchr(name, '.');
+    if (!dot_position) {
+        return json_object_get_value(object, name);
+    }
+    object = json_value_get_object(json_object_getn_value(object, name, dot_position - name));
+    return json_object_dotget_value(object, dot_position + 1);
+}
+
+const char * json_object_dotget_string(const JSON_Object *object, const char *name) {
+    return json_value_get_string(json_object_dotget_value(object, name));
+}
+
+double json_object_dotget_number(const JSON_Object *object, const char *name) {
+    return json_value_get_number(json_object_dotget_value(object, name));
+}
+
+JSON_Object * json_object_dotget_object(const JSON_Object *object, const char *name) {
+    return json_value_get_object(json_object_dotget_value(object, name));
+}
+
+JSON_Array * json_object_dotget_array(const JSON_Object *object, const char *name) {
+    return json_value_get_array(json_object_dotget_value(object, name));
+}
+
+int json_object_dotget_boolean(const JSON_Object *object, const char *name) {
+    return json_value_get_boolean(json_object_dotget_value(object, name));
+}
+
+size_t json_object_get_count(const JSON_Object *object) {
+    return object ? object->count : 0;
+}
+
+const char * json_object_get_name(const JSON_Object *object, size_t index) {
+    if (object == NULL || index >= json_object_get_count(object)) {
+        return NULL;
+    }
+    return object->names[index];
+}
+
+JSON_Value * json_object_get_value_at(const JSON_Object *object, size_t index) {
+    if (object == NULL || index >= json_object_get_count(object)) {
+        return NULL;
+    }
+    return object->values[index];
+}
+
+JSON_Value *json_object_get_wrapping_value(const JSON_Object *object) {
+    return object->wrapping_value;
+}
+
+int json_object_has_value (const JSON_Object *object, const char *name) {
+    return json_object_get_value(object, name) != NULL;
+}
+
+int json_object_has_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type) {
+    JSON_Value *val = json_object_get_value(object, name);
+    return val != NULL && json_value_get_type(val) == type;
+}
+
+int json_object_dothas_value (const JSON_Object *object, const char *name) {
+    return json_object_dotget_value(object, name) != NULL;
+}
+
+int json_object_dothas_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type) {
+    JSON_Value *val = json_object_dotget_value(object, name);
+    return val != NULL && json_value_get_type(val) == type;
+}
+
+/* JSON Path API */
+JSON_Path * json_path_compile(const char *path) {
+    JSON_Path *compiled = NULL;
+    JSON_Path_Segment *segment = NULL;
+    size_t count = 1, path_len = 0, i = 0;
+    char *names = NULL, *name = NULL;
+    if (path == NULL) {
+        return NULL;
+    }
+    path_len = strlen(path);
+    for (i = 0; i < path_len; i++) {
+        count += path[i] == '.';
+    }
+    compiled = (JSON_Path*)parson_malloc(sizeof(JSON_Path) + count * sizeof(JSON_Path_Segment) + path_len + 1);
+    if (compiled == NULL) {
+        return NULL;
+    }
+    compiled->segments = (JSON_Path_Segment*)(compiled + 1);
+    compiled->count = count;
+    names = (char*)(compiled->segments + count);
+    memcpy(names, path, path_len + 1);
+    name = names;
+    segment = compiled->segments;
+    for (i = 0; i <= path_len; i++) {
+        if (names[i] == '.' || names[i] == '\0') {
+            names[i] = '\0';
+            segment->name = name;
+            segment->name_len = (size_t)(names + i - name);
+            segment->hash = hash_string(name, segment->name_len);
+            segment++;
+            name = names + i + 1;
+        }
+    }
+    return compiled;
+}
+
+void json_path_free(JSON_Path *path) {
+    parson_free(path);
+}
+
+JSON_Value * json_path_get_value(const JSON_Object *object, const JSON_Path *path) {
+    const JSON_Path_Segment *segment = NULL;
+    JSON_Value *value = NULL;
+    size_t i = 0, index = 0;
+    if (object == NULL || path == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < path->count; i++) {
+        segment = &path->segments[i];
+        index = json_object_find(object, segment->name, segment->name_len, segment->hash);
+        if (index == OBJECT_NOT_FOUND) {
+            return NULL;
+        }
+        value = object->values[index];
+        if (i + 1 < path->count) {
+            object = json_value_get_object(value);
+            if (object == NULL) {
+                return NULL;
+            }
+        }
+    }
+    return value;
+}
+
+const char * json_path_get_string(const JSON_Object *object, const JSON_Path *path) {
+    return json_value_get_string(json_path_get_value(object, path));
+}
+
+double json_path_get_number(const JSON_Object *object, const JSON_Path *path) {
+    return json_value_get_number(json_path_get_value(object, path));
+}
+
+JSON_Object * json_path_get_object(const JSON_Object *object, const JSON_Path *path) {
+    return json_value_get_object(json_path_get_value(object, path));
+}
+
+JSON_Array * json_path_get_array(const JSON_Object *object, const JSON_Path *path) {
+    return json_value_get_array(json_path_get_value(object, path));
+}
+
+int json_path_get_boolean(const JSON_Object *object, const JSON_Path *path) {
+    return json_value_get_boolean(json_path_get_value(object, path));
+}
+
+JSON_Status json_path_set_value(JSON_Object *object, const JSON_Path *path, JSON_Value *value) {
+    const JSON_Path_Segment *segment = NULL, *last = NULL;
+    JSON_Value *new_root = NULL, *new_value = NULL;
+    JSON_Object *new_object = NULL;
+    size_t i = 0, j = 0, index = 0;
+    if (object == NULL || path == NULL || value == NULL || value->parent != NULL) {
+        return JSONFailure;
+    }
+    last = &path->segments[path->count - 1];
+    for (i = 0; i + 1 < path->count; i++) {
+        segment = &path->segments[i];
+        index = json_object_find(object, segment->name, segment->name_len, segment->hash);
+        if (index == OBJECT_NOT_FOUND) {
+            break;
+        }
+        object = json_value_get_object(object->values[index]);
+        if (object == NULL) {
+            return JSONFailure; /* Don't overwrite existing non-object, just like json_object_dotset_value */
+        }
+    }
+    if (i + 1 == path->count) {
+        return json_object_setn_value(object, last->name, last->name_len, last->hash, value);
+    }
+    /* create missing hierarchy and attach it after value is in place */
+    new_root = json_value_init_object();
+    if (new_root == NULL) {
+        return JSONFailure;
+    }
+    new_object = json_value_get_object(new_root);
+    for (j = i + 1; j + 1 < path->count; j++) {
+        segment = &path->segments[j];
+        new_value = json_value_init_object();
+        if (new_value == NULL ||
+            json_object_addn_unchecked(new_object, segment->name, segment->name_len, segment->hash, new_value) == JSONFailure) {
+            json_value_free(new_value);
+            json_value_free(new_root);
+            return JSONFailure;
+        }
+        new_object = json_value_get_object(new_value);
+    }
+    if (json_object_addn_unchecked(new_object, last->name, last->name_len, last->hash, value) == JSONFailure) {
+        json_value_free(new_root);
+        return JSONFailure;
+    }
+    segment = &path->segments[i];
+    if (json_object_setn_value(object, segment->name, segment->name_len, segment->hash, new_root) == JSONFailure) {
+        json_object_remove_internal(new_object, last->name, 0);
+        value->parent = NULL;
+        json_value_free(new_root);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+JSON_Status json_path_set_string(JSON_Object *object, const JSON_Path *path, const char *string) {
+    JSON_Value *value = json_value_init_string(string);
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (json_path_set_value(object, path, value) == JSONFailure) {
+        json_value_free(value);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+JSON_Status json_path_set_number(JSON_Object *object, const JSON_Path *path, double number) {
+    JSON_Value *value = json_value_init_number(number);
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (json_path_set_value(object, path, value) == JSONFailure) {
+        json_value_free(value);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+JSON_Status json_path_set_boolean(JSON_Object *object, const JSON_Path *path, int boolean) {
+    JSON_Value *value = json_value_init_boolean(boolean);
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (json_path_set_value(object, path, value) == JSONFailure) {
+        json_value_free(value);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+JSON_Status json_path_set_null(JSON_Object *object, const JSON_Path *path) {
+    JSON_Value *value = json_value_init_null();
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (json_path_set_value(object, path, value) == JSONFailure) {
+        json_value_free(value);
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+/* JSON Query API */
+static JSON_Query * json_query_alloc(size_t path_len) {
+    JSON_Query *query = (JSON_Query*)parson_malloc(sizeof(JSON_Query) + (path_len + 1) * sizeof(JSON_Query_Step) + path_len + 1);
+    if (query == NULL) {
+        return NULL;
+    }
+    query->steps = (JSON_Query_Step*)(query + 1);
+    query->count = 0;
+    query->names = (char*)(query->steps + path_len + 1);
+    query->names_used = 0;
+    return query;
+}
+
+static JSON_Query_Step * json_query_add_step(JSON_Query *query, int type) {
+    JSON_Query_Step *step = &query->steps[query->count++];
+    memset(step, 0, sizeof(JSON_Query_Step));
+    step->type = type;
+    step->index = -1;
+    step->step = 1;
+    return step;
+}
+
+/* Stores name in query's names buffer and sets hash, name can't be longer than the source it came from */
+static void json_query_set_name(JSON_Query *query, JSON_Query_Step *step, const char *name, size_t name_len) {
+    char *output = query->names + query->names_used;
+    memmove(output, name, name_len); /* pointer tokens are decoded in place */
+    output[name_len] = '\0';
+    query->names_used += name_len + 1;
+    step->name = output;
+    step->name_len = name_len;
+    step->hash = hash_string(output, name_len);
+}
+
+/* Returns array index encoded in pointer token, or -1 if it isn't one (RFC 6901, section 4) */
+static long json_query_pointer_index(const char *token, size_t len) {
+    long index = 0;
+    size_t i = 0;
+    if (len == 0 || (len > 1 && token[0] == '0')) {
+        return -1;
+    }
+    for (i = 0; i < len; i++) {
+        if (token[i] < '0' || token[i] > '9' || index > (LONG_MAX - 9) / 10) {
+            return -1;
+        }
+        index = index * 10 + (token[i] - '0');
+    }
+    return index;
+}
+
+/* Parses optional integer, returns 0 if there isn't one */
+static int json_query_parse_long(const char **string, long *result) {
+    char *end = NULL;
+    SKIP_WHITESPACES(string);
+    if (**string != '-' && !isdigit((unsigned char)**string)) {
+        return 0;
+    }
+    *result = strtol(*string, &end, 10);
+    if (end == *string) {
+        return 0;
+    }
+    *string = end;
+    SKIP_WHITESPACES(string);
+    return 1;
+}
+
+/* Parses 'quoted' or "quoted" name into query's names buffer, backslash escapes next character */
+static JSON_Status json_query_parse_quoted(JSON_Query *query, const char **string, const char **name, size_t *name_len) {
+    char quote = **string;
+    char *output = query->names + query->names_used;
+    const char *input = *string + 1;
+    size_t len = 0;
+    while (*input != quote) {
+        if (*input == '\\' && input[1] != '\0') {
+            input++;
+        } else if (*input == '\0') {
+            return JSONFailure;
+        }
+        output[len++] = *input++;
+    }
+    output[len] = '\0';
+    query->names_used += len + 1;
+    *name = output;
+    *name_len = len;
+    *string = input + 1;
+    return JSONSuccess;
+}
+
+/* Parses filter after "[?": [?(@.member op literal)] or [?(@.member)], parentheses are optional */
+static JSON_Status json_query_parse_filter(JSON_Query *query, JSON_Query_Step *step, const char **string) {
+    const char *p = *string, *member = NULL, *literal = NULL;
+    size_t member_len = 0, literal_len = 0;
+    int has_parens = 0;
+    char *end = NULL;
+    SKIP_WHITESPACES(&p);
+    if (*p == '(') {
+        has_parens = 1;
+        p++;
+        SKIP_WHITESPACES(&p);
+    }
+    if (*p != '@') {
+        return JSONFailure;
+    }
+    p++;
+    if (*p == '.') {
+        member = ++p;
+        while (*p != '\0' && strchr(" \t\n\r=!<>)]", *p) == NULL) {
+            p++;
+        }
+        member_len = (size_t)(p - member);
+        json_query_set_name(query, step, member, member_len);
+        step->member = json_path_compile(step->name);
+        if (step->member == NULL) {
+            return JSONFailure;
+        }
+    }
+    SKIP_WHITESPACES(&p);
+    if (p[0] == '=' && p[1] == '=') {
+        step->op = JSONQueryEqual;
+    } else if (p[0] == '!' && p[1] == '=') {
+        step->op = JSONQueryNotEqual;
+    } else if (p[0] == '<') {
+        step->op = p[1] == '=' ? JSONQueryLessOrEqual : JSONQueryLess;
+    } else if (p[0] == '>') {
+        step->op = p[1] == '=' ? JSONQueryGreaterOrEqual : JSONQueryGreater;
+    }
+    if (step->op != JSONQueryExists) {
+        p += (p[1] == '=') ? 2 : 1;
+        SKIP_WHITESPACES(&p);
+        if (*p == '\'' || *p == '"') {
+            if (json_query_parse_quoted(query, &p, &literal, &literal_len) == JSONFailure) {
+                return JSONFailure;
+            }
+            step->literal = json_value_init_string(literal);
+        } else if (strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0) {
+            step->literal = json_value_init_boolean(*p == 't');
+            p += *p == 't' ? 4 : 5;
+        } else if (strncmp(p, "null", 4) == 0) {
+            step->literal = json_value_init_null();
+            p += 4;
+        } else {
+            errno = 0;
+            step->literal = json_value_init_number(strtod(p, &end));
+            if (end == p || errno) {
+                return JSONFailure;
+            }
+            p = end;
+        }
+        if (step->literal == NULL) {
+            return JSONFailure;
+        }
+        SKIP_WHITESPACES(&p);
+    }
+    if (has_parens) {
+        if (*p != ')') {
+            return JSONFailure;
+        }
+        p++;
+        SKIP_WHITESPACES(&p);
+    }
+    *string = p;
+    return JSONSuccess;
+}
+
+/* Parses bracketed selector: [*], ['name'], [index], [start:end:step] or [?filter] */
+static JSON_Status json_query_parse_bracket(JSON_Query *query, JSON_Query_Step *step, const char **string) {
+    const char *p = *string + 1, *name = NULL;
+    size_t name_len = 0;
+    SKIP_WHITESPACES(&p);
+    if (*p == '*') {
+        step->type = JSONQueryWildcard;
+        p++;
+        SKIP_WHITESPACES(&p);
+    } else if (*p == '\'' || *p == '"') {
+        if (json_query_parse_quoted(query, &p, &name, &name_len) == JSONFailure) {
+            return JSONFailure;
+        }
+        step->type = JSONQueryMember;
+        step->name = name;
+        step->name_len = name_len;
+        step->hash = hash_string(name, name_len);
+        SKIP_WHITESPACES(&p);
+    } else if (*p == '?') {
+        step->type = JSONQueryFilter;
+        p++;
+        if (json_query_parse_filter(query, step, &p) == JSONFailure) {
+            return JSONFailure;
+        }
+    } else {
+        step->has_start = json_query_parse_long(&p, &step->start);
+        if (*p == ':') {
+            step->type = JSONQuerySlice;
+            p++;
+            step->has_end = json_query_parse_long(&p, &step->end);
+            if (*p == ':') {
+                p++;
+                json_query_parse_long(&p, &step->step);
+            }
+        } else if (step->has_start) {
+            step->type = JSONQueryIndex;
+            step->index = step->start;
+        } else {
+            return JSONFailure;
+        }
+    }
+    if (*p != ']') {
+        return JSONFailure;
+    }
+    *string = p + 1;
+    return JSONSuccess;
+}
+
+JSON_Query * json_query_compile_pointer(const char *pointer) {
+    JSON_Query *query = NULL;
+    JSON_Query_Step *step = NULL;
+    const char *p = pointer;
+    char *name = NULL;
+    size_t name_len = 0;
+    if (pointer == NULL || (*pointer != '\0' && *pointer != '/')) {
+        return NULL;
+    }
+    query = json_query_alloc(strlen(pointer));
+    if (query == NULL) {
+        return NULL;
+    }
+    while (*p == '/') {
+        p++;
+        step = json_query_add_step(query, JSONQueryMember);
+        name = query->names + query->names_used;
+        name_len = 0;
+        while (*p != '\0' && *p != '/') {
+            if (*p == '~') {
+                if (p[1] != '0' && p[1] != '1') {
+                    json_query_free(query);
+                    return NULL;
+                }
+                name[name_len++] = p[1] == '0' ? '~' : '/';
+                p += 2;
+            } else {
+                name[name_len++] = *p++;
+            }
+        }
+        json_query_set_name(query, step, name, name_len);
+        step->index = json_query_pointer_index(name, name_len);
+    }
+    return query;
+}
+
+JSON_Query * json_query_compile(const char *path) {
+    JSON_Query *query = NULL;
+    JSON_Query_Step *step = NULL;
+    const char *p = path, *name = NULL;
+    if (path == NULL || *path != '$') {
+        return NULL;
+    }
+    query = json_query_alloc(strlen(path));
+    if (query == NULL) {
+        return NULL;
+    }
+    p++;
+    while (*p != '\0') {
+        step = json_query_add_step(query, JSONQueryMember);
+        if (p[0] == '.' && p[1] == '.') {
+            step->descendant = 1;
+            p += 2;
+        } else if (p[0] == '.') {
+            p++;
+        } else if (p[0] != '[') {
+            json_query_free(query);
+            return NULL;
+        }
+        if (*p == '[') {
+            if (json_query_parse_bracket(query, step, &p) == JSONFailure) {
+                json_query_free(query);
+                return NULL;
+            }
+        } else if (*p == '*') {
+            step->type = JSONQueryWildcard;
+            p++;
+        } else {
+            name = p;
+            while (*p != '\0' && *p != '.' && *p != '[') {
+                p++;
+            }
+            if (p == name) {
+                json_query_free(query);
+                return NULL;
+            }
+            json_query_set_name(query, step, name, (size_t)(p - name));
+        }
+    }
+    return query;
+}
+
+void json_query_free(JSON_Query *query) {
+    size_t i = 0;
+    if (query == NULL) {
+        return;
+    }
+    for (i = 0; i < query->count; i++) {
+        json_path_free(query->steps[i].member);
+        json_value_free(query->steps[i].literal);
+    }
+    parson_free(query);
+}
+
+static int json_query_filter_matches(const JSON_Query_Step *step, const JSON_Value *value) {
+    const JSON_Value *operand = value;
+    JSON_Value_Type type = JSONError;
+    int cmp = 0;
+    if (step->member != NULL) {
+        operand = json_path_get_value(json_value_get_object(value), step->member);
+    }
+    if (operand == NULL) {
+        return 0;
+    }
+    if (step->op == JSONQueryExists) {
+        return 1;
+    }
+    type = json_value_get_type(operand);
+    if (type != json_value_get_type(step->literal)) {
+        return step->op == JSONQueryNotEqual;
+    }
+    if (json_value_equals(operand, step->literal)) {
+        cmp = 0;
+    } else if (type == JSONNumber) {
+        cmp = json_value_get_number(operand) < json_value_get_number(step->literal) ? -1 : 1;
+    } else if (type == JSONString) {
+        cmp = strcmp(json_value_get_string(operand), json_value_get_string(step->literal));
+    } else {
+        return step->op == JSONQueryNotEqual; /* other types are only equal or not */
+    }
+    switch (step->op) {
+        case JSONQueryEqual:          return cmp == 0;
+        case JSONQueryNotEqual:       return cmp != 0;
+        case JSONQueryLess:           return cmp < 0;
+        case JSONQueryLessOrEqual:    return cmp <= 0;
+        case JSONQueryGreater:        return cmp > 0;
+        case JSONQueryGreaterOrEqual: return cmp >= 0;
+        default:                      return 0;
+    }
+}
+
+static JSON_Status json_query_deliver(JSON_Query_Run *run, JSON_Value *match) {
+    if (run->matches != NULL && run->count < run->max_matches) {
+        run->matches[run->count] = match;
+    }
+    run->count++;
+    if (run->callback != NULL && run->callback(match, run->arg) == JSONFailure) {
+        return JSONFailure;
+    }
+    return run->first_only ? JSONFailure : JSONSuccess;
+}
+
+/* Applies step i to children of value selected by it */
+static JSON_Status json_query_select(const JSON_Query *query, size_t i, JSON_Value *value, JSON_Query_Run *run) {
+    const JSON_Query_Step *step = &query->steps[i];
+    JSON_Object *object = json_value_get_object(value);
+    JSON_Array *array = json_value_get_array(value);
+    JSON_Value *child = NULL;
+    size_t j = 0, count = 0;
+    long index = 0, start = 0, end = 0, n = 0;
+    switch (step->type) {
+        case JSONQueryMember:
+            if (object != NULL) {
+                j = json_object_find(object, step->name, step->name_len, step->hash);
+                return j == OBJECT_NOT_FOUND ? JSONSuccess : json_query_apply(query, i + 1, object->values[j], run);
+            } else if (array != NULL && step->index >= 0 && (size_t)step->index < array->count) {
+                return json_query_apply(query, i + 1, array->items[step->index], run);
+            }
+            return JSONSuccess;
+        case JSONQueryIndex:
+            if (array == NULL) {
+                return JSONSuccess;
+            }
+            index = step->index < 0 ? (long)array->count + step->index : step->index;
+            if (index < 0 || (size_t)index >= array->count) {
+                return JSONSuccess;
+            }
+            return json_query_apply(query, i + 1, array->items[index], run);
+        case JSONQuerySlice: /* same rules as Python slices */
+            if (array == NULL || step->step == 0) {
+                return JSONSuccess;
+            }
+            n = (long)array->count;
+            if (step->step > 0) {
+                start = step->has_start ? step->start : 0;
+                end = step->has_end ? step->end : n;
+                start = start < 0 ? MAX(start + n, 0) : MIN(start, n);
+                end = end < 0 ? MAX(end + n, 0) : MIN(end, n);
+                for (index = start; index < end; index += step->step) {
+                    if (json_query_apply(query, i + 1, array->items[index], run) == JSONFailure) {
+                        return JSONFailure;
+                    }
+                    if (step->step >= end - index) { /* don't overflow index */
+                        break;
+                    }
+                }
+            } else {
+                start = step->has_start ? step->start : n - 1;
+                end = step->has_end ? step->end : -n - 1;
+                start = start < 0 ? MAX(start + n, -1) : MIN(start, n - 1);
+                end = end < 0 ? MAX(end + n, -1) : MIN(end, n - 1);
+                for (index = start; index > end; index += step->step) {
+                    if (json_query_apply(query, i + 1, array->items[index], run) == JSONFailure) {
+                        return JSONFailure;
+                    }
+                    if (step->step <= end - index) {
+                        break;
+                    }
+                }
+            }
+            return JSONSuccess;
+        case JSONQueryWildcard: case JSONQueryFilter:
+            count = object != NULL ? object->count : (array != NULL ? array->count : 0);
+            for (j = 0; j < count; j++) {
+                child = object != NULL ? object->values[j] : array->items[j];
+                if (step->type == JSONQueryFilter && !json_query_filter_matches(step, child)) {
+                    continue;
+                }
+                if (json_query_apply(query, i + 1, child, run) == JSONFailure) {
+                    return JSONFailure;
+                }
+            }
+            return JSONSuccess;
+        default:
+            return JSONSuccess;
+    }
+}
+
+/* Matches steps starting at i against value, recursive descent step is also matched against all descendants */
+static JSON_Status json_query_apply(const JSON_Query *query, size_t i, JSON_Value *value, JSON_Query_Run *run) {
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    size_t j = 0;
+    if (i == query->count) {
+        return json_query_deliver(run, value);
+    }
+    if (json_query_select(query, i, value, run) == JSONFailure) {
+        return JSONFailure;
+    }
+    if (!query->steps[i].descendant) {
+        return JSONSuccess;
+    }
+    object = json_value_get_object(value);
+    array = json_value_get_array(value);
+    for (j = 0; object != NULL && j < object->count; j++) {
+        if (json_query_apply(query, i, object->values[j], run) == JSONFailure) {
+            return JSONFailure;
+        }
+    }
+    for (j = 0; array != NULL && j < array->count; j++) {
+        if (json_query_apply(query, i, array->items[j], run) == JSONFailure) {
+            return JSONFailure;
+        }
+    }
+    return JSONSuccess;
+}
+
+size_t json_query_run(const JSON_Query *query, const JSON_Value *root, JSON_Query_Callback callback, void *arg) {
+    JSON_Query_Run run;
+    if (query == NULL || root == NULL) {
+        return 0;
+    }
+    memset(&run, 0, sizeof(JSON_Query_Run));
+    run.callback = callback;
+    run.arg = arg;
+    json_query_apply(query, 0, (JSON_Value*)root, &run);
+    return run.count;
+}
+
+size_t json_query_select_values(const JSON_Query *query, const JSON_Value *root, JSON_Value **matches, size_t max_matches) {
+    JSON_Query_Run run;
+    if (query == NULL || root == NULL) {
+        return 0;
+    }
+    memset(&run, 0, sizeof(JSON_Query_Run));
+    run.matches = matches;
+    run.max_matches = max_matches;
+    json_query_apply(query, 0, (JSON_Value*)root, &run);
+    return run.count;
+}
+
+JSON_Value * json_query_get_value(const JSON_Query *query, const JSON_Value *root) {
+    JSON_Value *match = NULL;
+    JSON_Query_Run run;
+    if (query == NULL || root == NULL) {
+        return NULL;
+    }
+    memset(&run, 0, sizeof(JSON_Query_Run));
+    run.matches = &match;
+    run.max_matches = 1;
+    run.first_only = 1;
+    json_query_apply(query, 0, (JSON_Value*)root, &run);
+    return match;
+}
+
+/* JSON Array API */
+JSON_Value * json_array_get_value(const JSON_Array *array, size_t index) {
+    if (array == NULL || index >= json_array_get_count(array)) {
+        return NULL;
+    }
+    return array->items[index];
+}
+
+const char * json_array_get_string(const JSON_Array *array, size_t index) {
+    return json_value_get_string(json_array_get_value(array, index));
+}
+
+double json_array_get_number(const JSON_Array *array, size_t index) {
+    return json_value_get_number(json_array_get_value(array, index));
+}
+
+JSON_Object * json_array_get_object(const JSON_Array *array, size_t index) {
+    return json_value_get_object(json_array_get_value(array, index));
+}
+
+JSON_Array * json_array_get_array(const JSON_Array *array, size_t index) {
+    return json_value_get_array(json_array_get_value(array, index));
+}
+
+int json_array_get_boolean(const JSON_Array *array, size_t index) {
+    return json_value_get_boolean(json_array_get_value(array, index));
+}
+
+size_t json_array_get_count(const JSON_Array *array) {
+    return array ? array->count : 0;
+}
+
+JSON_Value * json_array_get_wrapping_value(const JSON_Array *array) {
+    return array->wrapping_value;
+}
+
+/* JSON Value API */
+JSON_Value_Type json_value_get_type(const JSON_Value *value) {
+    return value ? value->type : JSONError;
+}
+
+JSON_Object * json_value_get_object(const JSON_Value *value) {
+    if (json_value_get_type(value) != JSONObject) {
+        return NULL;
+    }
+    if (value->storage == JSONStorageShared && json_value_unshare((JSON_Value*)value) == JSONFailure) {
+        return NULL;
+    }
+    if (value->storage == JSONStorageLazy && json_value_expand((JSON_Value*)value) == JSONFailure) {
+        return NULL;
+    }
+    return value->value.object;
+}
+
+JSON_Array * json_value_get_array(const JSON_Value *value) {
+    if (json_value_get_type(value) != JSONArray) {
+        return NULL;
+    }
+    if (value->storage == JSONStorageShared && json_value_unshare((JSON_Value*)value) == JSONFailure) {
+        return NULL;
+    }
+    if (value->storage == JSONStorageLazy && json_value_expand((JSON_Value*)value) == JSONFailure) {
+        return NULL;
+    }
+    return value->value.array;
+}
+
+const char * json_value_get_string(const JSON_Value *value) {
+    return json_value_get_type(value) == JSONString ? json_value_view(value)->value.string : NULL;
+}
+
+double json_value_get_number(const JSON_Value *value) {
+    if (json_value_get_type(value) != JSONNumber) {
+        return 0;
+    }
+    return value->storage == JSONStorageText ? strtod(value->value.text, NULL) : value->value.number;
+}
+
+int json_value_get_boolean(const JSON_Value *value) {
+    return json_value_get_type(value) == JSONBoolean ? value->value.boolean : -1;
+}
+
+JSON_Value * json_value_get_parent (const JSON_Value *value) {
+    return value ? value->parent : NULL;
+}
+
+void json_value_free(JSON_Value *value) {
+    if (value != NULL && value->storage == JSONStorageShared) {
+        json_shared_release(value->value.shared.store);
+        parson_free(value);
+        return;
+    }
+    if (value != NULL && value->storage == JSONStorageLazy) {
+        json_source_release(value->value.lazy.source);
+        parson_free(value);
+        return;
+    }
+    switch (json_value_get_type(value)) {
+        case JSONObject:
+            json_object_free(value->value.object);
+            break;
+        case JSONString:
+            parson_free(value->value.string);
+            break;
+        case JSONArray:
+            json_array_free(value->value.array);
+            break;
+        default:
+            break;
+    }
+    parson_free(value);
+}
+
+JSON_Value * json_value_init_object(void) {
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (!new_value) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageOwned;
+    new_value->type = JSONObject;
+    new_value->value.object = json_object_init(new_value);
+    if (!new_value->value.object) {
+        parson_free(new_value);
+        return NULL;
+    }
+    return new_value;
+}
+
+JSON_Value * json_value_init_array(void) {
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (!new_value) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageOwned;
+    new_value->type = JSONArray;
+    new_value->value.array = json_array_init(new_value);
+    if (!new_value->value.array) {
+        parson_free(new_value);
+        return NULL;
+    }
+    return new_value;
+}
+
+JSON_Value * json_value_init_string(const char *string) {
+    char *copy = NULL;
+    JSON_Value *value;
+    size_t string_len = 0;
+    if (string == NULL) {
+        return NULL;
+    }
+    string_len = strlen(string);
+    if (!is_valid_utf8(string, string_len)) {
+        return NULL;
+    }
+    copy = parson_strndup(string, string_len);
+    if (copy == NULL) {
+        return NULL;
+    }
+    value = json_value_init_string_no_copy(copy);
+    if (value == NULL) {
+        parson_free(copy);
+    }
+    return value;
+}
+
+JSON_Value * json_value_init_number(double number) {
+    JSON_Value *new_value = NULL;
+    if ((number * 0.0) != 0.0) { /* nan and inf test */
+        return NULL;
+    }
+    new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (new_value == NULL) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageOwned;
+    new_value->type = JSONNumber;
+    new_value->value.number = number;
+    return new_value;
+}
+
+JSON_Value * json_value_init_raw(const char *json, size_t len) {
+    JSON_Source *source = NULL;
+    JSON_Value *value = NULL;
+    JSON_Parser parser;
+    const char *string = NULL;
+    if (json == NULL) {
+        return NULL;
+    }
+    source = json_source_init(json, len);
+    if (source == NULL) {
+        return NULL;
+    }
+    source->raw = 1;
+    parser_init(&parser);
+    string = source->text;
+    SKIP_WHITESPACES(&string);
+    if (*string == '{' || *string == '[') {
+        if (lazy_scan_value(&parser, &string, 0, source) == JSONSuccess) {
+            value = json_value_init_lazy(source, 0);
+        }
+    } else {
+        value = parse_value(&parser, &string, 0, NULL); /* scalars are cheap to keep parsed */
+    }
+    parser_deinit(&parser);
+    if (value != NULL) {
+        SKIP_WHITESPACES(&string);
+        if ((size_t)(string - source->text) != len) { /* json has to be exactly one value */
+            json_value_free(value);
+            value = NULL;
+        }
+    }
+    json_source_release(source);
+    return value;
+}
+
+JSON_Value * json_value_init_boolean(int boolean) {
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (!new_value) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageOwned;
+    new_value->type = JSONBoolean;
+    new_value->value.boolean = boolean ? 1 : 0;
+    return new_value;
+}
+
+JSON_Value * json_value_init_null(void) {
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (!new_value) {
+        return NULL;
+    }
+    new_value->parent = NULL;
+    new_value->storage = JSONStorageOwned;
+    new_value->type = JSONNull;
+    return new_value;
+}
+
+JSON_Value * json_value_deep_copy(const JSON_Value *value) {
+    size_t i = 0;
+    JSON_Value *return_value = NULL, *temp_value_copy = NULL, *temp_value = NULL;
+    const char *temp_string = NULL, *temp_key = NULL;
+    char *temp_string_copy = NULL;
+    JSON_Array *temp_array = NULL, *temp_array_copy = NULL;
+    JSON_Object *temp_object = NULL, *temp_object_copy = NULL;
+
+    if (value != NULL && value->storage == JSONStorageShared) { /* copy-on-write */
+        return json_value_init_shared(value->value.shared.store, value->value.shared.source);
+    }
+    if (value != NULL && value->storage == JSONStorageLazy) { /* source is never modified */
+        return json_value_init_lazy(value->value.lazy.source, value->value.lazy.span);
+    }
+    switch (json_value_get_type(value)) {
+        case JSONArray:
+            temp_array = json_value_get_array(value);
+            return_value = json_value_init_array();
+            if (return_value == NULL) {
+                return NULL;
+            }
+            temp_array_copy = json_value_get_array(return_value);
+            if (temp_array->count > 0 && json_array_resize(temp_array_copy, temp_array->count) == JSONFailure) {
+                json_value_free(return_value);
+                return NULL;
+            }
+            for (i = 0; i < json_array_get_count(temp_array); i++) {
+                temp_value = json_array_get_value(temp_array, i);
+                temp_value_copy = json_value_deep_copy(temp_value);
+                if (temp_value_copy == NULL) {
+                    json_value_free(return_value);
+                    return NULL;
+                }
+                if (json_array_add(temp_array_copy, temp_value_copy) == JSONFailure) {
+                    json_value_free(return_value);
+                    json_value_free(temp_value_copy);
+                    return NULL;
+                }
+            }
+            return return_value;
+        case JSONObject:
+            temp_object = json_value_get_object(value);
+            return_value = json_value_init_object();
+            if (return_value == NULL) {
+                return NULL;
+            }
+            temp_object_copy = json_value_get_object(return_value);
+            if (temp_object->count > 0 && json_object_resize(temp_object_copy, temp_object->count) == JSONFailure) {
+                json_value_free(return_value);
+                return NULL;
+            }
+            for (i = 0; i < json_object_get_count(temp_object); i++) {
+                temp_key = json_object_get_name(temp_object, i);
+                temp_value = json_object_get_value_at(temp_object, i);
+                temp_value_copy = json_value_deep_copy(temp_value);
+                if (temp_value_copy == NULL) {
+                    json_value_free(return_value);
+                    return NULL;
+                }
+                /* names in source object are unique, so there's no need to look them up */
+                if (json_object_addn_unchecked(temp_object_copy, temp_key, strlen(temp_key),
+                                               temp_object->hashes[i], temp_value_copy) == JSONFailure) {
+                    json_value_free(return_value);
+                    json_value_free(temp_value_copy);
+                    return NULL;
+                }
+            }
+            return return_value;
+        case JSONBoolean:
+            return json_value_init_boolean(json_value_get_boolean(value));
+        case JSONNumber:
+            if (value->storage == JSONStorageText) {
+                return json_value_init_number_text(value->value.text, strlen(value->value.text));
+            }
+            return json_value_init_number(json_value_get_number(value));
+        case JSONString:
+            temp_string = json_value_get_string(value);
+            if (temp_string == NULL) {
+                return NULL;
+            }
+            temp_string_copy = parson_strdup(temp_string);
+            if (temp_string_copy == NULL) {
+                return NULL;
+            }
+            return_value = json_value_init_string_no_copy(temp_string_copy);
+            if (return_value == NULL) {
+                parson_free(temp_string_copy);
+            }
+            return return_value;
+        case JSONNull:
+            return json_value_init_null();
+        case JSONError:
+            return NULL;
+        default:
+            return NULL;
+    }
+}
+
+JSON_Status json_value_share(JSON_Value *value) {
+    JSON_Shared *store = NULL;
+    JSON_Value *root = NULL;
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    size_t i = 0;
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (value->storage == JSONStorageShared) {
+        return JSONSuccess;
+    }
+    if (value->storage == JSONStorageLazy && json_value_expand(value) == JSONFailure) {
+        return JSONFailure;
+    }
+    switch (value->type) {
+        case JSONObject: case JSONArray: case JSONString:
+            break;
+        default:
+            return JSONSuccess; /* other scalars are copied anyway */
+    }
+    store = (JSON_Shared*)parson_malloc(sizeof(JSON_Shared));
+    if (store == NULL) {
+        return JSONFailure;
+    }
+    root = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    if (root == NULL) {
+        parson_free(store);
+        return JSONFailure;
+    }
+    /* move payload to a hidden root, value becomes a reference to it */
+    *root = *value;
+    root->parent = NULL;
+    if (root->type == JSONObject) {
+        object = root->value.object;
+        object->wrapping_value = root;
+        for (i = 0; i < object->count; i++) {
+            object->values[i]->parent = root;
+        }
+    } else if (root->type == JSONArray) {
+        array = root->value.array;
+        array->wrapping_value = root;
+        for (i = 0; i < array->count; i++) {
+            array->items[i]->parent = root;
+        }
+    }
+    store->root = root;
+    store->refcount = 1;
+    value->storage = JSONStorageShared;
+    value->value.shared.store = store;
+    value->value.shared.source = root;
+    return JSONSuccess;
+}
+
+size_t json_serialization_size(const JSON_Value *value) {
+    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
+    int res = json_serialize_to_buffer_r(value, NULL, 0, 0, num_buf);
+    return res < 0 ? 0 : (size_t)(res + 1);
+}
+
+JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes) {
+    int written = -1;
+    size_t needed_size_in_bytes = json_serialization_size(value);
+    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
+        return JSONFailure;
+    }
+    written = json_serialize_to_buffer_r(value, buf, 0, 0, NULL);
+    if (written < 0) {
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+JSON_Status json_serialize_to_file(const JSON_Value *value, const char *filename) {
+    JSON_Status return_code = JSONSuccess;
+    FILE *fp = NULL;
+    char *serialized_string = json_serialize_to_string(value);
+    if (serialized_string == NULL) {
+        return JSONFailure;
+    }
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+        json_free_serialized_string(serialized_string);
+        return JSONFailure;
+    }
+    if (fputs(serialized_string, fp) == EOF) {
+        return_code = JSONFailure;
+    }
+    if (fclose(fp) == EOF) {
+        return_code = JSONFailure;
+    }
+    json_free_serialized_string(serialized_string);
+    return return_code;
+}
+
+char * json_serialize_to_string(const JSON_Value *value) {
+    JSON_Status serialization_result = JSONFailure;
+    size_t buf_size_bytes = json_serialization_size(value);
+    char *buf = NULL;
+    if (buf_size_bytes == 0) {
+        return NULL;
+    }
+    buf = (char*)parson_malloc(buf_size_bytes);
+    if (buf == NULL) {
+        return NULL;
+    }
+    serialization_result = json_serialize_to_buffer(value, buf, buf_size_bytes);
+    if (serialization_result == JSONFailure) {
+        json_free_serialized_string(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+size_t json_serialization_size_pretty(const JSON_Value *value) {
+    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
+    int res = json_serialize_to_buffer_r(value, NULL, 0, 1, num_buf);
+    return res < 0 ? 0 : (size_t)(res + 1);
+}
+
+JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf, size_t buf_size_in_bytes) {
+    int written = -1;
+    size_t needed_size_in_bytes = json_serialization_size_pretty(value);
+    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
+        return JSONFailure;
+    }
+    written = json_serialize_to_buffer_r(value, buf, 0, 1, NULL);
+    if (written < 0) {
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+JSON_Status json_serialize_to_file_pretty(const JSON_Value *value, const char *filename) {
+    JSON_Status return_code = JSONSuccess;
+    FILE *fp = NULL;
+    char *serialized_string = json_serialize_to_string_pretty(value);
+    if (serialized_string == NULL) {
+        return JSONFailure;
     }
-    return written_total;
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+        json_free_serialized_string(serialized_string);
+        return JSONFailure;
+    }
+    if (fputs(serialized_string, fp) == EOF) {
+        return_code = JSONFailure;
+    }
+    if (fclose(fp) == EOF) {
+        return_code = JSONFailure;
+    }
+    json_free_serialized_string(serialized_string);
+    return return_code;
 }
 
-static int append_string(char *buf, const char *string) {
+char * json_serialize_to_string_pretty(const JSON_Value *value) {
+    JSON_Status serialization_result = JSONFailure;
+    size_t buf_size_bytes = json_serialization_size_pretty(value);
+    char *buf = NULL;
+    if (buf_size_bytes == 0) {
+        return NULL;
+    }
+    buf = (char*)parson_malloc(buf_size_bytes);
     if (buf == NULL) {
-        return (int)strlen(string);
+        return NULL;
     }
-    return sprintf(buf, "%s", string);
+    serialization_result = json_serialize_to_buffer_pretty(value, buf, buf_size_bytes);
+    if (serialization_result == JSONFailure) {
+        json_free_serialized_string(buf);
+        return NULL;
+    }
+    return buf;
 }
 
-#undef APPEND_STRING
-#undef APPEND_INDENT
+char * json_serialize_to_string_parallel(const JSON_Value *value, size_t threads_count) {
+#if PARSON_THREADS
+    const JSON_Value *root = NULL;
+    threads_count = threads_get_count(threads_count);
+    root = !parson_serialization_cache && threads_count > 1 ? serialization_root(value) : NULL;
+    if (root != NULL) {
+        return serialization_parallel(root, 0, threads_count);
+    }
+#else
+    (void)threads_count;
+#endif
+    return json_serialize_to_string(value);
+}
 
-/* Parser API */
-JSON_Value * json_parse_file(const char *filename) {
-    char *file_contents = read_file(filename);
-    JSON_Value *output_value = NULL;
-    if (file_contents == NULL) {
-        return NULL;
+char * json_serialize_to_string_pretty_parallel(const JSON_Value *value, size_t threads_count) {
+#if PARSON_THREADS
+    const JSON_Value *root = NULL;
+    threads_count = threads_get_count(threads_count);
+    root = threads_count > 1 ? serialization_root(value) : NULL;
+    if (root != NULL) {
+        return serialization_parallel(root, 1, threads_count);
     }
-    output_value = json_parse_string(file_contents);
-    parson_free(file_contents);
-    return output_value;
+#else
+    (void)threads_count;
+#endif
+    return json_serialize_to_string_pretty(value);
 }
 
-JSON_Value * json_parse_file_with_comments(const char *filename) {
-    char *file_contents = read_file(filename);
-    JSON_Value *output_value = NULL;
-    if (file_contents == NULL) {
+void json_free_serialized_string(char *string) {
+    parson_free(string);
+}
+
+JSON_Segment * json_serialize_to_segments(const JSON_Value *value, size_t *segments_count) {
+    JSON_Segment_Writer writer;
+    JSON_Segment *segments = NULL;
+    char num_buf[NUM_BUF_SIZE];
+    if (segments_count == NULL) {
         return NULL;
     }
-    output_value = json_parse_string_with_comments(file_contents);
-    parson_free(file_contents);
-    return output_value;
+    *segments_count = 0;
+    memset(&writer, 0, sizeof(writer));
+    if (json_serialize_to_segments_r(value, &writer, num_buf) < 0) {
+        return NULL;
+    }
+    /* segments are followed by scratch buffer (+1 for terminator written by serializers) */
+    segments = (JSON_Segment*)parson_malloc(writer.count * sizeof(JSON_Segment) + writer.scratch_len + 1);
+    if (segments == NULL) {
+        return NULL;
+    }
+    writer.segments = segments;
+    writer.scratch = (char*)(segments + writer.count);
+    writer.count = 0;
+    writer.scratch_len = 0;
+    writer.last_is_scratch = 0;
+    if (json_serialize_to_segments_r(value, &writer, num_buf) < 0) {
+        parson_free(segments);
+        return NULL;
+    }
+    *segments_count = writer.count;
+    return segments;
 }
 
-JSON_Value * json_parse_string(const char *string) {
-    if (string == NULL) {
+void json_free_segments(JSON_Segment *segments) {
+    parson_free(segments);
+}
+
+unsigned char * json_value_to_msgpack(const JSON_Value *value, size_t *size) {
+    JSON_Binary_Writer writer;
+    unsigned char *data = NULL;
+    if (size == NULL) {
         return NULL;
     }
-    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
-        string = string + 3; /* Support for UTF-8 BOM */
+    *size = 0;
+    memset(&writer, 0, sizeof(writer));
+    if (msgpack_write_value(&writer, value) != JSONSuccess) {
+        return NULL;
+    }
+    data = (unsigned char*)parson_malloc(writer.len);
+    if (data == NULL) {
+        return NULL;
+    }
+    writer.buf = data;
+    writer.len = 0;
+    if (msgpack_write_value(&writer, value) != JSONSuccess) {
+        parson_free(data);
+        return NULL;
     }
-    return parse_value((const char**)&string, 0);
+    *size = writer.len;
+    return data;
 }
 
-JSON_Value * json_parse_string_with_comments(const char *string) {
-    JSON_Value *result = NULL;
-    char *string_mutable_copy = NULL, *string_mutable_copy_ptr = NULL;
-    string_mutable_copy = parson_strdup(string);
-    if (string_mutable_copy == NULL) {
-        return NULL;
+JSON_Status json_value_to_msgpack_stream(const JSON_Value *value, JSON_Write_Function write_fun, void *arg) {
+    JSON_Binary_Writer writer;
+    if (write_fun == NULL) {
+        return JSONFailure;
     }
-    remove_comments(string_mutable_copy, "/*", "*/");
-    remove_comments(string_mutable_copy, "//", "\n");
-    string_mutable_copy_ptr = string_mutable_copy;
-    result = parse_value((const char**)&string_mutable_copy_ptr, 0);
-    parson_free(string_mutable_copy);
-    return result;
+    memset(&writer, 0, sizeof(writer));
+    writer.write_fun = write_fun;
+    writer.arg = arg;
+    if (msgpack_write_value(&writer, value) != JSONSuccess) {
+        return JSONFailure;
+    }
+    return binary_flush(&writer);
 }
 
-/* JSON Object API */
+JSON_Value * json_value_from_msgpack(const unsigned char *data, size_t size) {
+    JSON_Binary_Reader reader;
+    JSON_Value *value = NULL;
+    if (data == NULL) {
+        return NULL;
+    }
+    memset(&reader, 0, sizeof(reader));
+    reader.data = data;
+    reader.size = size;
+    value = msgpack_read_value(&reader, 0);
+    if (value != NULL && reader.pos != size) { /* trailing bytes */
+        json_value_free(value);
+        return NULL;
+    }
+    return value;
+}
 
-JSON_Value * json_object_get_value(const JSON_Object *object, const char *name) {
-    if (object == NULL || name == NULL) {
+JSON_Value * json_value_from_msgpack_stream(JSON_Read_Function read_fun, void *arg) {
+    JSON_Binary_Reader reader;
+    if (read_fun == NULL) {
         return NULL;
     }
-    return json_object_getn_value(object, name, strlen(name));
+    memset(&reader, 0, sizeof(reader));
+    reader.read_fun = read_fun;
+    reader.arg = arg;
+    return msgpack_read_value(&reader, 0);
 }
 
-const char * json_object_get_string(const JSON_Object *object, const char *name) {
-    return json_value_get_string(json_object_get_value(object, name));
+void json_free_msgpack(unsigned char *data) {
+    parson_free(data);
 }
 
-double json_object_get_number(const JSON_Object *object, const char *name) {
-    return json_value_get_number(json_object_get_value(object, name));
+unsigned char * json_value_to_cbor(const JSON_Value *value, size_t *size) {
+    return cbor_encode(value, size, 0);
 }
 
-JSON_Object * json_object_get_object(const JSON_Object *object, const char *name) {
-    return json_value_get_object(json_object_get_value(object, name));
+unsigned char * json_value_to_cbor_canonical(const JSON_Value *value, size_t *size) {
+    return cbor_encode(value, size, 1);
 }
 
-JSON_Array * json_object_get_array(const JSON_Object *object, const char *name) {
-    return json_value_get_array(json_object_get_value(object, name));
+JSON_Value * json_value_from_cbor(const unsigned char *data, size_t size) {
+    JSON_Binary_Reader reader;
+    JSON_Value *value = NULL;
+    if (data == NULL) {
+        return NULL;
+    }
+    memset(&reader, 0, sizeof(reader));
+    reader.data = data;
+    reader.size = size;
+    value = cbor_read_value(&reader, 0);
+    if (value != NULL && reader.pos != size) { /* trailing bytes */
+        json_value_free(value);
+        return NULL;
+    }
+    return value;
 }
 
-int json_object_get_boolean(const JSON_Object *object, const char *name) {
-    return json_value_get_boolean(json_object_get_value(object, name));
+void json_free_cbor(unsigned char *data) {
+    parson_free(data);
 }
 
-JSON_Value * json_object_dotget_value(const JSON_Object *object, const char *name) {
-    const char *dot_position = strchr(name, '.');
-    if (!dot_position) {
-        return json_object_get_value(object, name);
+JSON_Status json_snapshot_write(const JSON_Value *value, const char *filename) {
+    JSON_Binary_Writer writer;
+    JSON_Value *names = NULL;
+    const unsigned char placeholder[SNAPSHOT_HEADER_SIZE] = { 0 };
+    size_t root = 0, size = 0;
+    JSON_Status status = JSONFailure;
+    FILE *fp = NULL;
+    char *temp_name = NULL;
+    if (value == NULL || filename == NULL) {
+        return JSONFailure;
     }
-    object = json_value_get_object(json_object_getn_value(object, name, dot_position - name));
-    return json_object_dotget_value(object, dot_position + 1);
+    names = json_value_init_object();
+    temp_name = (char*)parson_malloc(strlen(filename) + sizeof(".tmp"));
+    if (names == NULL || temp_name == NULL) {
+        json_value_free(names);
+        parson_free(temp_name);
+        return JSONFailure;
+    }
+    /* image is written next to filename and renamed over it, so readers never see a partial file */
+    strcpy(temp_name, filename);
+    strcat(temp_name, ".tmp");
+    fp = fopen(temp_name, "wb");
+    if (fp == NULL) {
+        json_value_free(names);
+        parson_free(temp_name);
+        return JSONFailure;
+    }
+    memset(&writer, 0, sizeof(writer));
+    writer.write_fun = snapshot_file_write;
+    writer.arg = fp;
+    /* header is rewritten when size and root are known */
+    if (binary_put(&writer, placeholder, SNAPSHOT_HEADER_SIZE) == JSONSuccess
+        && snapshot_put_value(&writer, json_object(names), value, &root) == JSONSuccess
+        && binary_flush(&writer) == JSONSuccess && writer.len <= SNAPSHOT_MAX_SIZE
+        && fseek(fp, 0, SEEK_SET) == 0) {
+        size = writer.len;
+        writer.len = 0;
+        if (binary_put(&writer, SNAPSHOT_MAGIC, 4) == JSONSuccess
+            && snapshot_put_u32(&writer, SNAPSHOT_VERSION) == JSONSuccess
+            && snapshot_put_u32(&writer, size) == JSONSuccess
+            && snapshot_put_u32(&writer, root) == JSONSuccess) {
+            status = binary_flush(&writer);
+        }
+    }
+    json_value_free(names);
+    if (fclose(fp) == EOF) {
+        status = JSONFailure;
+    }
+#if !PARSON_POSIX
+    if (status == JSONSuccess) {
+        remove(filename); /* rename doesn't have to replace existing files outside POSIX */
+    }
+#endif
+    if (status != JSONSuccess || rename(temp_name, filename) != 0) {
+        remove(temp_name);
+        status = JSONFailure;
+    }
+    parson_free(temp_name);
+    return status;
 }
 
-const char * json_object_dotget_string(const JSON_Object *object, const char *name) {
-    return json_value_get_string(json_object_dotget_value(object, name));
+JSON_Snapshot * json_snapshot_open(const char *filename) {
+    JSON_Snapshot *snapshot = NULL;
+    unsigned char *data = NULL;
+    size_t size = 0;
+    long pos = 0;
+    FILE *fp = NULL;
+#if PARSON_POSIX
+    struct stat info;
+    void *mapping = NULL;
+    int fd = -1;
+    if (filename == NULL) {
+        return NULL;
+    }
+    fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &info) == 0 && info.st_size >= SNAPSHOT_HEADER_SIZE && (unsigned long)info.st_size <= SNAPSHOT_MAX_SIZE) {
+        mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping != NULL && mapping != MAP_FAILED) {
+        snapshot = snapshot_init((const unsigned char*)mapping, (size_t)info.st_size);
+        if (snapshot == NULL) {
+            munmap(mapping, (size_t)info.st_size);
+            return NULL;
+        }
+        snapshot->mapped = 1;
+        return snapshot;
+    }
+#endif
+    if (filename == NULL) {
+        return NULL;
+    }
+    fp = fopen(filename, "rb"); /* without mmap file is read into memory */
+    if (fp == NULL) {
+        return NULL;
+    }
+    if (fseek(fp, 0L, SEEK_END) == 0) {
+        pos = ftell(fp);
+    }
+    if (pos >= SNAPSHOT_HEADER_SIZE && (unsigned long)pos <= SNAPSHOT_MAX_SIZE && fseek(fp, 0L, SEEK_SET) == 0) {
+        size = (size_t)pos;
+        data = (unsigned char*)parson_malloc(size);
+    }
+    if (data != NULL && fread(data, 1, size, fp) == size) {
+        snapshot = snapshot_init(data, size);
+    }
+    fclose(fp);
+    if (snapshot == NULL) {
+        parson_free(data);
+        return NULL;
+    }
+    snapshot->owned = 1;
+    return snapshot;
 }
 
-double json_object_dotget_number(const JSON_Object *object, const char *name) {
-    return json_value_get_number(json_object_dotget_value(object, name));
+JSON_Snapshot * json_snapshot_open_buffer(const void *data, size_t size) {
+    return snapshot_init((const unsigned char*)data, size);
 }
 
-JSON_Object * json_object_dotget_object(const JSON_Object *object, const char *name) {
-    return json_value_get_object(json_object_dotget_value(object, name));
+void json_snapshot_close(JSON_Snapshot *snapshot) {
+    if (snapshot == NULL) {
+        return;
+    }
+#if PARSON_POSIX
+    if (snapshot->mapped) {
+        munmap((void*)snapshot->data, snapshot->size);
+    }
+#endif
+    if (snapshot->owned) {
+        parson_free((void*)snapshot->data);
+    }
+    parson_free(snapshot);
 }
 
-JSON_Array * json_object_dotget_array(const JSON_Object *object, const char *name) {
-    return json_value_get_array(json_object_dotget_value(object, name));
+const JSON_Snapshot_Value * json_snapshot_root(const JSON_Snapshot *snapshot) {
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    return (const JSON_Snapshot_Value*)(snapshot->data + snapshot_get_u32(snapshot->data + 12));
 }
 
-int json_object_dotget_boolean(const JSON_Object *object, const char *name) {
-    return json_value_get_boolean(json_object_dotget_value(object, name));
+JSON_Value_Type json_snapshot_get_type(const JSON_Snapshot_Value *value) {
+    return value == NULL ? JSONError : (JSON_Value_Type)(snapshot_get_u32((const unsigned char*)value) & 0xff);
 }
 
-size_t json_object_get_count(const JSON_Object *object) {
-    return object ? object->count : 0;
+const char * json_snapshot_get_string(const JSON_Snapshot_Value *value) {
+    if (json_snapshot_get_type(value) != JSONString) {
+        return NULL;
+    }
+    return (const char*)value + 8;
 }
 
-const char * json_object_get_name(const JSON_Object *object, size_t index) {
-    if (object == NULL || index >= json_object_get_count(object)) {
-        return NULL;
+size_t json_snapshot_get_string_len(const JSON_Snapshot_Value *value) {
+    if (json_snapshot_get_type(value) != JSONString) {
+        return 0;
     }
-    return object->names[index];
+    return snapshot_get_u32((const unsigned char*)value + 4);
 }
 
-JSON_Value * json_object_get_value_at(const JSON_Object *object, size_t index) {
-    if (object == NULL || index >= json_object_get_count(object)) {
-        return NULL;
+double json_snapshot_get_number(const JSON_Snapshot_Value *value) {
+    const unsigned char *bytes = (const unsigned char*)value + 4;
+    unsigned char *raw = NULL;
+    double number = 0.0;
+    int little_endian = host_is_little_endian();
+    size_t i = 0;
+    if (json_snapshot_get_type(value) != JSONNumber) {
+        return 0;
     }
-    return object->values[index];
+    raw = (unsigned char*)&number;
+    for (i = 0; i < 8; i++) {
+        raw[i] = bytes[little_endian ? i : 7 - i];
+    }
+    return number;
 }
 
-JSON_Value *json_object_get_wrapping_value(const JSON_Object *object) {
-    return object->wrapping_value;
+int json_snapshot_get_boolean(const JSON_Snapshot_Value *value) {
+    if (json_snapshot_get_type(value) != JSONBoolean) {
+        return -1;
+    }
+    return (snapshot_get_u32((const unsigned char*)value) & 0x100) != 0;
 }
 
-int json_object_has_value (const JSON_Object *object, const char *name) {
-    return json_object_get_value(object, name) != NULL;
+size_t json_snapshot_get_count(const JSON_Snapshot_Value *value) {
+    JSON_Value_Type type = json_snapshot_get_type(value);
+    if (type != JSONArray && type != JSONObject) {
+        return 0;
+    }
+    return snapshot_get_u32((const unsigned char*)value + 4);
 }
 
-int json_object_has_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type) {
-    JSON_Value *val = json_object_get_value(object, name);
-    return val != NULL && json_value_get_type(val) == type;
+const JSON_Snapshot_Value * json_snapshot_get_value(const JSON_Snapshot_Value *object, const char *name) {
+    if (name == NULL) {
+        return NULL;
+    }
+    return snapshot_getn_value(object, name, strlen(name));
 }
 
-int json_object_dothas_value (const JSON_Object *object, const char *name) {
-    return json_object_dotget_value(object, name) != NULL;
+const JSON_Snapshot_Value * json_snapshot_dotget_value(const JSON_Snapshot_Value *object, const char *name) {
+    const char *dot = NULL;
+    if (name == NULL) {
+        return NULL;
+    }
+    while ((dot = strchr(name, '.')) != NULL && object != NULL) {
+        object = snapshot_getn_value(object, name, (size_t)(dot - name));
+        name = dot + 1;
+    }
+    return snapshot_getn_value(object, name, strlen(name));
 }
 
-int json_object_dothas_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type) {
-    JSON_Value *val = json_object_dotget_value(object, name);
-    return val != NULL && json_value_get_type(val) == type;
+const JSON_Snapshot_Value * json_snapshot_get_value_at(const JSON_Snapshot_Value *value, size_t index) {
+    JSON_Value_Type type = json_snapshot_get_type(value);
+    if (index >= json_snapshot_get_count(value)) {
+        return NULL;
+    }
+    return (const JSON_Snapshot_Value*)snapshot_child((const unsigned char*)value, type == JSONArray ? 8 + index * 4 : 12 + index * 8);
+}
+
+const char * json_snapshot_get_name_at(const JSON_Snapshot_Value *object, size_t index) {
+    if (json_snapshot_get_type(object) != JSONObject || index >= json_snapshot_get_count(object)) {
+        return NULL;
+    }
+    return (const char*)snapshot_child((const unsigned char*)object, 8 + index * 8) + 8;
+}
+
+JSON_Tape * json_tape_parse_string(const char *string) {
+    JSON_Tape *tape = NULL;
+    JSON_Parser parser;
+    if (string == NULL) {
+        return NULL;
+    }
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    tape = (JSON_Tape*)parson_malloc(sizeof(JSON_Tape));
+    if (tape == NULL) {
+        return NULL;
+    }
+    memset(tape, 0, sizeof(JSON_Tape));
+    parser_init(&parser);
+    if (tape_parse_value(tape, &parser, &string, 0) != JSONSuccess) {
+        parser_deinit(&parser);
+        json_tape_free(tape);
+        return NULL;
+    }
+    if (parser.scratch == parser.scratch_stack) { /* strings have to outlive parser */
+        tape->strings = (char*)parson_malloc(parser.scratch_used + 1);
+        if (tape->strings == NULL) {
+            json_tape_free(tape);
+            return NULL;
+        }
+        memcpy(tape->strings, parser.scratch, parser.scratch_used);
+    } else {
+        tape->strings = parser.scratch;
+    }
+    return tape;
 }
 
-/* JSON Array API */
-JSON_Value * json_array_get_value(const JSON_Array *array, size_t index) {
-    if (array == NULL || index >= json_array_get_count(array)) {
+JSON_Tape * json_tape_parse_file(const char *filename) {
+    char *file_contents = read_file(filename);
+    JSON_Tape *tape = NULL;
+    if (file_contents == NULL) {
         return NULL;
     }
-    return array->items[index];
+    tape = json_tape_parse_string(file_contents);
+    parson_free(file_contents);
+    return tape;
 }
 
-const char * json_array_get_string(const JSON_Array *array, size_t index) {
-    return json_value_get_string(json_array_get_value(array, index));
+void json_tape_free(JSON_Tape *tape) {
+    if (tape == NULL) {
+        return;
+    }
+    parson_free(tape->words);
+    parson_free(tape->numbers);
+    parson_free(tape->strings);
+    parson_free(tape);
 }
 
-double json_array_get_number(const JSON_Array *array, size_t index) {
-    return json_value_get_number(json_array_get_value(array, index));
+JSON_Cursor json_tape_root(const JSON_Tape *tape) {
+    return tape_cursor(tape, 0, 0, 0);
 }
 
-JSON_Object * json_array_get_object(const JSON_Array *array, size_t index) {
-    return json_value_get_object(json_array_get_value(array, index));
+JSON_Value_Type json_cursor_get_type(JSON_Cursor cursor) {
+    if (cursor.tape == NULL) {
+        return JSONError;
+    }
+    switch (TAPE_TAG(cursor.tape->words[cursor.index])) {
+        case TapeNull:   return JSONNull;
+        case TapeTrue:   return JSONBoolean;
+        case TapeFalse:  return JSONBoolean;
+        case TapeNumber: return JSONNumber;
+        case TapeString: return JSONString;
+        case TapeArray:  return JSONArray;
+        case TapeObject: return JSONObject;
+        default:         return JSONError;
+    }
 }
 
-JSON_Array * json_array_get_array(const JSON_Array *array, size_t index) {
-    return json_value_get_array(json_array_get_value(array, index));
+const char * json_cursor_get_string(JSON_Cursor cursor) {
+    if (json_cursor_get_type(cursor) != JSONString) {
+        return NULL;
+    }
+    return cursor.tape->strings + TAPE_PAYLOAD(cursor.tape->words[cursor.index]);
 }
 
-int json_array_get_boolean(const JSON_Array *array, size_t index) {
-    return json_value_get_boolean(json_array_get_value(array, index));
+size_t json_cursor_get_string_len(JSON_Cursor cursor) {
+    if (json_cursor_get_type(cursor) != JSONString) {
+        return 0;
+    }
+    return cursor.tape->words[cursor.index + 1];
 }
 
-size_t json_array_get_count(const JSON_Array *array) {
-    return array ? array->count : 0;
+double json_cursor_get_number(JSON_Cursor cursor) {
+    if (json_cursor_get_type(cursor) != JSONNumber) {
+        return 0;
+    }
+    return cursor.tape->numbers[TAPE_PAYLOAD(cursor.tape->words[cursor.index])];
 }
 
-JSON_Value * json_array_get_wrapping_value(const JSON_Array *array) {
-    return array->wrapping_value;
+int json_cursor_get_boolean(JSON_Cursor cursor) {
+    if (json_cursor_get_type(cursor) != JSONBoolean) {
+        return -1;
+    }
+    return TAPE_TAG(cursor.tape->words[cursor.index]) == TapeTrue;
 }
 
-/* JSON Value API */
-JSON_Value_Type json_value_get_type(const JSON_Value *value) {
-    return value ? value->type : JSONError;
+size_t json_cursor_get_count(JSON_Cursor cursor) {
+    JSON_Value_Type type = json_cursor_get_type(cursor);
+    if (type != JSONArray && type != JSONObject) {
+        return 0;
+    }
+    return cursor.tape->words[cursor.index + 1];
 }
 
-JSON_Object * json_value_get_object(const JSON_Value *value) {
-    return json_value_get_type(value) == JSONObject ? value->value.object : NULL;
+const char * json_cursor_get_name(JSON_Cursor cursor) {
+    if (cursor.tape == NULL || cursor.name == 0) {
+        return NULL;
+    }
+    return cursor.tape->strings + TAPE_PAYLOAD(cursor.tape->words[cursor.name]);
 }
 
-JSON_Array * json_value_get_array(const JSON_Value *value) {
-    return json_value_get_type(value) == JSONArray ? value->value.array : NULL;
+JSON_Cursor json_cursor_first(JSON_Cursor container) {
+    JSON_Value_Type type = json_cursor_get_type(container);
+    size_t end = 0;
+    if (json_cursor_get_count(container) == 0) {
+        return tape_cursor(NULL, 0, 0, 0);
+    }
+    end = TAPE_PAYLOAD(container.tape->words[container.index]);
+    if (type == JSONObject) {
+        return tape_cursor(container.tape, container.index + 4, container.index + 2, end);
+    }
+    return tape_cursor(container.tape, container.index + 2, 0, end);
 }
 
-const char * json_value_get_string(const JSON_Value *value) {
-    return json_value_get_type(value) == JSONString ? value->value.string : NULL;
+JSON_Cursor json_cursor_next(JSON_Cursor cursor) {
+    size_t next = 0;
+    if (cursor.tape == NULL) {
+        return cursor;
+    }
+    next = tape_next(cursor.tape, cursor.index);
+    if (next >= cursor.end) {
+        return tape_cursor(NULL, 0, 0, 0);
+    }
+    if (cursor.name != 0) {
+        return tape_cursor(cursor.tape, next + 2, next, cursor.end);
+    }
+    return tape_cursor(cursor.tape, next, 0, cursor.end);
 }
 
-double json_value_get_number(const JSON_Value *value) {
-    return json_value_get_type(value) == JSONNumber ? value->value.number : 0;
+JSON_Cursor json_cursor_get_value(JSON_Cursor object, const char *name) {
+    if (name == NULL) {
+        return tape_cursor(NULL, 0, 0, 0);
+    }
+    return tape_getn_value(object, name, strlen(name));
 }
 
-int json_value_get_boolean(const JSON_Value *value) {
-    return json_value_get_type(value) == JSONBoolean ? value->value.boolean : -1;
+JSON_Cursor json_cursor_dotget_value(JSON_Cursor object, const char *name) {
+    const char *dot = NULL;
+    if (name == NULL) {
+        return tape_cursor(NULL, 0, 0, 0);
+    }
+    while ((dot = strchr(name, '.')) != NULL) {
+        object = tape_getn_value(object, name, (size_t)(dot - name));
+        name = dot + 1;
+    }
+    return tape_getn_value(object, name, strlen(name));
 }
 
-JSON_Value * json_value_get_parent (const JSON_Value *value) {
-    return value ? value->parent : NULL;
+JSON_Cursor json_cursor_get_value_at(JSON_Cursor container, size_t index) {
+    JSON_Cursor cursor = json_cursor_first(container);
+    while (index-- > 0 && cursor.tape != NULL) {
+        cursor = json_cursor_next(cursor);
+    }
+    return cursor;
 }
 
-void json_value_free(JSON_Value *value) {
-    switch (json_value_get_type(value)) {
-        case JSONObject:
-            json_object_free(value->value.object);
-            break;
+JSON_Value * json_cursor_to_value(JSON_Cursor cursor) {
+    JSON_Value *value = NULL, *item = NULL;
+    JSON_Value_Type type = json_cursor_get_type(cursor);
+    size_t count = json_cursor_get_count(cursor);
+    char *string = NULL;
+    switch (type) {
+        case JSONArray: case JSONObject:
+            value = type == JSONArray ? json_value_init_array() : json_value_init_object();
+            if (value == NULL) {
+                return NULL;
+            }
+            if (count > 0 && (type == JSONArray ? json_array_resize(json_array(value), count)
+                                                : json_object_resize(json_object(value), count)) != JSONSuccess) {
+                json_value_free(value);
+                return NULL;
+            }
+            for (cursor = json_cursor_first(cursor); cursor.tape != NULL; cursor = json_cursor_next(cursor)) {
+                item = json_cursor_to_value(cursor);
+                if (item == NULL || (type == JSONArray ? json_array_add(json_array(value), item)
+                                                       : json_object_add(json_object(value), json_cursor_get_name(cursor), item)) != JSONSuccess) {
+                    json_value_free(item);
+                    json_value_free(value);
+                    return NULL;
+                }
+            }
+            return value;
         case JSONString:
-            parson_free(value->value.string);
-            break;
-        case JSONArray:
-            json_array_free(value->value.array);
-            break;
+            string = parson_strndup(json_cursor_get_string(cursor), json_cursor_get_string_len(cursor));
+            if (string == NULL) {
+                return NULL;
+            }
+            value = json_value_init_string_no_copy(string);
+            if (value == NULL) {
+                parson_free(string);
+            }
+            return value;
+        case JSONNumber:
+            return json_value_init_number(json_cursor_get_number(cursor));
+        case JSONBoolean:
+            return json_value_init_boolean(json_cursor_get_boolean(cursor));
+        case JSONNull:
+            return json_value_init_null();
         default:
-            break;
+            return NULL;
     }
-    parson_free(value);
 }
 
-JSON_Value * json_value_init_object(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
+JSON_Lines * json_lines_open_string(const char *string) {
+    JSON_Lines *lines = NULL;
+    if (string == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONObject;
-    new_value->value.object = json_object_init(new_value);
-    if (!new_value->value.object) {
-        parson_free(new_value);
+    lines = lines_init();
+    if (lines == NULL) {
         return NULL;
     }
-    return new_value;
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
+    }
+    lines->string = string;
+    return lines;
 }
 
-JSON_Value * json_value_init_array(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
+JSON_Lines * json_lines_open_file(const char *filename) {
+    JSON_Lines *lines = NULL;
+    FILE *fp = NULL;
+    if (filename == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONArray;
-    new_value->value.array = json_array_init(new_value);
-    if (!new_value->value.array) {
-        parson_free(new_value);
+    fp = fopen(filename, "rb");
+    if (fp == NULL) {
         return NULL;
     }
-    return new_value;
-}
-
-JSON_Value * json_value_init_string(const char *string) {
-    char *copy = NULL;
-    JSON_Value *value;
-    size_t string_len = 0;
-    if (string == NULL) {
+    lines = json_lines_open_stream(lines_file_read, fp);
+    if (lines == NULL) {
+        fclose(fp);
         return NULL;
     }
-    string_len = strlen(string);
-    if (!is_valid_utf8(string, string_len)) {
+    lines->fp = fp;
+    return lines;
+}
+
+JSON_Lines * json_lines_open_fd(int fd) {
+#if PARSON_POSIX
+    JSON_Lines *lines = NULL;
+    if (fd < 0) {
         return NULL;
     }
-    copy = parson_strndup(string, string_len);
-    if (copy == NULL) {
+    lines = json_lines_open_stream(lines_fd_read, NULL);
+    if (lines == NULL) {
         return NULL;
     }
-    value = json_value_init_string_no_copy(copy);
-    if (value == NULL) {
-        parson_free(copy);
-    }
-    return value;
+    lines->fd = fd;
+    lines->arg = &lines->fd;
+    return lines;
+#else
+    (void)fd;
+    return NULL;
+#endif
 }
 
-JSON_Value * json_value_init_number(double number) {
-    JSON_Value *new_value = NULL;
-    if ((number * 0.0) != 0.0) { /* nan and inf test */
+JSON_Lines * json_lines_open_stream(JSON_Read_Function read_fun, void *arg) {
+    JSON_Lines *lines = NULL;
+    if (read_fun == NULL) {
         return NULL;
     }
-    new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (new_value == NULL) {
+    lines = lines_init();
+    if (lines == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONNumber;
-    new_value->value.number = number;
-    return new_value;
+    lines->read_fun = read_fun;
+    lines->arg = arg;
+    return lines;
 }
 
-JSON_Value * json_value_init_boolean(int boolean) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
-        return NULL;
+void json_lines_set_skip_errors(JSON_Lines *lines, int skip_errors) {
+    if (lines != NULL) {
+        lines->skip_errors = skip_errors;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONBoolean;
-    new_value->value.boolean = boolean ? 1 : 0;
-    return new_value;
 }
 
-JSON_Value * json_value_init_null(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
-    if (!new_value) {
+JSON_Value * json_lines_next(JSON_Lines *lines) {
+    const char *line = NULL, *line_end = NULL;
+    JSON_Value *value = NULL;
+    if (lines == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONNull;
-    return new_value;
-}
-
-JSON_Value * json_value_deep_copy(const JSON_Value *value) {
-    size_t i = 0;
-    JSON_Value *return_value = NULL, *temp_value_copy = NULL, *temp_value = NULL;
-    const char *temp_string = NULL, *temp_key = NULL;
-    char *temp_string_copy = NULL;
-    JSON_Array *temp_array = NULL, *temp_array_copy = NULL;
-    JSON_Object *temp_object = NULL, *temp_object_copy = NULL;
-
-    switch (json_value_get_type(value)) {
-        case JSONArray:
-            temp_array = json_value_get_array(value);
-            return_value = json_value_init_array();
-            if (return_value == NULL) {
-                return NULL;
-            }
-            temp_array_copy = json_value_get_array(return_value);
-            for (i = 0; i < json_array_get_count(temp_array); i++) {
-                temp_value = json_array_get_value(temp_array, i);
-                temp_value_copy = json_value_deep_copy(temp_value);
-                if (temp_value_copy == NULL) {
-                    json_value_free(return_value);
-                    return NULL;
-                }
-                if (json_array_add(temp_array_copy, temp_value_copy) == JSONFailure) {
-                    json_value_free(return_value);
-                    json_value_free(temp_value_copy);
-                    return NULL;
-                }
-            }
-            return return_value;
-        case JSONObject:
-            temp_object = json_value_get_object(value);
-            return_value = json_value_init_object();
-            if (return_value == NULL) {
-                return NULL;
-            }
-            temp_object_copy = json_value_get_object(return_value);
-            for (i = 0; i < json_object_get_count(temp_object); i++) {
-                temp_key = json_object_get_name(temp_object, i);
-                temp_value = json_object_get_value(temp_object, temp_key);
-                temp_value_copy = json_value_deep_copy(temp_value);
-                if (temp_value_copy == NULL) {
-                    json_value_free(return_value);
-                    return NULL;
-                }
-                if (json_object_add(temp_object_copy, temp_key, temp_value_copy) == JSONFailure) {
-                    json_value_free(return_value);
-                    json_value_free(temp_value_copy);
-                    return NULL;
-                }
-            }
-            return return_value;
-        case JSONBoolean:
-            return json_value_init_boolean(json_value_get_boolean(value));
-        case JSONNumber:
-            return json_value_init_number(json_value_get_number(value));
-        case JSONString:
-            temp_string = json_value_get_string(value);
-            if (temp_string == NULL) {
-                return NULL;
-            }
-            temp_string_copy = parson_strdup(temp_string);
-            if (temp_string_copy == NULL) {
-                return NULL;
-            }
-            return_value = json_value_init_string_no_copy(temp_string_copy);
-            if (return_value == NULL) {
-                parson_free(temp_string_copy);
+    lines->error_line = 0;
+    while ((line = lines_next_line(lines, &line_end)) != NULL) {
+        lines->line++;
+        if (lines->line == 1 && lines->string == NULL
+            && line[0] == '\xEF' && line[1] == '\xBB' && line[2] == '\xBF') {
+            line = line + 3; /* Support for UTF-8 BOM */
+        }
+        if (lines_parse_line(&lines->parser, line, line_end, &value) == JSONSuccess) {
+            if (value != NULL) {
+                return value;
             }
-            return return_value;
-        case JSONNull:
-            return json_value_init_null();
-        case JSONError:
-            return NULL;
-        default:
+            continue; /* blank lines are ignored */
+        }
+        lines->error_count++;
+        if (!lines->skip_errors) {
+            lines->error_line = lines->line;
             return NULL;
+        }
     }
+    return NULL;
 }
 
-size_t json_serialization_size(const JSON_Value *value) {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 0, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+size_t json_lines_get_line(const JSON_Lines *lines) {
+    return lines == NULL ? 0 : lines->line;
 }
 
-JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes) {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
-        return JSONFailure;
+size_t json_lines_get_error_line(const JSON_Lines *lines) {
+    return lines == NULL ? 0 : lines->error_line;
+}
+
+size_t json_lines_get_error_count(const JSON_Lines *lines) {
+    return lines == NULL ? 0 : lines->error_count;
+}
+
+void json_lines_close(JSON_Lines *lines) {
+    if (lines == NULL) {
+        return;
     }
-    written = json_serialize_to_buffer_r(value, buf, 0, 0, NULL);
-    if (written < 0) {
-        return JSONFailure;
+    if (lines->fp != NULL) {
+        fclose(lines->fp);
     }
-    return JSONSuccess;
+    parser_deinit(&lines->parser);
+    parson_free(lines->buf);
+    parson_free(lines);
 }
 
-JSON_Status json_serialize_to_file(const JSON_Value *value, const char *filename) {
-    JSON_Status return_code = JSONSuccess;
+JSON_Lines_Writer * json_lines_writer_open_file(const char *filename) {
+    JSON_Lines_Writer *writer = NULL;
     FILE *fp = NULL;
-    char *serialized_string = json_serialize_to_string(value);
-    if (serialized_string == NULL) {
-        return JSONFailure;
+    if (filename == NULL) {
+        return NULL;
     }
-    fp = fopen(filename, "w");
+    fp = fopen(filename, "ab");
     if (fp == NULL) {
-        json_free_serialized_string(serialized_string);
-        return JSONFailure;
-    }
-    if (fputs(serialized_string, fp) == EOF) {
-        return_code = JSONFailure;
+        return NULL;
     }
-    if (fclose(fp) == EOF) {
-        return_code = JSONFailure;
+    writer = lines_writer_init(lines_file_write, fp);
+    if (writer == NULL) {
+        fclose(fp);
+        return NULL;
     }
-    json_free_serialized_string(serialized_string);
-    return return_code;
+    writer->fp = fp;
+    return writer;
 }
 
-char * json_serialize_to_string(const JSON_Value *value) {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
+JSON_Lines_Writer * json_lines_writer_open_fd(int fd) {
+#if PARSON_POSIX
+    JSON_Lines_Writer *writer = NULL;
+    if (fd < 0) {
         return NULL;
     }
-    buf = (char*)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
-    }
-    serialization_result = json_serialize_to_buffer(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
+    writer = lines_writer_init(lines_fd_write, NULL);
+    if (writer == NULL) {
         return NULL;
     }
-    return buf;
+    writer->fd = fd;
+    writer->arg = &writer->fd;
+    return writer;
+#else
+    (void)fd;
+    return NULL;
+#endif
 }
 
-size_t json_serialization_size_pretty(const JSON_Value *value) {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 1, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+JSON_Lines_Writer * json_lines_writer_open_stream(JSON_Write_Function write_fun, void *arg) {
+    return lines_writer_init(write_fun, arg);
 }
 
-JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf, size_t buf_size_in_bytes) {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size_pretty(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
+JSON_Status json_lines_write(JSON_Lines_Writer *writer, const JSON_Value *value) {
+    size_t size = 0, new_capacity = 0, i = 0, line_len = 0;
+    char *new_buf = NULL, *line = NULL;
+    if (writer == NULL || writer->status != JSONSuccess) {
         return JSONFailure;
     }
-    written = json_serialize_to_buffer_r(value, buf, 0, 1, NULL);
-    if (written < 0) {
+    size = json_serialization_size(value); /* line's newline takes place of terminating null */
+    if (size == 0) {
+        return JSONFailure;
+    }
+    if (writer->buf_capacity - writer->buf_len < size && json_lines_writer_flush(writer) != JSONSuccess) {
+        return JSONFailure;
+    }
+    if (writer->buf_capacity < size) {
+        new_capacity = MAX(size, LINES_BUFFER_SIZE);
+        new_buf = (char*)parson_malloc(new_capacity);
+        if (new_buf == NULL) {
+            return JSONFailure;
+        }
+        parson_free(writer->buf);
+        writer->buf = new_buf;
+        writer->buf_capacity = new_capacity;
+    }
+    line = writer->buf + writer->buf_len;
+    if (json_serialize_to_buffer_r(value, line, 0, 0, NULL) < 0) {
         return JSONFailure;
     }
+    if (memchr(line, '\n', size - 1) != NULL || memchr(line, '\r', size - 1) != NULL) {
+        for (i = 0; i < size - 1; i++) { /* raw fragments are copied verbatim, strings can't have line breaks */
+            if (line[i] != '\n' && line[i] != '\r') {
+                line[line_len++] = line[i];
+            }
+        }
+        size = line_len + 1;
+    }
+    writer->buf_len += size;
+    writer->buf[writer->buf_len - 1] = '\n';
+    if (writer->buf_len >= LINES_BUFFER_SIZE) {
+        return json_lines_writer_flush(writer);
+    }
     return JSONSuccess;
 }
 
-JSON_Status json_serialize_to_file_pretty(const JSON_Value *value, const char *filename) {
-    JSON_Status return_code = JSONSuccess;
-    FILE *fp = NULL;
-    char *serialized_string = json_serialize_to_string_pretty(value);
-    if (serialized_string == NULL) {
+JSON_Status json_lines_writer_flush(JSON_Lines_Writer *writer) {
+    if (writer == NULL) {
         return JSONFailure;
     }
-    fp = fopen(filename, "w");
-    if (fp == NULL) {
-        json_free_serialized_string(serialized_string);
-        return JSONFailure;
+    if (writer->status == JSONSuccess && writer->buf_len > 0) {
+        writer->status = writer->write_fun(writer->buf, writer->buf_len, writer->arg);
     }
-    if (fputs(serialized_string, fp) == EOF) {
-        return_code = JSONFailure;
+    writer->buf_len = 0;
+    if (writer->status == JSONSuccess && writer->fp != NULL && fflush(writer->fp) == EOF) {
+        writer->status = JSONFailure;
     }
-    if (fclose(fp) == EOF) {
-        return_code = JSONFailure;
+    return writer->status;
+}
+
+JSON_Status json_lines_writer_close(JSON_Lines_Writer *writer) {
+    JSON_Status status = JSONSuccess;
+    if (writer == NULL) {
+        return JSONFailure;
     }
-    json_free_serialized_string(serialized_string);
-    return return_code;
+    status = json_lines_writer_flush(writer);
+    if (writer->fp != NULL && fclose(writer->fp) == EOF) {
+        status = JSONFailure;
+    }
+    parson_free(writer->buf);
+    parson_free(writer);
+    return status;
 }
 
-char * json_serialize_to_string_pretty(const JSON_Value *value) {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size_pretty(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
+JSON_Status json_lines_parse_parallel(const char *string, size_t threads_count, int ordered,
+                                      JSON_Lines_Callback callback, void *arg) {
+#if PARSON_THREADS
+    JSON_Lines_Job job;
+    pthread_t *threads = NULL;
+    JSON_Status status = JSONFailure;
+    size_t started = 0, i = 0, j = 0, size = 0;
+#endif
+    if (string == NULL || callback == NULL) {
+        return JSONFailure;
     }
-    buf = (char*)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
+    if (string[0] == '\xEF' && string[1] == '\xBB' && string[2] == '\xBF') {
+        string = string + 3; /* Support for UTF-8 BOM */
     }
-    serialization_result = json_serialize_to_buffer_pretty(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
+    threads_count = threads_get_count(threads_count);
+#if PARSON_THREADS
+    if (threads_count < 2) {
+        return lines_parse_sequential(string, callback, arg);
+    }
+    size = strlen(string);
+    memset(&job, 0, sizeof(JSON_Lines_Job));
+    job.next = string;
+    job.end = string + size;
+    job.chunk_size = MIN(MAX(size / (threads_count * LINES_CHUNKS_PER_THREAD * 4), PARALLEL_CHUNK_MIN), PARALLEL_CHUNK_MAX);
+    job.window = threads_count * LINES_CHUNKS_PER_THREAD;
+    job.chunks = (JSON_Lines_Chunk*)parson_malloc(job.window * sizeof(JSON_Lines_Chunk));
+    threads = (pthread_t*)parson_malloc(threads_count * sizeof(pthread_t));
+    if (job.chunks == NULL || threads == NULL) {
+        parson_free(job.chunks);
+        parson_free(threads);
+        return JSONFailure;
     }
-    return buf;
+    memset(job.chunks, 0, job.window * sizeof(JSON_Lines_Chunk));
+    if (pthread_mutex_init(&job.mutex, NULL) == 0) {
+        if (pthread_cond_init(&job.cond, NULL) == 0) {
+            for (started = 0; started < threads_count; started++) {
+                if (pthread_create(&threads[started], NULL, lines_worker, &job) != 0) {
+                    break;
+                }
+            }
+            if (started > 0) {
+                status = lines_deliver(&job, ordered, callback, arg);
+            }
+            for (i = 0; i < started; i++) {
+                pthread_join(threads[i], NULL);
+            }
+            pthread_cond_destroy(&job.cond);
+        }
+        pthread_mutex_destroy(&job.mutex);
+    }
+    for (i = 0; i < job.window; i++) { /* values that weren't delivered after a failure */
+        for (j = 0; j < job.chunks[i].items_count; j++) {
+            json_value_free(job.chunks[i].items[j].value);
+        }
+        parson_free(job.chunks[i].items);
+    }
+    parson_free(job.chunks);
+    parson_free(threads);
+    if (started == 0 && job.claimed == 0) { /* threads aren't available */
+        return lines_parse_sequential(string, callback, arg);
+    }
+    return status;
+#else
+    (void)ordered;
+    return lines_parse_sequential(string, callback, arg);
+#endif
 }
 
-void json_free_serialized_string(char *string) {
-    parson_free(string);
+JSON_Status json_array_remove(JSON_Array *array, size_t ix) {
+    JSON_Value *value = json_array_detach(array, ix);
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    json_value_free(value);
+    return JSONSuccess;
 }
 
-JSON_Status json_array_remove(JSON_Array *array, size_t ix) {
+JSON_Value * json_array_detach(JSON_Array *array, size_t ix) {
+    JSON_Value *value = NULL;
     size_t to_move_bytes = 0;
     if (array == NULL || ix >= json_array_get_count(array)) {
-        return JSONFailure;
+        return NULL;
     }
-    json_value_free(json_array_get_value(array, ix));
+    value = json_array_get_value(array, ix);
     to_move_bytes = (json_array_get_count(array) - 1 - ix) * sizeof(JSON_Value*);
     memmove(array->items + ix, array->items + ix + 1, to_move_bytes);
     array->count -= 1;
-    return JSONSuccess;
+    value->parent = NULL;
+    json_value_invalidate(json_array_get_wrapping_value(array));
+    return value;
 }
 
 JSON_Status json_array_replace_value(JSON_Array *array, size_t ix, JSON_Value *value) {
@@ -1620,6 +7778,7 @@ JSON_Status json_array_replace_value(JSON_Array *array, size_t ix, JSON_Value *v
     json_value_free(json_array_get_value(array, ix));
     value->parent = json_array_get_wrapping_value(array);
     array->items[ix] = value;
+    json_value_invalidate(value->parent);
     return JSONSuccess;
 }
 
@@ -1680,6 +7839,7 @@ JSON_Status json_array_clear(JSON_Array *array) {
         json_value_free(json_array_get_value(array, i));
     }
     array->count = 0;
+    json_value_invalidate(json_array_get_wrapping_value(array));
     return JSONSuccess;
 }
 
@@ -1687,7 +7847,11 @@ JSON_Status json_array_append_value(JSON_Array *array, JSON_Value *value) {
     if (array == NULL || value == NULL || value->parent != NULL) {
         return JSONFailure;
     }
-    return json_array_add(array, value);
+    if (json_array_add(array, value) == JSONFailure) {
+        return JSONFailure;
+    }
+    json_value_invalidate(value->parent);
+    return JSONSuccess;
 }
 
 JSON_Status json_array_append_string(JSON_Array *array, const char *string) {
@@ -1739,24 +7903,12 @@ JSON_Status json_array_append_null(JSON_Array *array) {
 }
 
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value) {
-    size_t i = 0;
-    JSON_Value *old_value;
+    size_t name_len = 0;
     if (object == NULL || name == NULL || value == NULL || value->parent != NULL) {
         return JSONFailure;
     }
-    old_value = json_object_get_value(object, name);
-    if (old_value != NULL) { /* free and overwrite old value */
-        json_value_free(old_value);
-        for (i = 0; i < json_object_get_count(object); i++) {
-            if (strcmp(object->names[i], name) == 0) {
-                value->parent = json_object_get_wrapping_value(object);
-                object->values[i] = value;
-                return JSONSuccess;
-            }
-        }
-    }
-    /* add new key value pair */
-    return json_object_add(object, name, value);
+    name_len = strlen(name);
+    return json_object_setn_value(object, name, name_len, hash_string(name, name_len), value);
 }
 
 JSON_Status json_object_set_string(JSON_Object *object, const char *name, const char *string) {
@@ -1814,6 +7966,7 @@ JSON_Status json_object_dotset_value(JSON_Object *object, const char *name, JSON
         json_value_free(new_value);
         return JSONFailure;
     }
+    json_value_invalidate(json_object_get_wrapping_value(object));
     return JSONSuccess;
 }
 
@@ -1873,6 +8026,55 @@ JSON_Status json_object_dotremove(JSON_Object *object, const char *name) {
     return json_object_dotremove_internal(object, name, 1);
 }
 
+JSON_Value * json_object_detach(JSON_Object *object, const char *name) {
+    JSON_Value *value = json_object_get_value(object, name);
+    if (value == NULL || json_object_remove_internal(object, name, 0) == JSONFailure) {
+        return NULL;
+    }
+    value->parent = NULL;
+    return value;
+}
+
+JSON_Status json_object_merge_move(JSON_Object *dest, JSON_Object *src) {
+    JSON_Value *dest_value = NULL, *ancestor = NULL;
+    size_t i = 0, j = 0;
+    if (dest == NULL || src == NULL || dest == src) {
+        return JSONFailure;
+    }
+    dest_value = json_object_get_wrapping_value(dest);
+    for (ancestor = dest_value; ancestor != NULL; ancestor = ancestor->parent) {
+        if (ancestor == json_object_get_wrapping_value(src)) {
+            return JSONFailure; /* src can't be moved into its own member */
+        }
+    }
+    if (src->count == 0) {
+        return JSONSuccess;
+    }
+    if (dest->count + src->count > dest->capacity &&
+        json_object_resize(dest, MAX(dest->count + src->count, STARTING_CAPACITY)) == JSONFailure) {
+        return JSONFailure;
+    }
+    for (i = 0; i < src->count; i++) {
+        j = json_object_find(dest, src->names[i], strlen(src->names[i]), src->hashes[i]);
+        if (j != OBJECT_NOT_FOUND) { /* replace existing value, name is already there */
+            json_value_free(dest->values[j]);
+            dest->values[j] = src->values[i];
+            src->values[i]->parent = dest_value;
+            parson_free(src->names[i]);
+            parson_free(src->keys[i].escaped);
+        } else {
+            json_object_push(dest, src->names[i], src->hashes[i], &src->keys[i], src->values[i]);
+        }
+    }
+    src->count = 0;
+    parson_free(src->cells);
+    src->cells = NULL;
+    src->cell_capacity = 0;
+    json_value_invalidate(dest_value);
+    json_value_invalidate(json_object_get_wrapping_value(src));
+    return JSONSuccess;
+}
+
 JSON_Status json_object_clear(JSON_Object *object) {
     size_t i = 0;
     if (object == NULL) {
@@ -1880,9 +8082,14 @@ JSON_Status json_object_clear(JSON_Object *object) {
     }
     for (i = 0; i < json_object_get_count(object); i++) {
         parson_free(object->names[i]);
+        parson_free(object->keys[i].escaped);
         json_value_free(object->values[i]);
     }
     object->count = 0;
+    parson_free(object->cells);
+    object->cells = NULL;
+    object->cell_capacity = 0;
+    json_value_invalidate(json_object_get_wrapping_value(object));
     return JSONSuccess;
 }
 
@@ -1896,6 +8103,8 @@ JSON_Status json_validate(const JSON_Value *schema, const JSON_Value *value) {
     if (schema == NULL || value == NULL) {
         return JSONFailure;
     }
+    schema = json_value_view(schema);
+    value = json_value_view(value);
     schema_type = json_value_get_type(schema);
     value_type = json_value_get_type(value);
     if (schema_type != value_type && schema_type != JSONNull) { /* null represents all values */
@@ -1946,13 +8155,275 @@ JSON_Status json_validate(const JSON_Value *schema, const JSON_Value *value) {
     }
 }
 
+static JSON_Projection * projection_build(const char **paths, size_t paths_count) {
+    JSON_Projection *projection = NULL, *node = NULL;
+    const JSON_Projection *child = NULL;
+    const char *name = NULL, *dot = NULL;
+    size_t nodes_count = 1, nodes_used = 1, name_len = 0, i = 0;
+    for (i = 0; i < paths_count; i++) {
+        if (paths[i] == NULL) {
+            return NULL;
+        }
+        for (name = paths[i]; name != NULL; name = strchr(name, '.')) {
+            nodes_count++;
+            name += *name == '.';
+        }
+    }
+    projection = (JSON_Projection*)parson_malloc(nodes_count * sizeof(JSON_Projection));
+    if (projection == NULL) {
+        return NULL;
+    }
+    memset(projection, 0, sizeof(JSON_Projection));
+    for (i = 0; i < paths_count; i++) {
+        node = projection;
+        name = paths[i];
+        while (!node->whole) {
+            dot = strchr(name, '.');
+            name_len = dot != NULL ? (size_t)(dot - name) : strlen(name);
+            child = projection_get_member(projection, node, name, name_len);
+            if (child == NULL) { /* prepend new child */
+                child = &projection[nodes_used];
+                projection[nodes_used].name = name;
+                projection[nodes_used].name_len = name_len;
+                projection[nodes_used].hash = hash_string(name, name_len);
+                projection[nodes_used].whole = 0;
+                projection[nodes_used].first_child = 0;
+                projection[nodes_used].next_sibling = node->first_child;
+                node->first_child = nodes_used++;
+            }
+            node = &projection[child - projection];
+            if (dot == NULL) {
+                node->whole = 1; /* requested paths below are already included */
+                break;
+            }
+            name = dot + 1;
+        }
+    }
+    return projection;
+}
+
+static const JSON_Projection * projection_get_member(const JSON_Projection *projection, const JSON_Projection *node, const char *name, size_t name_len) {
+    const JSON_Projection *child = NULL;
+    unsigned long hash = 0;
+    size_t i = 0;
+    if (node->first_child == 0) {
+        return NULL;
+    }
+    hash = hash_string(name, name_len);
+    for (i = node->first_child; i != 0; i = child->next_sibling) {
+        child = &projection[i];
+        if (child->hash == hash && child->name_len == name_len && strncmp(child->name, name, name_len) == 0) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+static void json_schema_measure(const JSON_Value *schema, size_t *nodes_count, size_t *names_size) {
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    size_t i = 0;
+    schema = json_value_view(schema);
+    *nodes_count += 1;
+    switch (json_value_get_type(schema)) {
+        case JSONObject:
+            object = schema->value.object;
+            for (i = 0; i < object->count; i++) {
+                *names_size += strlen(object->names[i]) + 1;
+                json_schema_measure(object->values[i], nodes_count, names_size);
+            }
+            break;
+        case JSONArray:
+            array = schema->value.array;
+            if (array->count > 0) {
+                json_schema_measure(array->items[0], nodes_count, names_size);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Writes nodes of schema subtree starting at node, returns node following the subtree */
+static JSON_Schema_Node * json_schema_fill(const JSON_Value *schema, JSON_Schema_Node *node, char **names_ptr) {
+    JSON_Schema_Node *next = node + 1;
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    size_t i = 0, name_len = 0;
+    schema = json_value_view(schema);
+    node->type = json_value_get_type(schema);
+    node->count = 0;
+    switch (node->type) {
+        case JSONObject:
+            object = schema->value.object;
+            node->count = object->count;
+            for (i = 0; i < object->count; i++) {
+                name_len = strlen(object->names[i]);
+                memcpy(*names_ptr, object->names[i], name_len + 1);
+                next->name = *names_ptr;
+                next->name_len = name_len;
+                next->name_hash = object->hashes[i];
+                *names_ptr += name_len + 1;
+                next = json_schema_fill(object->values[i], next, names_ptr);
+            }
+            break;
+        case JSONArray:
+            array = schema->value.array;
+            if (array->count > 0) { /* only first value is used */
+                node->count = 1;
+                next->name = NULL;
+                next->name_len = 0;
+                next->name_hash = 0;
+                next = json_schema_fill(array->items[0], next, names_ptr);
+            }
+            break;
+        default:
+            break;
+    }
+    node->size = (size_t)(next - node);
+    return next;
+}
+
+static JSON_Status json_schema_run_r(const JSON_Schema_Node *node, const JSON_Value *value) {
+    const JSON_Schema_Node *member = NULL;
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    size_t i = 0, index = 0;
+    value = json_value_view(value);
+    if (value == NULL) {
+        return JSONFailure;
+    }
+    if (node->type == JSONNull) { /* null represents all values */
+        return JSONSuccess;
+    }
+    if (node->type != value->type) {
+        return JSONFailure;
+    }
+    switch (node->type) {
+        case JSONArray:
+            if (node->count == 0) {
+                return JSONSuccess; /* Empty array allows all types */
+            }
+            array = value->value.array;
+            for (i = 0; i < array->count; i++) {
+                if (json_schema_run_r(node + 1, array->items[i]) == JSONFailure) {
+                    return JSONFailure;
+                }
+            }
+            return JSONSuccess;
+        case JSONObject:
+            object = value->value.object;
+            if (object->count < node->count) {
+                return JSONFailure; /* Tested object mustn't have less name-value pairs than schema */
+            }
+            member = node + 1;
+            for (i = 0; i < node->count; i++) {
+                index = json_object_find(object, member->name, member->name_len, member->name_hash);
+                if (index == OBJECT_NOT_FOUND || json_schema_run_r(member, object->values[index]) == JSONFailure) {
+                    return JSONFailure;
+                }
+                member += member->size;
+            }
+            return JSONSuccess;
+        default:
+            return JSONSuccess; /* equality already tested */
+    }
+}
+
+JSON_Schema * json_schema_compile(const JSON_Value *schema) {
+    JSON_Schema *compiled = NULL;
+    size_t nodes_count = 0, names_size = 0;
+    char *names_ptr = NULL;
+    if (schema == NULL) {
+        return NULL;
+    }
+    json_schema_measure(schema, &nodes_count, &names_size);
+    compiled = (JSON_Schema*)parson_malloc(sizeof(JSON_Schema));
+    if (compiled == NULL) {
+        return NULL;
+    }
+    compiled->nodes = (JSON_Schema_Node*)parson_malloc(nodes_count * sizeof(JSON_Schema_Node));
+    compiled->names = (char*)parson_malloc(names_size + 1);
+    if (compiled->nodes == NULL || compiled->names == NULL) {
+        json_schema_free(compiled);
+        return NULL;
+    }
+    names_ptr = compiled->names;
+    compiled->nodes[0].name = NULL;
+    compiled->nodes[0].name_len = 0;
+    compiled->nodes[0].name_hash = 0;
+    json_schema_fill(schema, compiled->nodes, &names_ptr);
+    return compiled;
+}
+
+JSON_Status json_schema_run(const JSON_Schema *schema, const JSON_Value *value) {
+    if (schema == NULL || value == NULL) {
+        return JSONFailure;
+    }
+    return json_schema_run_r(schema->nodes, value);
+}
+
+void json_schema_free(JSON_Schema *schema) {
+    if (schema == NULL) {
+        return;
+    }
+    parson_free(schema->nodes);
+    parson_free(schema->names);
+    parson_free(schema);
+}
+
+unsigned long json_value_hash(const JSON_Value *value) {
+    JSON_Object *object = NULL;
+    JSON_Array *array = NULL;
+    const char *string = NULL;
+    unsigned long hash = 0, member_hash = 0;
+    size_t i = 0;
+    value = json_value_view(value);
+    hash = (unsigned long)json_value_get_type(value);
+    switch (json_value_get_type(value)) {
+        case JSONObject:
+            object = value->value.object;
+            if (object->hash_valid) {
+                return object->hash;
+            }
+            for (i = 0; i < object->count; i++) { /* sum doesn't depend on order of names */
+                member_hash = json_value_hash(object->values[i]);
+                hash += object->hashes[i] ^ (member_hash + 0x9e3779b9UL + (object->hashes[i] << 6) + (object->hashes[i] >> 2));
+            }
+            object->hash = hash;
+            object->hash_valid = 1;
+            return hash;
+        case JSONArray:
+            array = value->value.array;
+            if (array->hash_valid) {
+                return array->hash;
+            }
+            for (i = 0; i < array->count; i++) {
+                hash = hash * 31 + json_value_hash(array->items[i]);
+            }
+            array->hash = hash;
+            array->hash_valid = 1;
+            return hash;
+        case JSONString:
+            string = value->value.string;
+            return hash ^ hash_string(string, strlen(string));
+        case JSONBoolean:
+            return hash * 31 + (unsigned long)value->value.boolean;
+        case JSONNumber: /* numbers are compared with epsilon, so they can't be hashed */
+        default:
+            return hash;
+    }
+}
+
 int json_value_equals(const JSON_Value *a, const JSON_Value *b) {
     JSON_Object *a_object = NULL, *b_object = NULL;
     JSON_Array *a_array = NULL, *b_array = NULL;
     const char *a_string = NULL, *b_string = NULL;
     const char *key = NULL;
-    size_t a_count = 0, b_count = 0, i = 0;
+    size_t a_count = 0, b_count = 0, i = 0, j = 0;
     JSON_Value_Type a_type, b_type;
+    a = json_value_view(a);
+    b = json_value_view(b);
     a_type = json_value_get_type(a);
     b_type = json_value_get_type(b);
     if (a_type != b_type) {
@@ -1964,7 +8435,7 @@ int json_value_equals(const JSON_Value *a, const JSON_Value *b) {
             b_array = json_value_get_array(b);
             a_count = json_array_get_count(a_array);
             b_count = json_array_get_count(b_array);
-            if (a_count != b_count) {
+            if (a_count != b_count || json_value_hash(a) != json_value_hash(b)) {
                 return 0;
             }
             for (i = 0; i < a_count; i++) {
@@ -1979,13 +8450,13 @@ int json_value_equals(const JSON_Value *a, const JSON_Value *b) {
             b_object = json_value_get_object(b);
             a_count = json_object_get_count(a_object);
             b_count = json_object_get_count(b_object);
-            if (a_count != b_count) {
+            if (a_count != b_count || json_value_hash(a) != json_value_hash(b)) {
                 return 0;
             }
             for (i = 0; i < a_count; i++) {
-                key = json_object_get_name(a_object, i);
-                if (!json_value_equals(json_object_get_value(a_object, key),
-                                       json_object_get_value(b_object, key))) {
+                key = a_object->names[i];
+                j = json_object_find(b_object, key, strlen(key), a_object->hashes[i]);
+                if (j == OBJECT_NOT_FOUND || !json_value_equals(a_object->values[i], b_object->values[j])) {
                     return 0;
                 }
             }
@@ -2038,3 +8509,15 @@ void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Fu
     parson_malloc = malloc_fun;
     parson_free = free_fun;
 }
+
+void json_set_lazy_parsing(int enabled) {
+    parson_lazy_parsing = enabled;
+}
+
+void json_set_lazy_numbers(int enabled) {
+    parson_lazy_numbers = enabled;
+}
+
+void json_set_serialization_cache(int enabled) {
+    parson_serialization_cache = enabled;
+}
@@ -35,6 +35,30 @@ extern "C"
 typedef struct json_object_t JSON_Object;
 typedef struct json_array_t  JSON_Array;
 typedef struct json_value_t  JSON_Value;
+typedef struct json_schema_t JSON_Schema;
+typedef struct json_path_t   JSON_Path;
+typedef struct json_query_t  JSON_Query;
+typedef struct json_snapshot_t JSON_Snapshot;
+typedef struct json_snapshot_value_t JSON_Snapshot_Value; /* points into snapshot's data */
+typedef struct json_tape_t   JSON_Tape;
+typedef struct json_lines_t  JSON_Lines;
+typedef struct json_lines_writer_t JSON_Lines_Writer;
+typedef struct json_loader_t JSON_Loader;
+typedef struct json_load_t   JSON_Load;
+
+/* Position in a JSON_Tape, see json_tape_root. Cursors are passed by value and don't need to be freed. */
+typedef struct json_cursor_t {
+    const JSON_Tape *tape;  /* NULL for cursors that don't point to a value */
+    size_t           index;
+    size_t           name;  /* name of object's member */
+    size_t           end;   /* end of parent container */
+} JSON_Cursor;
+
+/* Piece of serialized output, see json_serialize_to_segments */
+typedef struct json_segment_t {
+    const char *data;
+    size_t      length;
+} JSON_Segment;
 
 enum json_value_type {
     JSONError   = -1,
@@ -47,6 +71,20 @@ enum json_value_type {
 };
 typedef int JSON_Value_Type;
 
+enum json_input_type {
+    JSONInputString = 1,
+    JSONInputFile   = 2,
+    JSONInputFd     = 3
+};
+typedef int JSON_Input_Type;
+
+/* Input of json_parse_batch: string, name of file or file descriptor */
+typedef struct json_input_t {
+    JSON_Input_Type type;
+    const char     *data; /* string or file name */
+    int             fd;
+} JSON_Input;
+
 enum json_result_t {
     JSONSuccess = 0,
     JSONFailure = -1
@@ -56,10 +94,42 @@ typedef int JSON_Status;
 typedef void * (*JSON_Malloc_Function)(size_t);
 typedef void   (*JSON_Free_Function)(void *);
 
+/* Stream callbacks. Write function returns JSONFailure if it couldn't write all size bytes,
+   read function returns number of bytes read (at most size), 0 on end of input or error. */
+typedef JSON_Status (*JSON_Write_Function)(const void *data, size_t size, void *arg);
+typedef size_t      (*JSON_Read_Function)(void *buf, size_t size, void *arg);
+typedef JSON_Status (*JSON_Lines_Callback)(JSON_Value *value, size_t line, void *arg);
+typedef void        (*JSON_Load_Callback)(const char *filename, JSON_Value *value, void *arg);
+
 /* Call only once, before calling any other function from parson API. If not called, malloc and free
-   from stdlib will be used for all allocations */
+   from stdlib will be used for all allocations.
+   Functions taking threads_count (json_*_parallel, json_parse_batch and loaders) allocate from
+   several threads, so allocation functions have to be thread-safe. threads_count 0 uses one thread
+   per processor. Threads are used only in builds with PARSON_THREADS defined as 1, otherwise these
+   functions do all work on the calling thread. */
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun);
 
+/* Lazy parsing (disabled by default). When enabled, json_parse_* functions (except ones with schema
+   or projection) only validate syntax and keep a copy of the input. Each object or array is built
+   the first time it's reached (by json_value_get_object, json_object_get_value, serialization etc.),
+   so parts of a document that are never read cost only validation. Duplicate names in an object
+   fail parsing, like without lazy parsing. Reading (json_value_get_object, json_value_get_array,
+   serialization etc.) builds containers in place, so a lazily parsed document can't be read from
+   several threads at the same time. */
+void json_set_lazy_parsing(int enabled);
+
+/* Lazy numbers (disabled by default). When enabled, parsed numbers shorter than 16 characters keep
+   their text, which is converted by json_value_get_number and written verbatim by serialization
+   functions, so numbers are passed through without changing their formatting (1.0 stays 1.0). */
+void json_set_lazy_numbers(int enabled);
+
+/* Serialization cache (disabled by default). When enabled, compact serialization functions keep
+   a copy of each object's and array's output, and later calls copy it instead of walking the
+   container again. Modifying a value drops cached copies of it and all containers above it, so
+   re-serializing a large document after a small edit only re-encodes the changed path. Pretty
+   serialization doesn't use the cache. */
+void json_set_serialization_cache(int enabled);
+
 /* Parses first JSON value in a file, returns NULL in case of error */
 JSON_Value * json_parse_file(const char *filename);
 
@@ -74,6 +144,31 @@ JSON_Value * json_parse_string(const char *string);
     returns NULL in case of error */
 JSON_Value * json_parse_string_with_comments(const char *string);
 
+/* Parse like json_parse_file and json_parse_string, but items of a top-level array are split into
+   chunks (skipping strings and nested values) parsed by threads_count threads, result has items in
+   original order. Other values and lazy parsing are parsed on calling thread. */
+JSON_Value * json_parse_file_parallel(const char *filename, size_t threads_count);
+JSON_Value * json_parse_string_parallel(const char *string, size_t threads_count);
+
+/* Parses count independent inputs with threads_count threads (calling thread is one of them) and
+   stores results in the same order, NULL for inputs that failed. Threads that finish early take
+   over half of another thread's remaining inputs, next file is read ahead while parsing the current
+   one. Fds are read from their current position and aren't closed (they are supported only on
+   POSIX systems). Returns JSONFailure if any input failed. */
+JSON_Status  json_parse_batch(const JSON_Input *inputs, size_t count, JSON_Value **results, size_t threads_count);
+
+/* Loaders read (with pread) and parse files on threads_count background threads, so callers (like
+   event loops) don't block on reading. json_loader_submit calls callback on a loader thread with
+   the parsed value (callback takes ownership, value is NULL on fail). json_loader_load returns a
+   handle instead: json_load_is_ready doesn't block, json_load_get waits for the value and frees the
+   handle. json_loader_free finishes submitted requests and frees handles that weren't collected. */
+JSON_Loader * json_loader_create(size_t threads_count);
+JSON_Status   json_loader_submit(JSON_Loader *loader, const char *filename, JSON_Load_Callback callback, void *arg);
+JSON_Load *   json_loader_load(JSON_Loader *loader, const char *filename);
+int           json_load_is_ready(JSON_Load *load);
+JSON_Value *  json_load_get(JSON_Load *load); /* returns NULL on fail */
+void          json_loader_free(JSON_Loader *loader);
+
 /* Serialization */
 size_t      json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
@@ -88,9 +183,138 @@ char *      json_serialize_to_string_pretty(const JSON_Value *value);
 
 void        json_free_serialized_string(char *string); /* frees string from json_serialize_to_string and json_serialize_to_string_pretty */
 
-/* Comparing */
+/* Serialize like json_serialize_to_string and json_serialize_to_string_pretty (output is the same),
+   but items of a top-level array or object are split into chunks that threads_count threads size
+   and then write at their offsets in the result. Chunks with lazy values are sized on calling
+   thread. Other values and compact serialization with serialization cache enabled are serialized
+   on calling thread. Free result with json_free_serialized_string. */
+char *      json_serialize_to_string_parallel(const JSON_Value *value, size_t threads_count);
+char *      json_serialize_to_string_pretty_parallel(const JSON_Value *value, size_t threads_count);
+
+/* Scatter-gather serialization. Returns compact serialization as a list of segments (to be written
+   in order, e.g. with writev), sets segments_count and returns NULL on fail. Long strings that don't
+   need escaping are referenced in place instead of being copied, so segments are valid only until
+   value is modified or freed. Punctuation, numbers, keys, escaped text and raw fragments are written
+   to a buffer allocated with the list, output isn't null-terminated. */
+JSON_Segment * json_serialize_to_segments(const JSON_Value *value, size_t *segments_count);
+void           json_free_segments(JSON_Segment *segments);
+
+/* MessagePack. Integral numbers that are exact in a double are encoded as integers (shortest form),
+   other numbers as float 64. Integers are decoded to doubles, integral floats keep their float
+   type (serialized as 1.0), so values round-trip with the same MessagePack types. Binary and
+   extension types, maps with non-string keys and strings containing null bytes are rejected.
+   json_value_from_msgpack fails if data has bytes after the value, stream reader reads exactly one
+   value so it can be called repeatedly for a sequence of values. */
+unsigned char * json_value_to_msgpack(const JSON_Value *value, size_t *size); /* returns NULL on fail */
+JSON_Status     json_value_to_msgpack_stream(const JSON_Value *value, JSON_Write_Function write_fun, void *arg);
+JSON_Value *    json_value_from_msgpack(const unsigned char *data, size_t size);
+JSON_Value *    json_value_from_msgpack_stream(JSON_Read_Function read_fun, void *arg);
+void            json_free_msgpack(unsigned char *data);
+
+/* CBOR (RFC 8949). Numbers are encoded like in MessagePack (integers in shortest form, other numbers
+   as double precision floats). Canonical encoding follows core deterministic encoding: object names
+   are sorted (shorter first, then bytewise), floats use the shortest exact form (half, single or
+   double precision) and lazy number text is ignored, so equal values always give equal bytes.
+   Decoding accepts indefinite length strings, arrays and maps and ignores tags, byte strings,
+   undefined and other simple values are rejected, as are data with bytes after the value. */
+unsigned char * json_value_to_cbor(const JSON_Value *value, size_t *size); /* returns NULL on fail */
+unsigned char * json_value_to_cbor_canonical(const JSON_Value *value, size_t *size);
+JSON_Value *    json_value_from_cbor(const unsigned char *data, size_t size);
+void            json_free_cbor(unsigned char *data);
+
+/* Snapshots. json_snapshot_write saves value as a binary image (with sorted name tables and packed
+   numbers) that can be queried without parsing. Image is written to filename.tmp and renamed over
+   filename, so snapshots that are already open keep their image. json_snapshot_open maps the file
+   read-only (reads it into memory if mmap isn't available), so processes opening the same snapshot
+   share its pages. Image is checked once when opened, json_snapshot_open_buffer uses data without copying it (data
+   has to outlive the snapshot). Snapshot values are valid until json_snapshot_close, snapshot's
+   objects are iterated in original order. Images are limited to 4 GB. */
+JSON_Status     json_snapshot_write(const JSON_Value *value, const char *filename);
+JSON_Snapshot * json_snapshot_open(const char *filename);
+JSON_Snapshot * json_snapshot_open_buffer(const void *data, size_t size);
+void            json_snapshot_close(JSON_Snapshot *snapshot);
+
+const JSON_Snapshot_Value * json_snapshot_root(const JSON_Snapshot *snapshot);
+JSON_Value_Type json_snapshot_get_type(const JSON_Snapshot_Value *value);
+const char *    json_snapshot_get_string(const JSON_Snapshot_Value *value);
+size_t          json_snapshot_get_string_len(const JSON_Snapshot_Value *value);
+double          json_snapshot_get_number(const JSON_Snapshot_Value *value);
+int             json_snapshot_get_boolean(const JSON_Snapshot_Value *value); /* returns -1 on fail */
+size_t          json_snapshot_get_count(const JSON_Snapshot_Value *value); /* of object or array */
+const JSON_Snapshot_Value * json_snapshot_get_value(const JSON_Snapshot_Value *object, const char *name);
+const JSON_Snapshot_Value * json_snapshot_dotget_value(const JSON_Snapshot_Value *object, const char *name);
+const JSON_Snapshot_Value * json_snapshot_get_value_at(const JSON_Snapshot_Value *value, size_t index); /* array item or object value */
+const char *    json_snapshot_get_name_at(const JSON_Snapshot_Value *object, size_t index);
+
+/* Tapes are read-only documents stored as a flat array of tagged words plus one buffer for strings
+   and one for numbers, parsing allocates only when these grow. Containers store the position after
+   their end, so json_cursor_next skips a sibling in constant time, while getting a value by name or
+   index walks the container. Tapes accept the same input as json_parse_string, names aren't checked
+   for duplicates (lookups find the first one). Cursors are valid until json_tape_free. */
+JSON_Tape *     json_tape_parse_file(const char *filename);
+JSON_Tape *     json_tape_parse_string(const char *string);
+void            json_tape_free(JSON_Tape *tape);
+JSON_Cursor     json_tape_root(const JSON_Tape *tape);
+
+JSON_Value_Type json_cursor_get_type(JSON_Cursor cursor); /* JSONError for cursors without a value */
+const char *    json_cursor_get_string(JSON_Cursor cursor);
+size_t          json_cursor_get_string_len(JSON_Cursor cursor);
+double          json_cursor_get_number(JSON_Cursor cursor);
+int             json_cursor_get_boolean(JSON_Cursor cursor); /* returns -1 on fail */
+size_t          json_cursor_get_count(JSON_Cursor cursor); /* of object or array */
+const char *    json_cursor_get_name(JSON_Cursor cursor); /* name of object's member, NULL otherwise */
+JSON_Cursor     json_cursor_first(JSON_Cursor container); /* first item or member's value */
+JSON_Cursor     json_cursor_next(JSON_Cursor cursor); /* next sibling */
+JSON_Cursor     json_cursor_get_value(JSON_Cursor object, const char *name);
+JSON_Cursor     json_cursor_dotget_value(JSON_Cursor object, const char *name);
+JSON_Cursor     json_cursor_get_value_at(JSON_Cursor container, size_t index);
+JSON_Value *    json_cursor_to_value(JSON_Cursor cursor); /* mutable copy, NULL on fail (also for duplicate names) */
+
+/* JSON Lines (newline-delimited JSON). Lines readers parse one document per line in place (strings
+   aren't copied, files and fds are read in large chunks) reusing one parser, blank lines are
+   ignored. json_lines_next returns NULL at the end of input and on a bad line, which is then
+   reported by json_lines_get_error_line (reading can continue with the following line). With
+   json_lines_set_skip_errors bad lines are skipped and only counted. Lines readers don't close fds they were
+   opened with. Lines writers append compact serializations followed by newlines (line breaks in
+   raw fragments are dropped) and batch them into large writes, json_lines_writer_open_file appends
+   to existing file. Write failures are kept, so checking json_lines_writer_close is enough. Fds are
+   available only on POSIX systems. */
+JSON_Lines *    json_lines_open_string(const char *string); /* string has to outlive the reader */
+JSON_Lines *    json_lines_open_file(const char *filename);
+JSON_Lines *    json_lines_open_fd(int fd);
+JSON_Lines *    json_lines_open_stream(JSON_Read_Function read_fun, void *arg);
+void            json_lines_set_skip_errors(JSON_Lines *lines, int skip_errors);
+JSON_Value *    json_lines_next(JSON_Lines *lines);
+size_t          json_lines_get_line(const JSON_Lines *lines); /* number of last read line (from 1) */
+size_t          json_lines_get_error_line(const JSON_Lines *lines); /* bad line that stopped last json_lines_next, 0 at end */
+size_t          json_lines_get_error_count(const JSON_Lines *lines);
+void            json_lines_close(JSON_Lines *lines);
+
+JSON_Lines_Writer * json_lines_writer_open_file(const char *filename);
+JSON_Lines_Writer * json_lines_writer_open_fd(int fd);
+JSON_Lines_Writer * json_lines_writer_open_stream(JSON_Write_Function write_fun, void *arg);
+JSON_Status     json_lines_write(JSON_Lines_Writer *writer, const JSON_Value *value);
+JSON_Status     json_lines_writer_flush(JSON_Lines_Writer *writer);
+JSON_Status     json_lines_writer_close(JSON_Lines_Writer *writer); /* flushes and frees writer */
+
+/* Parses JSON Lines split at newlines into chunks by threads_count worker threads. Callback is
+   called on the calling thread with every value (it takes ownership) and line number, or with NULL
+   for bad lines. Values are passed in input order if ordered is set, otherwise as soon as their
+   chunk is parsed. Only a few chunks per worker are parsed ahead of the callback, so memory use
+   stays bounded. Parsing stops when callback returns JSONFailure. */
+JSON_Status     json_lines_parse_parallel(const char *string, size_t threads_count, int ordered,
+                                          JSON_Lines_Callback callback, void *arg);
+
+/* Comparing. Uses json_value_hash, so it stores hashes in compared objects and arrays and
+   the same values can't be compared from several threads at the same time. */
 int  json_value_equals(const JSON_Value *a, const JSON_Value *b);
 
+/* Structural hash, equal values (as in json_value_equals) have equal hashes and order of names
+ * in objects doesn't matter. Numbers contribute only their type, because they're compared with
+ * epsilon. Hashes of objects and arrays are cached in them (so computing a hash writes to the
+ * value) and recomputed after they're modified. */
+unsigned long json_value_hash(const JSON_Value *value);
+
 /* Validation
    This is *NOT* JSON Schema. It validates json by checking if object have identically
    named fields with matching types.
@@ -103,6 +327,25 @@ int  json_value_equals(const JSON_Value *a, const JSON_Value *b);
  */
 JSON_Status json_validate(const JSON_Value *schema, const JSON_Value *value);
 
+/* Compiled validation. json_schema_compile flattens schema (with the same rules as json_validate)
+   and precomputes hashes of its names, so json_schema_run doesn't traverse schema or allocate.
+   Compiled schema doesn't reference passed value and has to be freed with json_schema_free. */
+JSON_Schema * json_schema_compile(const JSON_Value *schema);
+JSON_Status   json_schema_run(const JSON_Schema *schema, const JSON_Value *value);
+void          json_schema_free(JSON_Schema *schema);
+
+/* Parses first JSON value in a file or string and validates it against compiled schema at the same time.
+   Returns NULL if value is invalid or doesn't match schema, parsing stops at the first mismatch. */
+JSON_Value * json_parse_file_with_schema(const char *filename, const JSON_Schema *schema);
+JSON_Value * json_parse_string_with_schema(const char *string, const JSON_Schema *schema);
+
+/* Parses only members on given dot notation paths (e.g. {"user.name", "items"}) and returns object
+   containing just them, everything else is skipped without being decoded or allocated. Skipped parts
+   are only checked for matching brackets and quotes. Values on paths that aren't objects where path
+   continues through them are left out. Returns NULL if root isn't an object. */
+JSON_Value * json_parse_file_projected(const char *filename, const char **paths, size_t paths_count);
+JSON_Value * json_parse_string_projected(const char *string, const char **paths, size_t paths_count);
+
 /*
  * JSON Object
  */
@@ -138,6 +381,45 @@ int json_object_has_value_of_type(const JSON_Object *object, const char *name, J
 int json_object_dothas_value        (const JSON_Object *object, const char *name);
 int json_object_dothas_value_of_type(const JSON_Object *object, const char *name, JSON_Value_Type type);
 
+/* Compiled dot notation paths. json_path_compile splits path at dots once and hashes its names,
+ * so json_path_get and json_path_set functions, which otherwise behave like dotget and dotset
+ * functions, don't parse strings or allocate (except for values created by set functions).
+ * Compiled path has to be freed with json_path_free. */
+JSON_Path   * json_path_compile(const char *path);
+void          json_path_free   (JSON_Path *path);
+
+JSON_Value  * json_path_get_value  (const JSON_Object *object, const JSON_Path *path);
+const char  * json_path_get_string (const JSON_Object *object, const JSON_Path *path);
+JSON_Object * json_path_get_object (const JSON_Object *object, const JSON_Path *path);
+JSON_Array  * json_path_get_array  (const JSON_Object *object, const JSON_Path *path);
+double        json_path_get_number (const JSON_Object *object, const JSON_Path *path); /* returns 0 on fail */
+int           json_path_get_boolean(const JSON_Object *object, const JSON_Path *path); /* returns -1 on fail */
+
+JSON_Status json_path_set_value  (JSON_Object *object, const JSON_Path *path, JSON_Value *value);
+JSON_Status json_path_set_string (JSON_Object *object, const JSON_Path *path, const char *string);
+JSON_Status json_path_set_number (JSON_Object *object, const JSON_Path *path, double number);
+JSON_Status json_path_set_boolean(JSON_Object *object, const JSON_Path *path, int boolean);
+JSON_Status json_path_set_null   (JSON_Object *object, const JSON_Path *path);
+
+/* Queries. json_query_compile_pointer compiles RFC 6901 JSON Pointer (e.g. "/users/0/name", "" is
+ * the whole document), json_query_compile compiles JSONPath subset: $ root, .name or ['name'] member,
+ * [index] (negative counts from the end), [start:end:step] slice, .* or [*] wildcard, .. recursive
+ * descent and [?(@.member op literal)] filter, where op is one of == != < <= > >= (or none to test
+ * existence) and literal is a number, 'string', true, false or null.
+ * Compiled queries don't reference documents, so they can be reused. Matches are values inside
+ * queried document (nothing is copied), so they mustn't outlive it and callback mustn't modify
+ * containers being queried. Running query returns number of matches, callback can return
+ * JSONFailure to stop early. json_query_select_values stores at most max_matches matches. */
+typedef JSON_Status (*JSON_Query_Callback)(JSON_Value *match, void *arg);
+
+JSON_Query * json_query_compile_pointer(const char *pointer);
+JSON_Query * json_query_compile(const char *path);
+void         json_query_free(JSON_Query *query);
+
+size_t       json_query_run(const JSON_Query *query, const JSON_Value *root, JSON_Query_Callback callback, void *arg);
+size_t       json_query_select_values(const JSON_Query *query, const JSON_Value *root, JSON_Value **matches, size_t max_matches);
+JSON_Value * json_query_get_value(const JSON_Query *query, const JSON_Value *root); /* first match or NULL */
+
 /* Creates new name-value pair or frees and replaces old value with a new one.
  * json_object_set_value does not copy passed value so it shouldn't be freed afterwards. */
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value);
@@ -163,6 +445,15 @@ JSON_Status json_object_dotremove(JSON_Object *object, const char *key);
 /* Removes all name-value pairs in object */
 JSON_Status json_object_clear(JSON_Object *object);
 
+/* Removes name-value pair without freeing the value, which is returned with its parent cleared.
+ * Returned value can be added to another object or array and has to be freed otherwise.
+ * Returns NULL if there is no value with given name. */
+JSON_Value * json_object_detach(JSON_Object *object, const char *name);
+
+/* Moves all name-value pairs from src to dest without copying them, src is left empty.
+ * Values in dest with the same names are freed and replaced. */
+JSON_Status json_object_merge_move(JSON_Object *dest, JSON_Object *src);
+
 /*
  *JSON Array
  */
@@ -179,6 +470,10 @@ JSON_Value  * json_array_get_wrapping_value(const JSON_Array *array);
  * Order of values in array may change during execution.  */
 JSON_Status json_array_remove(JSON_Array *array, size_t i);
 
+/* Works like json_array_remove, but returns removed value (with parent cleared) instead of freeing it.
+ * Returns NULL if index doesn't exist. */
+JSON_Value * json_array_detach(JSON_Array *array, size_t i);
+
 /* Frees and removes from array value at given index and replaces it with given one.
  * Does nothing and returns JSONFailure if index doesn't exist.
  * json_array_replace_value does not copy passed value so it shouldn't be freed afterwards. */
@@ -208,9 +503,22 @@ JSON_Value * json_value_init_string (const char *string); /* copies passed strin
 JSON_Value * json_value_init_number (double number);
 JSON_Value * json_value_init_boolean(int boolean);
 JSON_Value * json_value_init_null   (void);
+
+/* Creates value from json text, which has to contain exactly one value. Text is copied and its syntax is
+   checked once. Objects and arrays aren't parsed until they're accessed, until then serialization
+   functions copy their text verbatim (so it's not reformatted by pretty serialization). */
+JSON_Value * json_value_init_raw    (const char *json, size_t len);
+
 JSON_Value * json_value_deep_copy   (const JSON_Value *value);
 void         json_value_free        (JSON_Value *value);
 
+/* Copy-on-write sharing. Moves contents of value into a reference counted, read-only tree.
+ * Afterwards json_value_deep_copy of value (or of its subvalues, which aren't modified yet)
+ * only increments a reference count. Copies are detached one level at a time, when their
+ * JSON_Object or JSON_Array is first accessed, so modifications never affect other copies.
+ * Reference counting isn't thread safe. */
+JSON_Status  json_value_share       (JSON_Value *value);
+
 JSON_Value_Type json_value_get_type   (const JSON_Value *value);
 JSON_Object *   json_value_get_object (const JSON_Value *value);
 JSON_Array  *   json_value_get_array  (const JSON_Value *value);
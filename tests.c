@@ -49,12 +49,33 @@ void test_suite_7(void); /* Test schema validation */
 void test_suite_8(void); /* Test serialization */
 void test_suite_9(void); /* Test serialization (pretty) */
 void test_suite_10(void); /* Testing for memory leaks */
+void test_suite_11(void); /* Test copy-on-write sharing */
+void test_suite_12(void); /* Test moving values between documents */
+void test_suite_13(void); /* Test compiled paths */
+void test_suite_14(void); /* Test queries */
+void test_suite_15(void); /* Test projected parsing */
+void test_suite_16(void); /* Test lazy parsing */
+void test_suite_17(void); /* Test lazy numbers */
+void test_suite_18(void); /* Test raw fragments */
+void test_suite_19(void); /* Test serialization cache */
+void test_suite_20(void); /* Test scatter-gather serialization */
+void test_suite_21(void); /* Test MessagePack */
+void test_suite_22(void); /* Test CBOR */
+void test_suite_23(void); /* Test snapshots */
+void test_suite_24(void); /* Test tapes */
+void test_suite_25(void); /* Test JSON Lines */
+void test_suite_26(void); /* Test parallel JSON Lines parsing */
+void test_suite_27(void); /* Test parallel array parsing */
+void test_suite_28(void); /* Test batch parsing */
+void test_suite_29(void); /* Test asynchronous loading */
+void test_suite_30(void); /* Test parallel serialization */
 
 void print_commits_info(const char *username, const char *repo);
 void persistence_example(void);
 void serialization_example(void);
 
 static int malloc_count;
+static size_t malloc_largest;
 static void *counted_malloc(size_t size);
 static void counted_free(void *ptr);
 
@@ -80,6 +101,26 @@ int main() {
     test_suite_8();
     test_suite_9();
     test_suite_10();
+    test_suite_11();
+    test_suite_12();
+    test_suite_13();
+    test_suite_14();
+    test_suite_15();
+    test_suite_16();
+    test_suite_17();
+    test_suite_18();
+    test_suite_19();
+    test_suite_20();
+    test_suite_21();
+    test_suite_22();
+    test_suite_23();
+    test_suite_24();
+    test_suite_25();
+    test_suite_26();
+    test_suite_27();
+    test_suite_28();
+    test_suite_29();
+    test_suite_30();
     printf("Tests failed: %d\n", tests_failed);
     printf("Tests passed: %d\n", tests_passed);
     return 0;
@@ -448,15 +489,57 @@ void test_suite_6(void) {
     const char *filename = "tests/test_2.txt";
     JSON_Value *a = NULL;
     JSON_Value *b = NULL;
+    JSON_Object *big = NULL;
+    char name[32];
+    int i, all_found = 1;
     a = json_parse_file(filename);
     b = json_parse_file(filename);
     TEST(json_value_equals(a, b));
+    TEST(json_value_hash(a) == json_value_hash(b));
     json_object_set_string(json_object(a), "string", "eki");
     TEST(!json_value_equals(a, b));
+    TEST(json_value_hash(a) != json_value_hash(b));
     a = json_value_deep_copy(b);
     TEST(json_value_equals(a, b));
     json_array_append_number(json_object_get_array(json_object(b), "string array"), 1337);
     TEST(!json_value_equals(a, b));
+    json_array_remove(json_object_get_array(json_object(b), "string array"), 2);
+    TEST(json_value_hash(a) == json_value_hash(b));
+    json_object_dotset_boolean(json_object(b), "object.nested true", 0);
+    TEST(json_value_hash(a) != json_value_hash(b));
+
+    /* order of names doesn't matter */
+    a = json_parse_string("{\"a\":1,\"b\":[1,2],\"c\":{\"x\":null,\"y\":\"z\"}}");
+    b = json_parse_string("{\"c\":{\"y\":\"z\",\"x\":null},\"b\":[1,2],\"a\":1}");
+    TEST(json_value_hash(a) == json_value_hash(b));
+    TEST(json_value_equals(a, b));
+    TEST(json_value_hash(json_parse_string("[1,2]")) != json_value_hash(json_parse_string("[\"1\",2]")));
+
+    /* objects big enough to have a hash index */
+    a = json_value_init_object();
+    big = json_object(a);
+    for (i = 0; i < 200; i++) {
+        sprintf(name, "key%d", i);
+        json_object_set_number(big, name, i);
+    }
+    for (i = 0; i < 200; i += 3) {
+        sprintf(name, "key%d", i);
+        json_object_remove(big, name);
+    }
+    for (i = 0; i < 200; i++) {
+        sprintf(name, "key%d", i);
+        if (json_object_has_value(big, name) != (i % 3 != 0) ||
+            (i % 3 != 0 && json_object_get_number(big, name) != i)) {
+            all_found = 0;
+        }
+    }
+    TEST(all_found);
+    TEST(json_object_get_count(big) == 133);
+    b = json_value_deep_copy(a);
+    json_object_set_number(json_object(b), "key1", 1);
+    TEST(json_value_equals(a, b));
+    json_object_set_number(json_object(b), "key1", 2);
+    TEST(!json_value_equals(a, b));
 }
 
 void test_suite_7(void) {
@@ -464,6 +547,9 @@ void test_suite_7(void) {
     JSON_Value *schema = json_value_init_object();
     JSON_Object *schema_obj = json_value_get_object(schema);
     JSON_Array *interests_arr = NULL;
+    JSON_Schema *compiled = NULL;
+    JSON_Value *parsed = NULL;
+    int malloc_count_before = 0;
     json_object_set_string(schema_obj, "first", "");
     json_object_set_string(schema_obj, "last", "");
     json_object_set_number(schema_obj, "age", 0);
@@ -472,8 +558,44 @@ void test_suite_7(void) {
     json_array_append_string(interests_arr, "");
     json_object_set_null(schema_obj, "favorites");
     TEST(json_validate(schema, val_from_file) == JSONSuccess);
+    compiled = json_schema_compile(schema);
+    TEST(json_schema_run(compiled, val_from_file) == JSONSuccess);
     json_object_set_string(schema_obj, "age", "");
     TEST(json_validate(schema, val_from_file) == JSONFailure);
+    TEST(json_schema_run(compiled, val_from_file) == JSONSuccess); /* compiled schema is a snapshot */
+    json_schema_free(compiled);
+    compiled = json_schema_compile(schema);
+    TEST(json_schema_run(compiled, val_from_file) == JSONFailure);
+    json_schema_free(compiled);
+
+    compiled = json_schema_compile(json_parse_string("{\"a\":[{\"b\":0}],\"c\":null,\"d\":{}}"));
+    TEST(json_schema_run(compiled, json_parse_string("{\"a\":[{\"b\":1},{\"b\":2,\"x\":0}],\"c\":[],\"d\":{\"e\":1}}")) == JSONSuccess);
+    TEST(json_schema_run(compiled, json_parse_string("{\"a\":[],\"c\":true,\"d\":{}}")) == JSONSuccess);
+    TEST(json_schema_run(compiled, json_parse_string("{\"a\":[{\"b\":1},{\"x\":0}],\"c\":1,\"d\":{}}")) == JSONFailure);
+    TEST(json_schema_run(compiled, json_parse_string("{\"a\":[],\"d\":{}}")) == JSONFailure);
+    TEST(json_schema_run(compiled, json_parse_string("{\"a\":[],\"c\":1,\"d\":[]}")) == JSONFailure);
+
+    /* validation while parsing */
+    parsed = json_parse_string_with_schema("{\"a\":[{\"b\":1}],\"c\":[],\"d\":{\"e\":1}}", compiled);
+    TEST(parsed != NULL && json_schema_run(compiled, parsed) == JSONSuccess);
+    json_value_free(parsed);
+    malloc_count_before = malloc_count;
+    TEST(json_parse_string_with_schema("{\"a\":[{\"b\":\"1\"}],\"c\":[],\"d\":{}}", compiled) == NULL);
+    TEST(json_parse_string_with_schema("{\"a\":[],\"c\":[]}", compiled) == NULL);
+    TEST(json_parse_string_with_schema("{}", compiled) == NULL);
+    TEST(json_parse_string_with_schema("[]", compiled) == NULL);
+    TEST(json_parse_string_with_schema("{\"a\":[],\"c\":[],\"d\":{},}", compiled) == NULL);
+    TEST(malloc_count == malloc_count_before);
+    json_schema_free(compiled);
+    compiled = json_schema_compile(schema);
+    TEST(json_parse_file_with_schema("tests/test_5.txt", compiled) == NULL);
+    json_object_set_number(schema_obj, "age", 0);
+    json_schema_free(compiled);
+    compiled = json_schema_compile(schema);
+    parsed = json_parse_file_with_schema("tests/test_5.txt", compiled);
+    TEST(json_value_equals(parsed, val_from_file));
+    json_value_free(parsed);
+    json_schema_free(compiled);
 }
 
 void test_suite_8(void) {
@@ -491,6 +613,25 @@ void test_suite_8(void) {
     serialization_size = json_serialization_size(a);
     buf = json_serialize_to_string(a);
     TEST((strlen(buf)+1) == serialization_size);
+
+    /* names are written from cached serialized form */
+    malloc_count = 0;
+    a = json_parse_string("{\"plain\":1,\"quo\\\"te\":2,\"a/b\":3}");
+    b = json_value_init_object();
+    TEST(json_object_set_number(json_object(b), "tab\t", 4) == JSONSuccess);
+    TEST(json_object_set_number(json_object(b), "plain", 5) == JSONSuccess);
+    TEST(json_object_merge_move(json_object(a), json_object(b)) == JSONSuccess);
+    buf = json_serialize_to_string(a);
+    TEST(STREQ(buf, "{\"plain\":5,\"quo\\\"te\":2,\"a\\/b\":3,\"tab\\t\":4}"));
+    json_free_serialized_string(buf);
+    TEST(json_object_remove(json_object(a), "quo\"te") == JSONSuccess);
+    buf = json_serialize_to_string_pretty(a);
+    TEST(STREQ(buf, "{\n    \"plain\": 5,\n    \"tab\\t\": 4,\n    \"a\\/b\": 3\n}"));
+    json_free_serialized_string(buf);
+    TEST(json_object_clear(json_object(a)) == JSONSuccess);
+    json_value_free(a);
+    json_value_free(b);
+    TEST(malloc_count == 0);
 }
 
 void test_suite_9(void) {
@@ -518,9 +659,21 @@ void test_suite_9(void) {
 void test_suite_10(void) {
     JSON_Value *val;
     char *serialized;
+    char long_json[1024], long_key[600];
+    size_t i;
 
     malloc_count = 0;
 
+    /* keys and strings longer than parser's scratch */
+    for (i = 0; i < sizeof(long_key) - 1; i++) {
+        long_key[i] = (char)('a' + (i % 26));
+    }
+    long_key[sizeof(long_key) - 1] = '\0';
+    sprintf(long_json, "{\"%s\":{\"k\\u0065y\":\"%s\"}}", long_key, long_key + 300);
+    val = json_parse_string(long_json);
+    TEST(STREQ(json_object_get_string(json_object_get_object(json_object(val), long_key), "key"), long_key + 300));
+    json_value_free(val);
+
     val = json_parse_file("tests/test_1_1.txt");
     json_value_free(val);
 
@@ -538,6 +691,1596 @@ void test_suite_10(void) {
     TEST(malloc_count == 0);
 }
 
+void test_suite_11(void) {
+    JSON_Value *template_value = NULL, *expected = NULL, *copy_a = NULL, *copy_b = NULL;
+    char *serialized = NULL, *expected_serialized = NULL;
+    int malloc_count_before = 0;
+    malloc_count = 0;
+    template_value = json_parse_file("tests/test_2.txt");
+    expected = json_parse_file("tests/test_2.txt");
+    TEST(json_value_share(template_value) == JSONSuccess);
+    TEST(json_value_equals(template_value, expected));
+    malloc_count_before = malloc_count;
+    copy_a = json_value_deep_copy(template_value);
+    TEST(malloc_count == malloc_count_before + 1); /* only a reference is allocated */
+    copy_b = json_value_deep_copy(copy_a);
+    TEST(json_value_equals(copy_b, expected));
+    TEST(json_object_dotset_string(json_object(copy_a), "object.nested string", "changed") == JSONSuccess);
+    TEST(json_object_remove(json_object(copy_b), "string array") == JSONSuccess);
+    TEST(STREQ(json_object_dotget_string(json_object(copy_a), "object.nested string"), "changed"));
+    TEST(STREQ(json_object_dotget_string(json_object(template_value), "object.nested string"), "str"));
+    TEST(json_object_get_array(json_object(copy_a), "string array") != NULL);
+    TEST(json_value_get_parent(json_object_get_value(json_object(copy_a), "object")) == copy_a);
+    TEST(!json_value_equals(copy_a, expected));
+    TEST(json_value_equals(template_value, expected));
+    serialized = json_serialize_to_string(template_value);
+    expected_serialized = json_serialize_to_string(expected);
+    TEST(STREQ(serialized, expected_serialized));
+    json_free_serialized_string(serialized);
+    json_free_serialized_string(expected_serialized);
+    json_value_free(template_value);
+    json_value_free(copy_b);
+    TEST(STREQ(json_object_get_string(json_object(copy_a), "string"), "lorem ipsum"));
+    json_value_free(copy_a);
+    json_value_free(expected);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_12(void) {
+    JSON_Value *fragment = NULL, *response = NULL, *detached = NULL, *expected = NULL;
+    JSON_Object *response_obj = NULL;
+    malloc_count = 0;
+    fragment = json_parse_string("{\"a\":1,\"b\":[true,null,\"x\"],\"c\":{\"d\":2}}");
+    response = json_parse_string("{\"a\":0,\"z\":\"z\"}");
+    response_obj = json_object(response);
+
+    detached = json_object_detach(json_object(fragment), "c");
+    TEST(detached != NULL && json_value_get_parent(detached) == NULL);
+    TEST(json_object_get_value(json_object(fragment), "c") == NULL);
+    TEST(json_object_detach(json_object(fragment), "c") == NULL);
+    TEST(json_object_set_value(response_obj, "c", detached) == JSONSuccess);
+    TEST(json_value_get_parent(detached) == response);
+
+    detached = json_array_detach(json_object_get_array(json_object(fragment), "b"), 2);
+    TEST(STREQ(json_string(detached), "x"));
+    TEST(json_array_detach(json_object_get_array(json_object(fragment), "b"), 2) == NULL);
+    TEST(json_array_append_value(json_object_get_array(json_object(fragment), "b"), detached) == JSONSuccess);
+
+    TEST(json_object_merge_move(response_obj, json_object(fragment)) == JSONSuccess);
+    TEST(json_object_get_count(json_object(fragment)) == 0);
+    expected = json_parse_string("{\"a\":1,\"z\":\"z\",\"c\":{\"d\":2},\"b\":[true,null,\"x\"]}");
+    TEST(json_value_equals(response, expected));
+    TEST(json_value_get_parent(json_object_get_value(response_obj, "b")) == response);
+    TEST(json_object_merge_move(json_object_get_object(response_obj, "c"), response_obj) == JSONFailure);
+    TEST(json_object_merge_move(response_obj, response_obj) == JSONFailure);
+    json_value_free(fragment);
+    json_value_free(response);
+    json_value_free(expected);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_13(void) {
+    JSON_Value *root_value = NULL, *value = NULL;
+    JSON_Object *root_object = NULL;
+    JSON_Path *nested = NULL, *number = NULL, *missing = NULL, *deep = NULL, *through = NULL;
+    int malloc_count_before = 0;
+    malloc_count = 0;
+    root_value = json_parse_string("{\"a\":{\"b\":{\"c\":\"str\",\"n\":5,\"t\":true}},\"s\":\"x\"}");
+    root_object = json_object(root_value);
+    nested = json_path_compile("a.b.c");
+    number = json_path_compile("a.b.n");
+    missing = json_path_compile("a.x.c");
+    deep = json_path_compile("a.new.deeper.value");
+    through = json_path_compile("s.c");
+    TEST(json_path_compile(NULL) == NULL);
+
+    malloc_count_before = malloc_count;
+    TEST(STREQ(json_path_get_string(root_object, nested), "str"));
+    TEST(json_path_get_number(root_object, number) == 5);
+    TEST(json_path_get_value(root_object, missing) == NULL);
+    TEST(json_path_get_value(root_object, through) == NULL);
+    TEST(json_path_get_value(NULL, nested) == NULL);
+    TEST(json_path_get_value(root_object, NULL) == NULL);
+    TEST(malloc_count == malloc_count_before);
+
+    TEST(json_path_set_number(root_object, number, 6) == JSONSuccess);
+    TEST(json_object_dotget_number(root_object, "a.b.n") == 6);
+    TEST(json_path_set_boolean(root_object, deep, 1) == JSONSuccess);
+    TEST(json_object_dotget_boolean(root_object, "a.new.deeper.value") == 1);
+    TEST(json_path_get_boolean(root_object, deep) == 1);
+    TEST(json_path_set_string(root_object, through, "y") == JSONFailure);
+    TEST(STREQ(json_object_get_string(root_object, "s"), "x"));
+    value = json_value_init_null();
+    TEST(json_path_set_value(root_object, missing, value) == JSONSuccess);
+    TEST(json_value_get_parent(value) != NULL);
+    TEST(json_path_set_value(root_object, nested, value) == JSONFailure);
+    TEST(json_path_set_null(root_object, nested) == JSONSuccess);
+    TEST(json_value_get_type(json_object_dotget_value(root_object, "a.b.c")) == JSONNull);
+
+    json_path_free(nested);
+    json_path_free(number);
+    json_path_free(missing);
+    json_path_free(deep);
+    json_path_free(through);
+    json_value_free(root_value);
+    TEST(malloc_count == 0);
+}
+
+static JSON_Status count_titles(JSON_Value *match, void *arg) {
+    if (json_value_get_type(match) == JSONString) {
+        (*(int*)arg)++;
+    }
+    return *(int*)arg < 2 ? JSONSuccess : JSONFailure;
+}
+
+static size_t query_count(const char *path, const JSON_Value *root) {
+    JSON_Query *query = json_query_compile(path);
+    size_t count = json_query_run(query, root, NULL, NULL);
+    json_query_free(query);
+    return count;
+}
+
+void test_suite_14(void) {
+    JSON_Value *root_value = NULL, *matches[8];
+    JSON_Query *query = NULL;
+    int titles = 0;
+    malloc_count = 0;
+    root_value = json_parse_string(
+        "{\"store\":{\"book\":["
+        "{\"title\":\"A\",\"price\":8.95,\"isbn\":\"1\"},"
+        "{\"title\":\"B\",\"price\":12.99},"
+        "{\"title\":\"C\",\"price\":22.99,\"isbn\":\"2\"},"
+        "{\"title\":\"D\",\"price\":8.99,\"tags\":{\"title\":\"nested\"}}],"
+        "\"bicycle\":{\"color\":\"red\",\"price\":19.95}},"
+        "\"a/b\":1,\"m~n\":2,\"x.y\":3}");
+
+    query = json_query_compile_pointer("/store/book/1/title");
+    TEST(STREQ(json_string(json_query_get_value(query, root_value)), "B"));
+    json_query_free(query);
+    query = json_query_compile_pointer("/a~1b");
+    TEST(json_number(json_query_get_value(query, root_value)) == 1);
+    json_query_free(query);
+    query = json_query_compile_pointer("/m~0n");
+    TEST(json_number(json_query_get_value(query, root_value)) == 2);
+    json_query_free(query);
+    query = json_query_compile_pointer("");
+    TEST(json_query_get_value(query, root_value) == root_value);
+    json_query_free(query);
+    query = json_query_compile_pointer("/store/book/01");
+    TEST(json_query_get_value(query, root_value) == NULL);
+    json_query_free(query);
+    TEST(json_query_compile_pointer("store") == NULL);
+    TEST(json_query_compile_pointer("/a~2") == NULL);
+
+    query = json_query_compile("$['x.y']");
+    TEST(json_number(json_query_get_value(query, root_value)) == 3);
+    json_query_free(query);
+    query = json_query_compile("$.store.book[-1].title");
+    TEST(STREQ(json_string(json_query_get_value(query, root_value)), "D"));
+    json_query_free(query);
+    query = json_query_compile("$.store.book[*].title");
+    TEST(json_query_select_values(query, root_value, matches, 8) == 4);
+    TEST(STREQ(json_string(matches[0]), "A") && STREQ(json_string(matches[3]), "D"));
+    TEST(json_query_run(query, root_value, count_titles, &titles) == 2);
+    TEST(titles == 2);
+    json_query_free(query);
+    query = json_query_compile("$.store.book[1:3].title");
+    TEST(json_query_select_values(query, root_value, matches, 8) == 2);
+    TEST(STREQ(json_string(matches[0]), "B") && STREQ(json_string(matches[1]), "C"));
+    json_query_free(query);
+    query = json_query_compile("$.store.book[::-2].title");
+    TEST(json_query_select_values(query, root_value, matches, 8) == 2);
+    TEST(STREQ(json_string(matches[0]), "D") && STREQ(json_string(matches[1]), "B"));
+    json_query_free(query);
+    query = json_query_compile("$.store.book[?(@.price < 10)].title");
+    TEST(json_query_select_values(query, root_value, matches, 8) == 2);
+    TEST(STREQ(json_string(matches[0]), "A") && STREQ(json_string(matches[1]), "D"));
+    json_query_free(query);
+    query = json_query_compile("$.store.book[?(@.title == 'C')].price");
+    TEST(fabs(json_number(json_query_get_value(query, root_value)) - 22.99) < EPSILON);
+    json_query_free(query);
+    TEST(query_count("$.store.book[?(@.isbn)]", root_value) == 2);
+    TEST(query_count("$.store.book[?@.tags.title != 'x']", root_value) == 1);
+    TEST(query_count("$..price", root_value) == 5);
+    TEST(query_count("$..title", root_value) == 5);
+    TEST(query_count("$.store.*", root_value) == 2);
+    TEST(query_count("$..*", root_value) == 24);
+    TEST(query_count("$.store.book[10]", root_value) == 0);
+    TEST(query_count("$.store.book[0:100:1000000000]", root_value) == 1);
+    TEST(json_query_compile("store") == NULL);
+    TEST(json_query_compile("$.") == NULL);
+    TEST(json_query_compile("$[?(@.a == )]") == NULL);
+    TEST(json_query_compile("$['unterminated") == NULL);
+    json_value_free(root_value);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_15(void) {
+    const char *input =
+        "{\"id\":7,\"skip\":{\"s\":\"}]\\\"[{\",\"a\":[1,[2,{\"x\":null}]]},"
+        "\"user\":{\"name\":\"Joe\",\"bio\":\"long text\",\"address\":{\"city\":\"X\",\"zip\":\"1\"}},"
+        "\"items\":[1,2,3],\"flag\":true,\"text\":\"not an object\"}";
+    const char *paths[] = { "user.name", "user.address", "user.address.city", "items", "text.sub", "missing.path" };
+    const char *invalid_paths[] = { "id" };
+    JSON_Value *projected = NULL, *expected = NULL;
+    int malloc_count_full = 0;
+    malloc_count = 0;
+    projected = json_parse_string(input);
+    malloc_count_full = malloc_count;
+    json_value_free(projected);
+
+    malloc_count = 0;
+    projected = json_parse_string_projected(input, paths, sizeof(paths) / sizeof(paths[0]));
+    TEST(malloc_count < malloc_count_full);
+    expected = json_parse_string("{\"user\":{\"name\":\"Joe\",\"address\":{\"city\":\"X\",\"zip\":\"1\"}},\"items\":[1,2,3]}");
+    TEST(json_value_equals(projected, expected));
+    json_value_free(projected);
+    json_value_free(expected);
+
+    projected = json_parse_string_projected(input, NULL, 0);
+    TEST(json_object_get_count(json_object(projected)) == 0);
+    json_value_free(projected);
+    TEST(json_parse_string_projected("[1,2]", invalid_paths, 1) == NULL);
+    TEST(json_parse_string_projected("{\"a\":[1,2}", invalid_paths, 1) == NULL);
+    TEST(json_parse_string_projected("{\"a\":[1}, \"id\":1}", invalid_paths, 1) == NULL); /* mismatched brackets */
+    TEST(json_parse_string_projected("{\"a\":{\"b\":[{]}}, \"id\":1}", invalid_paths, 1) == NULL);
+    TEST(json_parse_string_projected("{\"a\":\"unterminated}", invalid_paths, 1) == NULL);
+    TEST(json_parse_string_projected("{\"id\":1,\"a\":}", invalid_paths, 1) == NULL);
+    TEST(json_parse_string_projected(NULL, invalid_paths, 1) == NULL);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_16(void) {
+    static char nested[2 * 2050 + 1];
+    JSON_Value *lazy = NULL, *eager = NULL, *copy = NULL;
+    char *lazy_serialized = NULL, *eager_serialized = NULL;
+    int malloc_count_eager = 0;
+    size_t i = 0;
+    json_set_lazy_parsing(1);
+    test_suite_2_no_comments();
+    test_suite_2_with_comments();
+
+    json_set_lazy_parsing(0);
+    malloc_count = 0;
+    eager = json_parse_file("tests/test_2.txt");
+    malloc_count_eager = malloc_count;
+    json_set_lazy_parsing(1);
+    lazy = json_parse_file("tests/test_2.txt");
+    TEST(malloc_count - malloc_count_eager < malloc_count_eager / 4); /* source, spans and root */
+    TEST(json_value_get_type(lazy) == JSONObject);
+    copy = json_value_deep_copy(lazy);
+    TEST(STREQ(json_object_dotget_string(json_object(copy), "object.nested string"), "str"));
+    json_value_free(copy);
+    TEST(json_value_equals(lazy, eager));
+    lazy_serialized = json_serialize_to_string_pretty(lazy);
+    eager_serialized = json_serialize_to_string_pretty(eager);
+    TEST(STREQ(lazy_serialized, eager_serialized));
+    json_free_serialized_string(lazy_serialized);
+    json_free_serialized_string(eager_serialized);
+    json_value_free(lazy);
+
+    lazy = json_parse_file("tests/test_2.txt");
+    copy = json_value_deep_copy(json_object_get_value(json_object(lazy), "object"));
+    TEST(json_value_share(lazy) == JSONSuccess);
+    TEST(json_value_equals(lazy, eager));
+    json_value_free(lazy);
+    TEST(json_object_get_count(json_object(copy)) > 0);
+    json_value_free(copy);
+    json_value_free(eager);
+    TEST(malloc_count == 0);
+
+    lazy = json_parse_string(" [1, {\"a\":[[]]}, \"x\"] ");
+    TEST(json_array_get_count(json_array(lazy)) == 3);
+    TEST(json_array_get_count(json_object_get_array(json_array_get_object(json_array(lazy), 1), "a")) == 1);
+    json_value_free(lazy);
+    TEST(json_parse_string("{\"a\":1,\"a\":2}") == NULL);
+    TEST(json_parse_string("{\"a\":{\"b\":0,\"b\":1}}") == NULL);
+    TEST(json_parse_string("{\"a\\u0000b\":1,\"a\":2}") == NULL);
+    TEST(json_parse_string("{\"1\":0,\"2\":0,\"3\":0,\"4\":0,\"5\":0,\"6\":0,\"7\":0,\"8\":0,\"9\":0,\"2\":0}") == NULL);
+    lazy = json_parse_string("{\"1\":0,\"2\":0,\"3\":0,\"4\":0,\"5\":0,\"6\":0,\"7\":0,\"8\":0,\"9\":{\"1\":0}}");
+    TEST(json_object_get_count(json_object(lazy)) == 9);
+    json_value_free(lazy);
+    TEST(json_parse_string("{\"lorem\":\"ipsum\",}") == NULL);
+    TEST(json_parse_string("[1,]") == NULL);
+    TEST(json_parse_string("[1 2]") == NULL);
+    TEST(json_parse_string("[\"\\u00zz\"]") == NULL);
+    TEST(json_parse_string("{\"a\":tru}") == NULL);
+    TEST(json_parse_string("[07]") == NULL);
+    TEST(json_parse_string("[.5]") == NULL);
+    TEST(json_parse_string("[1,.5e1]") == NULL);
+    TEST(json_parse_string("[[[]]") == NULL);
+    TEST(json_parse_string("{\"a\" 1}") == NULL);
+    TEST(json_parse_string("[") == NULL);
+    lazy = json_parse_string(" \"scalar\"");
+    TEST(STREQ(json_string(lazy), "scalar"));
+    json_value_free(lazy);
+
+    for (i = 0; i < 2049; i++) { /* root and 2048 levels of nesting, like eager parsing allows */
+        nested[i] = '[';
+        nested[2049 + i] = ']';
+    }
+    lazy = json_parse_string(nested);
+    TEST(lazy != NULL);
+    lazy_serialized = json_serialize_to_string(lazy);
+    TEST(lazy_serialized != NULL && strcmp(lazy_serialized, nested) == 0);
+    json_free_serialized_string(lazy_serialized);
+    json_value_free(lazy);
+    memmove(nested + 1, nested, 2 * 2049 + 1);
+    nested[2 * 2049 + 1] = ']';
+    TEST(json_parse_string(nested) == NULL);
+    json_set_lazy_parsing(0);
+    TEST(json_parse_string(nested) == NULL);
+    nested[2 * 2049 + 1] = '\0';
+    lazy = json_parse_string(nested + 1);
+    TEST(lazy != NULL);
+    json_value_free(lazy);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_17(void) {
+    const char *input = "[1.0,0.1,-0,1E5,2e-3,12345678901234567890,{\"n\":100.50}]";
+    JSON_Value *value = NULL, *copy = NULL;
+    char *serialized = NULL;
+    malloc_count = 0;
+    json_set_lazy_numbers(1);
+    value = json_parse_string(input);
+    TEST(json_array_get_number(json_array(value), 0) == 1.0);
+    TEST(fabs(json_array_get_number(json_array(value), 1) - 0.1) < EPSILON);
+    TEST(json_array_get_number(json_array(value), 3) == 100000);
+    TEST(fabs(json_array_get_number(json_array(value), 4) - 0.002) < EPSILON);
+    TEST(fabs(json_object_get_number(json_array_get_object(json_array(value), 6), "n") - 100.5) < EPSILON);
+    serialized = json_serialize_to_string(value);
+    TEST(STREQ(serialized, "[1.0,0.1,-0,1E5,2e-3,1.2345678901234567e+19,{\"n\":100.50}]"));
+    json_free_serialized_string(serialized);
+    copy = json_value_deep_copy(value);
+    TEST(json_value_equals(copy, value));
+    TEST(json_array_replace_number(json_array(copy), 0, 2.5) == JSONSuccess);
+    serialized = json_serialize_to_string(copy);
+    TEST(STREQ(serialized, "[2.5,0.1,-0,1E5,2e-3,1.2345678901234567e+19,{\"n\":100.50}]"));
+    json_free_serialized_string(serialized);
+    json_value_free(copy);
+    json_value_free(value);
+
+    json_set_lazy_parsing(1);
+    value = json_parse_string(input);
+    serialized = json_serialize_to_string(value);
+    TEST(STREQ(serialized, "[1.0,0.1,-0,1E5,2e-3,1.2345678901234567e+19,{\"n\":100.50}]"));
+    json_free_serialized_string(serialized);
+    json_value_free(value);
+    TEST(json_parse_string("[1e400]") == NULL);
+    TEST(json_parse_string("[07]") == NULL);
+    TEST(json_parse_string("[-]") == NULL);
+    json_set_lazy_parsing(0);
+    TEST(json_parse_string("[1e400]") == NULL);
+    TEST(json_parse_string("[1.5e-400000]") == NULL);
+    TEST(json_parse_string("[0x2]") == NULL);
+    TEST(json_parse_string("[-007]") == NULL);
+    value = json_parse_string("[1.,-.5,1.e5]"); /* accepted like strtod does, but not kept as text */
+    TEST(json_array_get_number(json_array(value), 0) == 1.0);
+    serialized = json_serialize_to_string(value);
+    TEST(STREQ(serialized, "[1,-0.5,100000]"));
+    json_free_serialized_string(serialized);
+    json_value_free(value);
+    json_set_lazy_parsing(1);
+    value = json_parse_string("[1.,-.5,1.e5]");
+    serialized = json_serialize_to_string(value);
+    TEST(STREQ(serialized, "[1,-0.5,100000]"));
+    json_free_serialized_string(serialized);
+    json_value_free(value);
+    json_set_lazy_parsing(0);
+    json_set_lazy_numbers(0);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_18(void) {
+    const char *fragment = "{ \"b\" : [1, 2.0],\"c\":\"x\" }";
+    JSON_Value *root_value = NULL, *raw = NULL, *copy = NULL;
+    char *serialized = NULL;
+    malloc_count = 0;
+    root_value = json_value_init_object();
+    raw = json_value_init_raw(fragment, strlen(fragment));
+    TEST(json_value_get_type(raw) == JSONObject);
+    TEST(json_object_set_value(json_object(root_value), "a", raw) == JSONSuccess);
+    copy = json_value_deep_copy(root_value);
+    serialized = json_serialize_to_string(copy);
+    TEST(STREQ(serialized, "{\"a\":{ \"b\" : [1, 2.0],\"c\":\"x\" }}"));
+    json_free_serialized_string(serialized);
+    json_value_free(copy);
+    TEST(json_serialization_size(root_value) == strlen(fragment) + 7);
+
+    TEST(STREQ(json_object_dotget_string(json_object(root_value), "a.c"), "x"));
+    serialized = json_serialize_to_string(root_value);
+    TEST(STREQ(serialized, "{\"a\":{\"b\":[1, 2.0],\"c\":\"x\"}}")); /* only accessed object is rebuilt */
+    json_free_serialized_string(serialized);
+    TEST(json_object_dotset_number(json_object(root_value), "a.d", 3) == JSONSuccess);
+    serialized = json_serialize_to_string(root_value);
+    TEST(STREQ(serialized, "{\"a\":{\"b\":[1, 2.0],\"c\":\"x\",\"d\":3}}"));
+    json_free_serialized_string(serialized);
+    json_value_free(root_value);
+
+    raw = json_value_init_raw("[1]garbage", 3);
+    TEST(json_array_get_count(json_array(raw)) == 1);
+    json_value_free(raw);
+    raw = json_value_init_raw(" \"str\" ", 7);
+    TEST(STREQ(json_string(raw), "str"));
+    json_value_free(raw);
+    TEST(json_value_init_raw("[1,", 3) == NULL);
+    TEST(json_value_init_raw("1 2", 3) == NULL);
+    TEST(json_value_init_raw("{}x", 3) == NULL);
+    TEST(json_value_init_raw("[\0]", 3) == NULL);
+    TEST(json_value_init_raw("[.5]", 4) == NULL);
+    TEST(json_value_init_raw("{\"a\":.5}", 8) == NULL);
+    TEST(json_value_init_raw("+1", 2) == NULL);
+    TEST(json_value_init_raw("[1.]", 4) == NULL);
+    TEST(json_value_init_raw("{\"a\":-.5}", 9) == NULL);
+    raw = json_value_init_raw("1.e5", 4);
+    serialized = json_serialize_to_string(raw);
+    TEST(STREQ(serialized, "100000"));
+    json_free_serialized_string(serialized);
+    json_value_free(raw);
+    TEST(json_value_init_raw(NULL, 0) == NULL);
+    TEST(malloc_count == 0);
+}
+
+/* Serializes value with cache enabled and compares result with fresh serialization */
+static int serializes_as_uncached(const JSON_Value *value) {
+    char *cached = NULL, *fresh = NULL;
+    int result = 0;
+    json_set_serialization_cache(1);
+    cached = json_serialize_to_string(value);
+    json_set_serialization_cache(0);
+    fresh = json_serialize_to_string(value);
+    result = cached != NULL && fresh != NULL && strcmp(cached, fresh) == 0
+          && json_serialization_size(value) == strlen(fresh) + 1;
+    json_free_serialized_string(cached);
+    json_free_serialized_string(fresh);
+    return result;
+}
+
+void test_suite_19(void) {
+    JSON_Value *root_value = NULL, *detached = NULL;
+    JSON_Object *root = NULL;
+    JSON_Array *items = NULL;
+    char *first = NULL, *second = NULL;
+    malloc_count = 0;
+    root_value = json_parse_string("{\"a\":{\"b\":[1,2,{\"c\":\"x\"}],\"d\":true},\"e\":[[],{}]}");
+    root = json_object(root_value);
+    TEST(serializes_as_uncached(root_value));
+    json_set_serialization_cache(1);
+    first = json_serialize_to_string(root_value);
+    second = json_serialize_to_string(root_value);
+    TEST(STREQ(first, second));
+    json_free_serialized_string(first);
+    json_free_serialized_string(second);
+    json_set_serialization_cache(0);
+
+    TEST(json_object_dotset_string(root, "a.b.2.c", "y") == JSONFailure);
+    TEST(json_object_set_string(json_array_get_object(json_object_dotget_array(root, "a.b"), 2), "c", "y") == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_object_dotset_number(root, "a.f.g", 4) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    items = json_object_dotget_array(root, "a.b");
+    TEST(json_array_append_null(items) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_array_replace_boolean(items, 0, 0) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_array_remove(items, 1) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_array_append_value(json_object_get_array(root, "e"), json_value_init_array()) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_array_clear(items) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_object_dotremove(root, "a.d") == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    detached = json_object_detach(root, "a");
+    TEST(serializes_as_uncached(root_value));
+    TEST(serializes_as_uncached(detached));
+    TEST(json_object_set_value(root, "z", detached) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    TEST(json_object_clear(json_object_get_object(root, "z")) == JSONSuccess);
+    TEST(serializes_as_uncached(root_value));
+    json_set_serialization_cache(1);
+    first = json_serialize_to_string_pretty(root_value);
+    json_set_serialization_cache(0);
+    second = json_serialize_to_string_pretty(root_value);
+    TEST(STREQ(first, second));
+    json_free_serialized_string(first);
+    json_free_serialized_string(second);
+    json_value_free(root_value);
+    TEST(malloc_count == 0);
+}
+
+/* Joins segments and compares them with json_serialize_to_string output */
+static int segments_match_string(const JSON_Value *value) {
+    JSON_Segment *segments = NULL;
+    char *serialized = NULL, *joined = NULL;
+    size_t count = 0, i = 0, len = 0;
+    int result = 0;
+    segments = json_serialize_to_segments(value, &count);
+    serialized = json_serialize_to_string(value);
+    if (segments != NULL && serialized != NULL) {
+        joined = (char*)malloc(strlen(serialized) + 1);
+        for (i = 0; i < count && len + segments[i].length <= strlen(serialized); i++) {
+            memcpy(joined + len, segments[i].data, segments[i].length);
+            len += segments[i].length;
+        }
+        result = i == count && len == strlen(serialized) && memcmp(joined, serialized, len) == 0;
+        free(joined);
+    }
+    json_free_segments(segments);
+    json_free_serialized_string(serialized);
+    return result;
+}
+
+void test_suite_20(void) {
+    const char *fragment = "{\"long raw fragment\":[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19]}";
+    char payload[300];
+    JSON_Value *root_value = NULL;
+    JSON_Object *root = NULL;
+    JSON_Segment *segments = NULL;
+    size_t count = 0, i = 0, len = 0;
+    int referenced = 0, matches = 0;
+    malloc_count = 0;
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[sizeof(payload) - 1] = '\0';
+    payload[100] = '"';
+    payload[101] = '\n';
+    root_value = json_value_init_object();
+    root = json_object(root_value);
+    TEST(json_object_set_string(root, "payload", payload) == JSONSuccess);
+    TEST(json_object_dotset_number(root, "meta.size", 1.5) == JSONSuccess);
+    TEST(json_object_dotset_string(root, "meta.name/\"", "short") == JSONSuccess);
+    TEST(json_object_set_value(root, "raw", json_value_init_raw(fragment, strlen(fragment))) == JSONSuccess);
+    TEST(json_object_set_value(root, "small raw", json_value_init_raw("[ 1 ]", 5)) == JSONSuccess);
+    TEST(json_object_set_value(root, "list", json_value_init_array()) == JSONSuccess);
+    TEST(json_array_append_boolean(json_object_get_array(root, "list"), 1) == JSONSuccess);
+    TEST(json_array_append_null(json_object_get_array(root, "list")) == JSONSuccess);
+    TEST(segments_match_string(root_value));
+
+    segments = json_serialize_to_segments(root_value, &count);
+    TEST(segments != NULL);
+    for (i = 0; segments != NULL && i < count; i++) {
+        if (segments[i].data == json_object_get_string(root, "payload")) {
+            referenced |= 1; /* run before escaped characters */
+        } else if (segments[i].data == json_object_get_string(root, "payload") + 102) {
+            referenced |= 2; /* run after escaped characters */
+        } else if (segments[i].data == fragment) {
+            TEST(0); /* raw fragments are copied on creation */
+        }
+    }
+    TEST(referenced == 3);
+    TEST(count < 10);
+    json_free_segments(segments);
+    json_value_free(root_value);
+
+    root_value = json_parse_string("[\"a\", 1, {}, [], true, \"\\u0001\"]");
+    TEST(segments_match_string(root_value));
+    segments = json_serialize_to_segments(root_value, &count);
+    TEST(count == 1);
+    json_free_segments(segments);
+    TEST(json_serialize_to_segments(root_value, NULL) == NULL);
+    json_value_free(root_value);
+    TEST(json_serialize_to_segments(NULL, &count) == NULL);
+    TEST(count == 0);
+
+    memset(payload, 'a', sizeof(payload) - 1); /* reading raw fragment parses it and frees its text */
+    payload[0] = '[';
+    payload[1] = '"';
+    payload[202] = '"';
+    payload[203] = ']';
+    root_value = json_value_init_raw(payload, 204);
+    segments = json_serialize_to_segments(root_value, &count);
+    TEST(json_array_get_count(json_value_get_array(root_value)) == 1);
+    for (i = 0, len = 0, matches = 1; segments != NULL && i < count && matches; i++) {
+        matches = len + segments[i].length <= 204 && memcmp(segments[i].data, payload + len, segments[i].length) == 0;
+        len += segments[i].length;
+    }
+    TEST(segments != NULL && matches && len == 204);
+    json_free_segments(segments);
+    json_value_free(root_value);
+    TEST(malloc_count == 0);
+}
+
+/* In-memory stream for MessagePack callbacks, reads are limited to chunk bytes */
+typedef struct test_stream_t {
+    unsigned char data[1024];
+    size_t len;
+    size_t pos;
+    size_t chunk;
+} Test_Stream;
+
+static JSON_Status test_stream_write(const void *data, size_t size, void *arg) {
+    Test_Stream *stream = (Test_Stream*)arg;
+    if (stream->len + size > sizeof(stream->data)) {
+        return JSONFailure;
+    }
+    memcpy(stream->data + stream->len, data, size);
+    stream->len += size;
+    return JSONSuccess;
+}
+
+static size_t test_stream_read(void *buf, size_t size, void *arg) {
+    Test_Stream *stream = (Test_Stream*)arg;
+    size_t available = stream->len - stream->pos;
+    size = size < stream->chunk ? size : stream->chunk;
+    size = size < available ? size : available;
+    memcpy(buf, stream->data + stream->pos, size);
+    stream->pos += size;
+    return size;
+}
+
+static int msgpack_decodes_to(const unsigned char *data, size_t size, const char *json) {
+    JSON_Value *decoded = json_value_from_msgpack(data, size);
+    JSON_Value *expected = json_parse_string(json);
+    int result = decoded != NULL && json_value_equals(decoded, expected);
+    json_value_free(decoded);
+    json_value_free(expected);
+    return result;
+}
+
+void test_suite_21(void) {
+    const unsigned char numbers_msgpack[] = {
+        0xdc, 0x00, 0x12, 0x00, 0x7f, 0xcc, 0x80, 0xcc, 0xff, 0xcd, 0x01, 0x00, 0xcd, 0xff, 0xff,
+        0xce, 0x00, 0x01, 0x00, 0x00, 0xff, 0xe0, 0xd0, 0xdf, 0xd0, 0x80, 0xd1, 0xff, 0x7f,
+        0xd1, 0x80, 0x00, 0xd2, 0xff, 0xff, 0x7f, 0xff, 0xd2, 0x80, 0x00, 0x00, 0x00,
+        0xd3, 0xff, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff,
+        0xcf, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0xcb, 0x3f, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    const char *numbers_json = "[0,127,128,255,256,65535,65536,-1,-32,-33,-128,-129,-32768,-32769,"
+                               "-2147483648,-2147483649,4294967296,1.5]";
+    const unsigned char object_msgpack[] = { 0x82, 0xa1, 'a', 0xa1, 'x', 0xa1, 'b', 0x93, 0xc3, 0xc2, 0xc0 };
+    const unsigned char float_one[] = { 0xcb, 0x3f, 0xf0, 0, 0, 0, 0, 0, 0 };
+    const unsigned char float32[] = { 0xca, 0x3f, 0xc0, 0, 0 };
+    const unsigned char max_safe[] = { 0xcf, 0x00, 0x20, 0, 0, 0, 0, 0, 0 };
+    const unsigned char binary[] = { 0xc4, 0x01, 0x00 };
+    const unsigned char int_key[] = { 0x81, 0x01, 0x01 };
+    const unsigned char duplicate_key[] = { 0x82, 0xa1, 'a', 0x01, 0xa1, 'a', 0x02 };
+    const unsigned char null_byte[] = { 0xa1, 0x00 };
+    const unsigned char long_str[] = { 0xdb, 0xff, 0xff, 0xff, 0xff, 'a' };
+    JSON_Value *root_value = NULL, *decoded = NULL;
+    unsigned char *encoded = NULL;
+    char *serialized = NULL;
+    char long_string[301];
+    Test_Stream stream;
+    size_t size = 0;
+    malloc_count = 0;
+
+    root_value = json_parse_string(numbers_json);
+    encoded = json_value_to_msgpack(root_value, &size);
+    TEST(encoded != NULL && size == sizeof(numbers_msgpack) && memcmp(encoded, numbers_msgpack, size) == 0);
+    json_free_msgpack(encoded);
+    json_value_free(root_value);
+    TEST(msgpack_decodes_to(numbers_msgpack, sizeof(numbers_msgpack), numbers_json));
+
+    root_value = json_parse_string("{\"a\":\"x\",\"b\":[true,false,null]}");
+    encoded = json_value_to_msgpack(root_value, &size);
+    TEST(encoded != NULL && size == sizeof(object_msgpack) && memcmp(encoded, object_msgpack, size) == 0);
+    json_free_msgpack(encoded);
+    json_value_free(root_value);
+    TEST(msgpack_decodes_to(object_msgpack, sizeof(object_msgpack), "{\"a\":\"x\",\"b\":[true,false,null]}"));
+
+    decoded = json_value_from_msgpack(float_one, sizeof(float_one));
+    serialized = json_serialize_to_string(decoded);
+    TEST(STREQ(serialized, "1.0"));
+    json_free_serialized_string(serialized);
+    encoded = json_value_to_msgpack(decoded, &size);
+    TEST(encoded != NULL && size == sizeof(float_one) && memcmp(encoded, float_one, size) == 0);
+    json_free_msgpack(encoded);
+    json_value_free(decoded);
+    TEST(msgpack_decodes_to(float32, sizeof(float32), "1.5"));
+    TEST(msgpack_decodes_to(max_safe, sizeof(max_safe), "9007199254740992"));
+
+    TEST(json_value_from_msgpack(binary, sizeof(binary)) == NULL);
+    TEST(json_value_from_msgpack(int_key, sizeof(int_key)) == NULL);
+    TEST(json_value_from_msgpack(duplicate_key, sizeof(duplicate_key)) == NULL);
+    TEST(json_value_from_msgpack(null_byte, sizeof(null_byte)) == NULL);
+    TEST(json_value_from_msgpack(long_str, sizeof(long_str)) == NULL);
+    TEST(json_value_from_msgpack(object_msgpack, sizeof(object_msgpack) - 1) == NULL);
+    TEST(json_value_from_msgpack(float_one, sizeof(float_one) + 1) == NULL);
+    TEST(json_value_from_msgpack(NULL, 0) == NULL);
+
+    memset(long_string, 'x', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+    root_value = json_value_init_object();
+    TEST(json_object_set_string(json_object(root_value), "s", long_string) == JSONSuccess);
+    TEST(json_object_dotset_number(json_object(root_value), "n.v", -0.0) == JSONSuccess);
+    memset(&stream, 0, sizeof(stream));
+    stream.chunk = 3;
+    TEST(json_value_to_msgpack_stream(root_value, test_stream_write, &stream) == JSONSuccess);
+    TEST(json_value_to_msgpack_stream(root_value, test_stream_write, &stream) == JSONSuccess);
+    TEST(stream.len > 2 * 300 && stream.data[3] == 0xda);
+    decoded = json_value_from_msgpack_stream(test_stream_read, &stream);
+    TEST(json_value_equals(root_value, decoded));
+    json_value_free(decoded);
+    decoded = json_value_from_msgpack_stream(test_stream_read, &stream);
+    TEST(json_value_equals(root_value, decoded));
+    json_value_free(decoded);
+    TEST(stream.pos == stream.len);
+    TEST(json_value_from_msgpack_stream(test_stream_read, &stream) == NULL);
+    json_value_free(root_value);
+    memset(&stream, 0, sizeof(stream));
+    stream.chunk = 3;
+    memcpy(stream.data, long_str, sizeof(long_str)); /* length of 4 GB without the data */
+    stream.len = sizeof(long_str);
+    malloc_largest = 0;
+    TEST(json_value_from_msgpack_stream(test_stream_read, &stream) == NULL);
+    TEST(malloc_largest < 65536);
+    TEST(malloc_count == 0);
+}
+
+static int cbor_encodes_to(const char *json, int canonical, const unsigned char *expected, size_t expected_size) {
+    JSON_Value *value = json_parse_string(json);
+    size_t size = 0;
+    unsigned char *encoded = canonical ? json_value_to_cbor_canonical(value, &size) : json_value_to_cbor(value, &size);
+    int result = encoded != NULL && size == expected_size && memcmp(encoded, expected, size) == 0;
+    json_free_cbor(encoded);
+    json_value_free(value);
+    return result;
+}
+
+static int cbor_decodes_to(const unsigned char *data, size_t size, const char *json) {
+    JSON_Value *decoded = json_value_from_cbor(data, size);
+    JSON_Value *expected = json_parse_string(json);
+    int result = decoded != NULL && json_value_equals(decoded, expected);
+    json_value_free(decoded);
+    json_value_free(expected);
+    return result;
+}
+
+void test_suite_22(void) {
+    const unsigned char integers[] = {
+        0x8b, 0x00, 0x17, 0x18, 0x18, 0x18, 0x64, 0x19, 0x03, 0xe8, 0x1a, 0x00, 0x0f, 0x42, 0x40,
+        0x1b, 0x00, 0x00, 0x00, 0xe8, 0xd4, 0xa5, 0x10, 0x00, 0x20, 0x29, 0x38, 0x63, 0x39, 0x03, 0xe7 };
+    const char *integers_json = "[0,23,24,100,1000,1000000,1000000000000,-1,-10,-100,-1000]";
+    const unsigned char floats[] = {
+        0x89, 0xf9, 0x3e, 0x00, 0xfa, 0x7f, 0x7f, 0xff, 0xff, 0xfb, 0x3f, 0xf1, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9a,
+        0xf9, 0x00, 0x01, 0xf9, 0x04, 0x00, 0xfb, 0xc0, 0x10, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+        0xf9, 0x80, 0x00, 0x19, 0xff, 0xe0, 0xfa, 0x47, 0xc3, 0x50, 0x40 };
+    const char *floats_json = "[1.5,3.4028234663852886e+38,1.1,5.960464477539063e-8,0.00006103515625,-4.1,-0.0,65504.0,100000.5]";
+    const unsigned char float_wide[] = { 0xfb, 0x3f, 0xf8, 0, 0, 0, 0, 0, 0 };
+    const unsigned char sorted[] = { 0xa3, 0x61, 'a', 0x03, 0x61, 'b', 0x02, 0x62, 'a', 'a', 0x01 };
+    const unsigned char unsorted[] = { 0xa3, 0x62, 'a', 'a', 0x01, 0x61, 'b', 0x02, 0x61, 'a', 0x03 };
+    const unsigned char indefinite_array[] = { 0x9f, 0x01, 0x82, 0x02, 0x03, 0x9f, 0x04, 0x05, 0xff, 0xff };
+    const unsigned char indefinite_map[] = { 0xbf, 0x61, 'a', 0x01, 0x61, 'b', 0x9f, 0x02, 0x03, 0xff, 0xff };
+    const unsigned char chunked[] = { 0x7f, 0x65, 's', 't', 'r', 'e', 'a', 0x64, 'm', 'i', 'n', 'g', 0xff };
+    const unsigned char tagged[] = { 0xc1, 0x1a, 0x51, 0x4b, 0x67, 0xb0 };
+    const unsigned char half_one[] = { 0xf9, 0x3c, 0x00 };
+    const unsigned char half_infinity[] = { 0xf9, 0x7c, 0x00 };
+    const unsigned char bytes[] = { 0x40 };
+    const unsigned char undefined[] = { 0xf7 };
+    const unsigned char int_key[] = { 0xa1, 0x01, 0x02 };
+    const unsigned char trailing[] = { 0x00, 0x00 };
+    const unsigned char no_break[] = { 0x9f, 0x01 };
+    const unsigned char truncated[] = { 0x82, 0x01 };
+    const unsigned char lone_break[] = { 0xff };
+    const unsigned char chunked_bytes[] = { 0x7f, 0x41, 'a', 0xff };
+    const unsigned char long_string[] = { 0x7b, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    JSON_Value *value = NULL, *other = NULL;
+    unsigned char *encoded = NULL, *other_encoded = NULL;
+    char *serialized = NULL;
+    size_t size = 0, other_size = 0;
+    malloc_count = 0;
+
+    TEST(cbor_encodes_to(integers_json, 0, integers, sizeof(integers)));
+    TEST(cbor_encodes_to(integers_json, 1, integers, sizeof(integers)));
+    TEST(cbor_decodes_to(integers, sizeof(integers), integers_json));
+    TEST(cbor_encodes_to(floats_json, 1, floats, sizeof(floats)));
+    TEST(cbor_decodes_to(floats, sizeof(floats), floats_json));
+    TEST(cbor_encodes_to("1.5", 0, float_wide, sizeof(float_wide)));
+    TEST(cbor_encodes_to("{\"aa\":1,\"b\":2,\"a\":3}", 1, sorted, sizeof(sorted)));
+    TEST(cbor_encodes_to("{\"aa\":1,\"b\":2,\"a\":3}", 0, unsorted, sizeof(unsorted)));
+
+    json_set_lazy_numbers(1);
+    value = json_parse_string("{\"b\":[1.0,\"x\"],\"a\":{\"d\":null,\"c\":true}}");
+    json_set_lazy_numbers(0);
+    other = json_parse_string("{\"a\":{\"c\":true,\"d\":null},\"b\":[1,\"x\"]}");
+    encoded = json_value_to_cbor_canonical(value, &size);
+    other_encoded = json_value_to_cbor_canonical(other, &other_size);
+    TEST(encoded != NULL && size == other_size && memcmp(encoded, other_encoded, size) == 0);
+    json_free_cbor(encoded);
+    json_free_cbor(other_encoded);
+    json_value_free(other);
+    encoded = json_value_to_cbor(value, &size);
+    other = json_value_from_cbor(encoded, size);
+    TEST(json_value_equals(value, other));
+    serialized = json_serialize_to_string(other);
+    TEST(STREQ(serialized, "{\"b\":[1.0,\"x\"],\"a\":{\"d\":null,\"c\":true}}"));
+    json_free_serialized_string(serialized);
+    json_free_cbor(encoded);
+    json_value_free(other);
+    json_value_free(value);
+
+    TEST(cbor_decodes_to(indefinite_array, sizeof(indefinite_array), "[1,[2,3],[4,5]]"));
+    TEST(cbor_decodes_to(indefinite_map, sizeof(indefinite_map), "{\"a\":1,\"b\":[2,3]}"));
+    TEST(cbor_decodes_to(chunked, sizeof(chunked), "\"streaming\""));
+    TEST(cbor_decodes_to(tagged, sizeof(tagged), "1363896240"));
+    value = json_value_from_cbor(half_one, sizeof(half_one));
+    serialized = json_serialize_to_string(value);
+    TEST(STREQ(serialized, "1.0"));
+    json_free_serialized_string(serialized);
+    json_value_free(value);
+    TEST(json_value_from_cbor(half_infinity, sizeof(half_infinity)) == NULL);
+    TEST(json_value_from_cbor(bytes, sizeof(bytes)) == NULL);
+    TEST(json_value_from_cbor(undefined, sizeof(undefined)) == NULL);
+    TEST(json_value_from_cbor(int_key, sizeof(int_key)) == NULL);
+    TEST(json_value_from_cbor(trailing, sizeof(trailing)) == NULL);
+    TEST(json_value_from_cbor(no_break, sizeof(no_break)) == NULL);
+    TEST(json_value_from_cbor(truncated, sizeof(truncated)) == NULL);
+    TEST(json_value_from_cbor(lone_break, sizeof(lone_break)) == NULL);
+    TEST(json_value_from_cbor(chunked_bytes, sizeof(chunked_bytes)) == NULL);
+    TEST(json_value_from_cbor(long_string, sizeof(long_string)) == NULL);
+    TEST(json_value_from_cbor(NULL, 0) == NULL);
+    TEST(json_value_to_cbor(NULL, &size) == NULL);
+    TEST(malloc_count == 0);
+}
+
+/* Compares snapshot value with JSON value recursively, including order of object's names */
+static int snapshot_matches(const JSON_Snapshot_Value *snapshot_value, const JSON_Value *value) {
+    size_t i = 0, count = 0;
+    const char *name = NULL;
+    if (json_snapshot_get_type(snapshot_value) != json_value_get_type(value)) {
+        return 0;
+    }
+    switch (json_value_get_type(value)) {
+        case JSONString:
+            return strcmp(json_snapshot_get_string(snapshot_value), json_value_get_string(value)) == 0
+                && json_snapshot_get_string_len(snapshot_value) == strlen(json_value_get_string(value));
+        case JSONNumber:
+            return json_snapshot_get_number(snapshot_value) == json_value_get_number(value);
+        case JSONBoolean:
+            return json_snapshot_get_boolean(snapshot_value) == json_value_get_boolean(value);
+        case JSONArray:
+            count = json_array_get_count(json_array(value));
+            for (i = 0; i < count; i++) {
+                if (!snapshot_matches(json_snapshot_get_value_at(snapshot_value, i), json_array_get_value(json_array(value), i))) {
+                    return 0;
+                }
+            }
+            return json_snapshot_get_count(snapshot_value) == count;
+        case JSONObject:
+            count = json_object_get_count(json_object(value));
+            for (i = 0; i < count; i++) {
+                name = json_object_get_name(json_object(value), i);
+                if (strcmp(json_snapshot_get_name_at(snapshot_value, i), name) != 0
+                    || !snapshot_matches(json_snapshot_get_value_at(snapshot_value, i), json_object_get_value_at(json_object(value), i))
+                    || json_snapshot_get_value(snapshot_value, name) != json_snapshot_get_value_at(snapshot_value, i)) {
+                    return 0;
+                }
+            }
+            return json_snapshot_get_count(snapshot_value) == count;
+        default:
+            return 1;
+    }
+}
+
+static void test_put_u32(unsigned char *bytes, size_t value) {
+    bytes[0] = (unsigned char)(value & 0xff);
+    bytes[1] = (unsigned char)((value >> 8) & 0xff);
+    bytes[2] = (unsigned char)((value >> 16) & 0xff);
+    bytes[3] = (unsigned char)((value >> 24) & 0xff);
+}
+
+/* Image with a string followed by levels arrays, each one referencing previous node twice */
+static size_t test_shared_snapshot(unsigned char *data, size_t levels) {
+    size_t size = 16 + 12 + levels * 16, i = 0, offset = 28;
+    memcpy(data, "PJSN", 4);
+    test_put_u32(data + 4, 1);
+    test_put_u32(data + 8, size);
+    test_put_u32(data + 12, size - 16);
+    test_put_u32(data + 16, JSONString);
+    test_put_u32(data + 20, 3);
+    memcpy(data + 24, "abc", 4);
+    for (i = 0; i < levels; i++, offset += 16) {
+        test_put_u32(data + offset, JSONArray);
+        test_put_u32(data + offset + 4, 2);
+        test_put_u32(data + offset + 8, i == 0 ? 12 : 16);
+        test_put_u32(data + offset + 12, i == 0 ? 12 : 16);
+    }
+    return size;
+}
+
+void test_suite_23(void) {
+    const char *filename = "tests/test_snapshot.bin";
+    JSON_Value *root_value = NULL;
+    JSON_Array *records = NULL;
+    JSON_Snapshot *snapshot = NULL, *previous = NULL;
+    const JSON_Snapshot_Value *root = NULL;
+    unsigned char data[4096];
+    size_t size = 0, i = 0;
+    FILE *fp = NULL;
+    malloc_count = 0;
+
+    root_value = json_parse_file("tests/test_2.txt");
+    TEST(json_snapshot_write(root_value, filename) == JSONSuccess);
+    snapshot = json_snapshot_open(filename);
+    TEST(snapshot != NULL);
+    root = json_snapshot_root(snapshot);
+    TEST(snapshot_matches(root, root_value));
+    TEST(STREQ(json_snapshot_get_string(json_snapshot_dotget_value(root, "object.nested string")), "str"));
+    TEST(STREQ(json_snapshot_get_string(json_snapshot_dotget_value(root, "object.nested object.lorem")), "ipsum"));
+    TEST(json_snapshot_get_string_len(json_snapshot_get_value(root, "utf-8 string")) == 15);
+    TEST(json_snapshot_get_number(json_snapshot_get_value(root, "hard to parse number")) == -3.14e-4);
+    TEST(json_snapshot_get_boolean(json_snapshot_get_value(root, "boolean true")) == 1);
+    TEST(json_snapshot_get_boolean(json_snapshot_get_value(root, "null")) == -1);
+    TEST(json_snapshot_get_type(json_snapshot_get_value(root, "null")) == JSONNull);
+    TEST(json_snapshot_get_count(json_snapshot_get_value(root, "x^2 array")) == 11);
+    TEST(json_snapshot_get_count(json_snapshot_get_value(root, "empty object")) == 0);
+    TEST(json_snapshot_get_value(root, "missing") == NULL);
+    TEST(json_snapshot_get_value(root, "objec") == NULL);
+    TEST(json_snapshot_dotget_value(root, "object.missing.lorem") == NULL);
+    TEST(json_snapshot_dotget_value(root, "string.lorem") == NULL);
+    TEST(json_snapshot_get_value_at(root, json_snapshot_get_count(root)) == NULL);
+    TEST(json_snapshot_get_name_at(json_snapshot_get_value(root, "string array"), 0) == NULL);
+    previous = snapshot;
+    json_value_free(root_value);
+
+    root_value = json_value_init_array(); /* names are stored once */
+    records = json_array(root_value);
+    for (i = 0; i < 50; i++) {
+        TEST(json_array_append_value(records, json_value_init_object()) == JSONSuccess);
+        TEST(json_object_set_number(json_array_get_object(records, i), "a rather long name of a field", (double)i) == JSONSuccess);
+    }
+    TEST(json_snapshot_write(root_value, filename) == JSONSuccess);
+    TEST(STREQ(json_snapshot_get_string(json_snapshot_dotget_value(root, "object.nested string")), "str")); /* replaced, not overwritten */
+    json_snapshot_close(previous);
+    fp = fopen("tests/test_snapshot.bin.tmp", "rb");
+    TEST(fp == NULL);
+    fp = fopen(filename, "rb");
+    size = fread(data, 1, sizeof(data), fp);
+    fclose(fp);
+    TEST(size < 50 * 40);
+    snapshot = json_snapshot_open_buffer(data, size);
+    TEST(snapshot_matches(json_snapshot_root(snapshot), root_value));
+    TEST(json_snapshot_get_number(json_snapshot_dotget_value(json_snapshot_get_value_at(json_snapshot_root(snapshot), 7),
+                                                             "a rather long name of a field")) == 7);
+    json_snapshot_close(snapshot);
+    json_value_free(root_value);
+
+    TEST(json_snapshot_open_buffer(data, size - 4) == NULL);
+    data[size - 8] = 0xff; /* distance of last record */
+    TEST(json_snapshot_open_buffer(data, size) == NULL);
+    data[0] = 'X';
+    TEST(json_snapshot_open_buffer(data, size) == NULL);
+
+    size = test_shared_snapshot(data, 1); /* shared strings are checked once */
+    snapshot = json_snapshot_open_buffer(data, size);
+    TEST(json_snapshot_get_count(json_snapshot_root(snapshot)) == 2);
+    TEST(STREQ(json_snapshot_get_string(json_snapshot_get_value_at(json_snapshot_root(snapshot), 1)), "abc"));
+    json_snapshot_close(snapshot);
+    size = test_shared_snapshot(data, 60); /* shared arrays would take 2^60 checks */
+    TEST(json_snapshot_open_buffer(data, size) == NULL);
+    TEST(json_snapshot_open("tests/test_2.txt") == NULL);
+    TEST(json_snapshot_open("tests/missing.bin") == NULL);
+    TEST(json_snapshot_write(NULL, filename) == JSONFailure);
+    root_value = json_value_init_array();
+    TEST(json_snapshot_write(root_value, "tests") == JSONFailure); /* directory can't be replaced */
+    fp = fopen("tests.tmp", "rb");
+    TEST(fp == NULL);
+    json_value_free(root_value);
+    TEST(json_snapshot_root(NULL) == NULL);
+    TEST(json_snapshot_get_type(NULL) == JSONError);
+    remove(filename);
+    TEST(malloc_count == 0);
+}
+
+static int tape_matches(JSON_Cursor cursor, const JSON_Value *value) {
+    size_t i = 0, count = 0;
+    JSON_Cursor item;
+    if (json_cursor_get_type(cursor) != json_value_get_type(value)) {
+        return 0;
+    }
+    switch (json_value_get_type(value)) {
+        case JSONString:
+            return strcmp(json_cursor_get_string(cursor), json_value_get_string(value)) == 0
+                && json_cursor_get_string_len(cursor) == strlen(json_value_get_string(value));
+        case JSONNumber:
+            return json_cursor_get_number(cursor) == json_value_get_number(value);
+        case JSONBoolean:
+            return json_cursor_get_boolean(cursor) == json_value_get_boolean(value);
+        case JSONArray:
+            count = json_array_get_count(json_array(value));
+            for (item = json_cursor_first(cursor); i < count; item = json_cursor_next(item), i++) {
+                if (!tape_matches(item, json_array_get_value(json_array(value), i))) {
+                    return 0;
+                }
+            }
+            return item.tape == NULL && json_cursor_get_count(cursor) == count;
+        case JSONObject:
+            count = json_object_get_count(json_object(value));
+            for (item = json_cursor_first(cursor); i < count; item = json_cursor_next(item), i++) {
+                if (json_cursor_get_name(item) == NULL
+                    || strcmp(json_cursor_get_name(item), json_object_get_name(json_object(value), i)) != 0
+                    || !tape_matches(item, json_object_get_value_at(json_object(value), i))) {
+                    return 0;
+                }
+            }
+            return item.tape == NULL && json_cursor_get_count(cursor) == count;
+        default:
+            return 1;
+    }
+}
+
+void test_suite_24(void) {
+    JSON_Value *root_value = NULL, *copy = NULL;
+    JSON_Tape *tape = NULL;
+    JSON_Cursor root, cursor;
+    double sum = 0;
+    malloc_count = 0;
+
+    root_value = json_parse_file("tests/test_2.txt");
+    tape = json_tape_parse_file("tests/test_2.txt");
+    TEST(tape != NULL);
+    root = json_tape_root(tape);
+    TEST(tape_matches(root, root_value));
+    TEST(json_cursor_get_name(root) == NULL);
+    TEST(STREQ(json_cursor_get_string(json_cursor_dotget_value(root, "object.nested string")), "str"));
+    TEST(STREQ(json_cursor_get_string(json_cursor_dotget_value(root, "object.nested object.lorem")), "ipsum"));
+    TEST(json_cursor_get_string_len(json_cursor_get_value(root, "utf-8 string")) == 15);
+    TEST(json_cursor_get_number(json_cursor_get_value(root, "hard to parse number")) == -3.14e-4);
+    TEST(json_cursor_get_boolean(json_cursor_get_value(root, "boolean true")) == 1);
+    TEST(json_cursor_get_boolean(json_cursor_get_value(root, "boolean false")) == 0);
+    TEST(json_cursor_get_boolean(json_cursor_get_value(root, "null")) == -1);
+    TEST(json_cursor_get_type(json_cursor_get_value(root, "null")) == JSONNull);
+    TEST(json_cursor_get_type(json_cursor_get_value(root, "missing")) == JSONError);
+    TEST(json_cursor_get_type(json_cursor_dotget_value(root, "object.missing.lorem")) == JSONError);
+    TEST(json_cursor_get_type(json_cursor_dotget_value(root, "string.lorem")) == JSONError);
+    TEST(json_cursor_get_count(json_cursor_get_value(root, "empty object")) == 0);
+    TEST(json_cursor_get_type(json_cursor_first(json_cursor_get_value(root, "empty array"))) == JSONError);
+    TEST(json_cursor_get_number(json_cursor_get_value_at(json_cursor_get_value(root, "x^2 array"), 3)) == 9);
+    TEST(json_cursor_get_type(json_cursor_get_value_at(root, json_cursor_get_count(root))) == JSONError);
+    for (cursor = json_cursor_first(json_cursor_get_value(root, "x^2 array")); cursor.tape != NULL;
+         cursor = json_cursor_next(cursor)) {
+        sum += json_cursor_get_number(cursor);
+    }
+    TEST(sum == 385);
+    copy = json_cursor_to_value(root);
+    TEST(json_value_equals(copy, root_value));
+    json_value_free(copy);
+    copy = json_cursor_to_value(json_cursor_get_value(root, "object"));
+    TEST(json_value_equals(copy, json_object_get_value(json_object(root_value), "object")));
+    json_value_free(copy);
+    json_tape_free(tape);
+    json_value_free(root_value);
+
+    tape = json_tape_parse_string("{\"a\":1,\"a\":2}"); /* duplicates are kept, lookups find first */
+    TEST(json_cursor_get_number(json_cursor_get_value(json_tape_root(tape), "a")) == 1);
+    TEST(json_cursor_to_value(json_tape_root(tape)) == NULL);
+    json_tape_free(tape);
+
+    tape = json_tape_parse_string("\xEF\xBB\xBF\"\\u00e9\"");
+    TEST(STREQ(json_cursor_get_string(json_tape_root(tape)), "\xc3\xa9"));
+    json_tape_free(tape);
+
+    TEST(json_tape_parse_string("[1,2,]") == NULL);
+    TEST(json_tape_parse_string("{\"a\":tru}") == NULL);
+    TEST(json_tape_parse_string("{\"a\" 1}") == NULL);
+    TEST(json_tape_parse_string("[\"a\"") == NULL);
+    TEST(json_tape_parse_string("") == NULL);
+    TEST(json_tape_parse_file("tests/missing.json") == NULL);
+    TEST(json_cursor_get_type(json_tape_root(NULL)) == JSONError);
+    TEST(malloc_count == 0);
+}
+
+static int lines_next_is(JSON_Lines *lines, const char *json) {
+    JSON_Value *value = json_lines_next(lines);
+    JSON_Value *expected = json_parse_string(json);
+    int result = value != NULL && json_value_equals(value, expected);
+    json_value_free(value);
+    json_value_free(expected);
+    return result;
+}
+
+/* 2000 lines opening arrays followed by 50000 lines of "1,", every line is bad and has to be
+   rejected without parsing the rest of text */
+#define TEST_OPEN_LINES_SIZE (2000 * 2 + 50000 * 3 + 1)
+static void test_open_lines(char *text) {
+    size_t i = 0;
+    for (i = 0; i < 2000; i++) {
+        memcpy(text + i * 2, "[\n", 2);
+    }
+    for (i = 0; i < 50000; i++) {
+        memcpy(text + 2000 * 2 + i * 3, "1,\n", 3);
+    }
+    text[TEST_OPEN_LINES_SIZE - 1] = '\0';
+}
+
+void test_suite_25(void) {
+    const char *filename = "tests/test_lines.ndjson";
+    const char *text = "\xEF\xBB\xBF{\"a\":1}\n\n[1, 2]\r\nbad\n{\"x\":\n1}\n\"s\"";
+    const char *raw_text = "{\"a\":\r\n 1, \"b\": \"x y\"}";
+    static char long_string[100001];
+    static char open_lines[TEST_OPEN_LINES_SIZE];
+    JSON_Lines *lines = NULL;
+    JSON_Lines_Writer *writer = NULL;
+    JSON_Value *value = NULL;
+    Test_Stream stream;
+    size_t i = 0, count = 0;
+    double sum = 0;
+    malloc_count = 0;
+
+    lines = json_lines_open_string(text);
+    TEST(lines_next_is(lines, "{\"a\":1}"));
+    TEST(json_lines_get_line(lines) == 1);
+    TEST(lines_next_is(lines, "[1,2]"));
+    TEST(json_lines_get_line(lines) == 3);
+    TEST(json_lines_next(lines) == NULL);
+    TEST(json_lines_get_error_line(lines) == 4);
+    TEST(json_lines_next(lines) == NULL); /* values can't span lines */
+    TEST(json_lines_get_error_line(lines) == 5);
+    TEST(json_lines_next(lines) == NULL);
+    TEST(json_lines_get_error_line(lines) == 6);
+    TEST(lines_next_is(lines, "\"s\""));
+    TEST(json_lines_next(lines) == NULL);
+    TEST(json_lines_get_error_line(lines) == 0);
+    TEST(json_lines_get_error_count(lines) == 3);
+    json_lines_close(lines);
+
+    memset(&stream, 0, sizeof(stream));
+    stream.len = strlen(text);
+    memcpy(stream.data, text, stream.len);
+    stream.chunk = 3;
+    lines = json_lines_open_stream(test_stream_read, &stream);
+    json_lines_set_skip_errors(lines, 1);
+    while ((value = json_lines_next(lines)) != NULL) {
+        count++;
+        json_value_free(value);
+    }
+    TEST(count == 3);
+    TEST(json_lines_get_line(lines) == 7);
+    TEST(json_lines_get_error_line(lines) == 0);
+    TEST(json_lines_get_error_count(lines) == 3);
+    json_lines_close(lines);
+
+    test_open_lines(open_lines);
+    lines = json_lines_open_string(open_lines);
+    json_lines_set_skip_errors(lines, 1);
+    TEST(json_lines_next(lines) == NULL);
+    TEST(json_lines_get_error_count(lines) == 52000);
+    json_lines_close(lines);
+
+    memset(&stream, 0, sizeof(stream));
+    writer = json_lines_writer_open_stream(test_stream_write, &stream);
+    value = json_parse_string("{\"a\": [1, true, null]}");
+    TEST(json_lines_write(writer, value) == JSONSuccess);
+    TEST(json_lines_write(writer, value) == JSONSuccess);
+    TEST(stream.len == 0); /* writes are batched */
+    TEST(json_lines_writer_flush(writer) == JSONSuccess);
+    TEST(json_lines_write(writer, NULL) == JSONFailure);
+    TEST(json_lines_writer_close(writer) == JSONSuccess);
+    json_value_free(value);
+    TEST(stream.len == 40 && memcmp(stream.data, "{\"a\":[1,true,null]}\n{\"a\":[1,true,null]}\n", 40) == 0);
+
+    memset(&stream, 0, sizeof(stream)); /* raw fragments are written on one line */
+    writer = json_lines_writer_open_stream(test_stream_write, &stream);
+    value = json_value_init_array();
+    TEST(json_array_append_value(json_array(value), json_value_init_raw(raw_text, strlen(raw_text))) == JSONSuccess);
+    TEST(json_lines_write(writer, value) == JSONSuccess);
+    TEST(json_lines_writer_close(writer) == JSONSuccess);
+    json_value_free(value);
+    TEST(stream.len == 23 && memcmp(stream.data, "[{\"a\": 1, \"b\": \"x y\"}]\n", 23) == 0);
+
+    remove(filename);
+    writer = json_lines_writer_open_file(filename);
+    for (i = 0; i < 1000; i++) {
+        value = json_value_init_object();
+        json_object_set_number(json_object(value), "i", (double)i);
+        json_lines_write(writer, value);
+        json_value_free(value);
+    }
+    TEST(json_lines_writer_close(writer) == JSONSuccess); /* failures are reported when closing */
+    memset(long_string, 'x', sizeof(long_string) - 1); /* longer than reading buffer */
+    writer = json_lines_writer_open_file(filename); /* appends */
+    value = json_value_init_string(long_string);
+    TEST(json_lines_write(writer, value) == JSONSuccess);
+    TEST(json_lines_writer_close(writer) == JSONSuccess);
+    json_value_free(value);
+    lines = json_lines_open_file(filename);
+    count = 0;
+    while (count < 1000 && (value = json_lines_next(lines)) != NULL) {
+        sum += json_object_get_number(json_object(value), "i");
+        count++;
+        json_value_free(value);
+    }
+    TEST(count == 1000 && sum == 499500);
+    value = json_lines_next(lines);
+    TEST(strlen(json_value_get_string(value)) == sizeof(long_string) - 1);
+    json_value_free(value);
+    TEST(json_lines_next(lines) == NULL);
+    TEST(json_lines_get_error_count(lines) == 0);
+    json_lines_close(lines);
+    remove(filename);
+
+    TEST(json_lines_open_file("tests/missing.ndjson") == NULL);
+    TEST(json_lines_open_fd(-1) == NULL);
+    TEST(json_lines_writer_open_fd(-1) == NULL);
+    TEST(json_lines_next(NULL) == NULL);
+    TEST(malloc_count == 0);
+}
+
+/* Lines are {"i":line} except for every 1000th line, which is bad */
+typedef struct test_lines_result_t {
+    size_t count;
+    size_t errors;
+    size_t last_line;
+    size_t limit; /* callback fails after this many values */
+    int    in_order;
+    int    lines_match;
+} Test_Lines_Result;
+
+static JSON_Status test_lines_callback(JSON_Value *value, size_t line, void *arg) {
+    Test_Lines_Result *result = (Test_Lines_Result*)arg;
+    if (value == NULL) {
+        result->errors++;
+        result->lines_match = result->lines_match && line % 1000 == 0;
+    } else {
+        result->count++;
+        result->lines_match = result->lines_match && json_object_get_number(json_object(value), "i") == (double)line;
+        json_value_free(value);
+    }
+    result->in_order = result->in_order && line > result->last_line;
+    result->last_line = line;
+    return result->count == result->limit ? JSONFailure : JSONSuccess;
+}
+
+static Test_Lines_Result test_lines_parse(const char *string, size_t threads_count, int ordered, size_t limit) {
+    Test_Lines_Result result;
+    memset(&result, 0, sizeof(result));
+    result.limit = limit;
+    result.in_order = 1;
+    result.lines_match = 1;
+    if (json_lines_parse_parallel(string, threads_count, ordered, test_lines_callback, &result) != JSONSuccess) {
+        result.limit = 0;
+    }
+    return result;
+}
+
+void test_suite_26(void) {
+    static char text[300000];
+    size_t line = 0, len = 0;
+    Test_Lines_Result result;
+    json_set_allocation_functions(malloc, free); /* counting allocations isn't thread-safe */
+
+    for (line = 1; line <= 20000; line++) {
+        if (line % 1000 == 0) {
+            len += sprintf(text + len, "bad\n");
+        } else if (line % 7 == 0) {
+            len += sprintf(text + len, "  {\"i\": %lu}\r\n", (unsigned long)line);
+        } else {
+            len += sprintf(text + len, "{\"i\":%lu}\n", (unsigned long)line);
+        }
+    }
+    text[len - 1] = '\0'; /* last line without newline */
+
+    result = test_lines_parse(text, 4, 1, 0);
+    TEST(result.count == 19980 && result.errors == 20 && result.lines_match && result.in_order);
+    result = test_lines_parse(text, 4, 0, 0);
+    TEST(result.count == 19980 && result.errors == 20 && result.lines_match);
+    result = test_lines_parse(text, 0, 1, 0);
+    TEST(result.count == 19980 && result.errors == 20 && result.lines_match && result.in_order);
+    result = test_lines_parse(text, 1, 1, 0);
+    TEST(result.count == 19980 && result.errors == 20 && result.lines_match && result.in_order);
+    result = test_lines_parse(text, 3, 1, 5000); /* stops */
+    TEST(result.limit == 0 && result.count == 5000 && result.in_order);
+    result = test_lines_parse(text, 3, 0, 5000);
+    TEST(result.limit == 0 && result.count == 5000);
+    result = test_lines_parse(text, 1, 1, 5000);
+    TEST(result.limit == 0 && result.count == 5000);
+    test_open_lines(text); /* limit isn't 0, because count stays 0 */
+    result = test_lines_parse(text, 4, 1, 1);
+    TEST(result.count == 0 && result.errors == 52000 && result.in_order);
+    result = test_lines_parse(text, 1, 1, 1);
+    TEST(result.count == 0 && result.errors == 52000);
+    result = test_lines_parse("\n\n", 2, 1, 0);
+    TEST(result.count == 0 && result.errors == 0);
+    result = test_lines_parse("", 2, 0, 0);
+    TEST(result.count == 0 && result.errors == 0);
+    TEST(json_lines_parse_parallel(NULL, 2, 1, test_lines_callback, &result) == JSONFailure);
+    TEST(json_lines_parse_parallel(text, 2, 1, NULL, NULL) == JSONFailure);
+
+    json_set_allocation_functions(counted_malloc, counted_free);
+}
+
+static int parallel_parse_matches(const char *string, size_t threads_count) {
+    JSON_Value *parallel = json_parse_string_parallel(string, threads_count);
+    JSON_Value *expected = json_parse_string(string);
+    int result = parallel == NULL ? expected == NULL : json_value_equals(parallel, expected);
+    json_value_free(parallel);
+    json_value_free(expected);
+    return result;
+}
+
+void test_suite_27(void) {
+    static char text[700000];
+    size_t i = 0, len = 0;
+    JSON_Value *value = NULL;
+    json_set_allocation_functions(malloc, free); /* counting allocations isn't thread-safe */
+
+    len = sprintf(text, "\xEF\xBB\xBF [");
+    for (i = 0; i < 6000; i++) { /* strings with brackets, commas and escapes */
+        len += sprintf(text + len, "%s{\"id\": %lu, \"s\": \"a,b]\\\"}[,\", \"t\": [1, {\"x\": \"]\\\\\"}, []], \"e\": {}}",
+                       i == 0 ? "" : ",\n  ", (unsigned long)i);
+        len += sprintf(text + len, ", \"%lu,]\", %lu.5, [[[\"[\"]]], null, true", (unsigned long)i, (unsigned long)i);
+    }
+    strcpy(text + len, "]\n");
+
+    value = json_parse_string_parallel(text, 4);
+    TEST(json_array_get_count(json_array(value)) == 36000);
+    TEST(STREQ(json_array_get_string(json_array(value), 35995), "5999,]"));
+    TEST(json_array_get_count(json_object_get_array(json_array_get_object(json_array(value), 6), "t")) == 3);
+    TEST(json_object_get_number(json_array_get_object(json_array(value), 6), "id") == 1);
+    json_value_free(value);
+    TEST(parallel_parse_matches(text, 4));
+    TEST(parallel_parse_matches(text, 3));
+    TEST(parallel_parse_matches(text, 0));
+    TEST(parallel_parse_matches(text, 1));
+    json_set_lazy_parsing(1);
+    TEST(parallel_parse_matches(text, 4));
+    json_set_lazy_parsing(0);
+
+    strcpy(text + len, ",]"); /* trailing comma */
+    TEST(json_parse_string_parallel(text, 4) == NULL);
+    text[len] = '\0'; /* not closed */
+    TEST(json_parse_string_parallel(text, 4) == NULL);
+    strcpy(text + len, "]");
+    for (i = 1; i < 8; i++) { /* breaks strings or structure in different chunks */
+        text[len * i / 8] = '\"';
+        TEST(parallel_parse_matches(text, 4));
+    }
+
+    TEST(parallel_parse_matches("[]", 4));
+    TEST(parallel_parse_matches(" [ ] ", 4));
+    TEST(parallel_parse_matches("[1,2,3]", 4));
+    TEST(parallel_parse_matches("[1,2,]", 4));
+    TEST(parallel_parse_matches("[1 2]", 4));
+    TEST(json_parse_string_parallel("[1,2}", 4) == NULL);
+    TEST(json_parse_string_parallel("[{\"a\":1}}", 4) == NULL);
+    TEST(json_parse_string_parallel("[[1},2]", 4) == NULL);
+    TEST(parallel_parse_matches("[\"a]\", {\"b\": \"[\"}] trailing", 4));
+    TEST(parallel_parse_matches("{\"a\": [1, 2]}", 4));
+    TEST(parallel_parse_matches("\"[1, 2]\"", 4));
+    TEST(parallel_parse_matches("[1, \"2", 4));
+    value = json_parse_file_parallel("tests/test_1_2.txt", 4); /* over 2048 levels of nesting */
+    TEST(value == NULL);
+    value = json_parse_file_parallel("tests/test_2.txt", 4);
+    TEST(json_value_get_type(value) == JSONObject);
+    json_value_free(value);
+    TEST(json_parse_string_parallel(NULL, 4) == NULL);
+
+    json_set_allocation_functions(counted_malloc, counted_free);
+}
+
+static int batch_results_match(const JSON_Input *inputs, JSON_Value **results, size_t count) {
+    JSON_Value *expected = NULL;
+    size_t i = 0;
+    int result = 1;
+    for (i = 0; i < count; i++) {
+        expected = inputs[i].type == JSONInputString ? json_parse_string(inputs[i].data) :
+                   inputs[i].type == JSONInputFile ? json_parse_file(inputs[i].data) : NULL;
+        result = result && (results[i] == NULL ? expected == NULL : json_value_equals(results[i], expected));
+        json_value_free(expected);
+        json_value_free(results[i]);
+        results[i] = NULL;
+    }
+    return result;
+}
+
+void test_suite_28(void) {
+    static JSON_Input inputs[600];
+    static JSON_Value *results[600];
+    const char *strings[] = { "{\"a\": [1, 2, {\"b\": null}]}", "[1, 2", "\xEF\xBB\xBF\"bom\"" };
+    const char *files[] = { "tests/test_2.txt", "tests/test_1_1.txt", "tests/missing.json" };
+    size_t i = 0;
+    json_set_allocation_functions(malloc, free); /* counting allocations isn't thread-safe */
+
+    for (i = 0; i < 600; i++) {
+        inputs[i].type = i % 7 == 6 ? JSONInputFd : (i % 2 == 0 ? JSONInputString : JSONInputFile);
+        inputs[i].data = i % 2 == 0 ? strings[i % 3] : files[i % 3];
+        inputs[i].fd = -1;
+    }
+    TEST(json_parse_batch(inputs, 600, results, 4) == JSONFailure);
+    TEST(batch_results_match(inputs, results, 600));
+    TEST(json_parse_batch(inputs, 600, results, 0) == JSONFailure);
+    TEST(batch_results_match(inputs, results, 600));
+    TEST(json_parse_batch(inputs, 600, results, 1) == JSONFailure);
+    TEST(batch_results_match(inputs, results, 600));
+    TEST(json_parse_batch(inputs, 5, results, 16) == JSONFailure);
+    TEST(batch_results_match(inputs, results, 5));
+
+    for (i = 0; i < 600; i++) {
+        inputs[i].type = i % 2 == 0 ? JSONInputString : JSONInputFile;
+        inputs[i].data = i % 2 == 0 ? strings[0] : files[i % 2];
+    }
+    TEST(json_parse_batch(inputs, 600, results, 3) == JSONSuccess);
+    TEST(batch_results_match(inputs, results, 600));
+    TEST(json_parse_batch(inputs, 0, results, 3) == JSONSuccess);
+    TEST(json_parse_batch(NULL, 1, results, 3) == JSONFailure);
+
+    json_set_allocation_functions(counted_malloc, counted_free);
+}
+
+typedef struct test_load_result_t {
+    size_t loaded;
+    size_t failed;
+    int    values_match;
+} Test_Load_Result;
+
+static void test_load_callback(const char *filename, JSON_Value *value, void *arg) {
+    Test_Load_Result *result = (Test_Load_Result*)arg;
+    JSON_Value *expected = json_parse_file(filename);
+    if (value == NULL) {
+        result->failed++;
+        result->values_match = result->values_match && expected == NULL;
+    } else {
+        result->loaded++;
+        result->values_match = result->values_match && json_value_equals(value, expected);
+    }
+    json_value_free(expected);
+    json_value_free(value);
+}
+
+void test_suite_29(void) {
+    const char *files[] = { "tests/test_2.txt", "tests/test_1_1.txt", "tests/missing.json", "tests/test_5.txt" };
+    JSON_Load *loads[40];
+    JSON_Loader *loader = NULL;
+    JSON_Value *value = NULL, *expected = NULL;
+    Test_Load_Result result;
+    size_t i = 0, ready = 0;
+    int values_match = 1;
+    json_set_allocation_functions(malloc, free); /* counting allocations isn't thread-safe */
+
+    memset(&result, 0, sizeof(result));
+    result.values_match = 1;
+    loader = json_loader_create(1); /* callbacks are called on one thread */
+    for (i = 0; i < 40; i++) {
+        json_loader_submit(loader, files[i % 4], test_load_callback, &result);
+    }
+    TEST(json_loader_submit(loader, files[0], NULL, NULL) == JSONFailure);
+    TEST(json_loader_submit(loader, NULL, test_load_callback, &result) == JSONFailure);
+    json_loader_free(loader); /* finishes submitted requests */
+    TEST(result.loaded == 30 && result.failed == 10 && result.values_match);
+
+    loader = json_loader_create(1); /* one thread takes requests in order */
+    for (i = 0; i < 40; i++) {
+        loads[i] = json_loader_load(loader, files[i % 4]);
+    }
+    json_value_free(json_load_get(loads[39]));
+    for (i = 0; i < 39; i++) { /* loaded before the last one */
+        ready += json_load_is_ready(loads[i]);
+    }
+    TEST(ready == 39);
+    for (i = 0; i < 39; i++) {
+        json_value_free(json_load_get(loads[i]));
+    }
+    json_loader_free(loader);
+
+#if !defined(PARSON_THREADS) || !PARSON_THREADS
+    loader = json_loader_create(0); /* without threads files are loaded by json_loader_load */
+    ready = 0;
+    for (i = 0; i < 4; i++) {
+        loads[i] = json_loader_load(loader, files[i]);
+        ready += json_load_is_ready(loads[i]);
+    }
+    TEST(ready == 4);
+    for (i = 0; i < 4; i++) {
+        json_value_free(json_load_get(loads[i]));
+    }
+    json_loader_free(loader);
+#endif
+
+    loader = json_loader_create(4);
+    for (i = 0; i < 40; i++) {
+        loads[i] = json_loader_load(loader, files[i % 4]);
+    }
+    for (i = 0; i < 40; i++) {
+        value = json_load_get(loads[i]);
+        expected = json_parse_file(files[i % 4]);
+        values_match = values_match && (value == NULL ? expected == NULL : json_value_equals(value, expected));
+        json_value_free(value);
+        json_value_free(expected);
+    }
+    TEST(values_match);
+    loads[0] = json_loader_load(loader, files[0]);
+    loads[1] = json_loader_load(loader, files[1]);
+    json_loader_free(loader); /* frees handles that weren't collected */
+
+    loader = json_loader_create(0);
+    TEST(json_loader_load(loader, NULL) == NULL);
+    TEST(json_load_get(NULL) == NULL);
+    TEST(json_load_is_ready(NULL) == 0);
+    json_loader_free(loader);
+
+    json_set_allocation_functions(counted_malloc, counted_free);
+}
+
+static int parallel_serialization_matches(const JSON_Value *value, size_t threads_count) {
+    char *parallel = json_serialize_to_string_parallel(value, threads_count);
+    char *expected = json_serialize_to_string(value);
+    char *parallel_pretty = json_serialize_to_string_pretty_parallel(value, threads_count);
+    char *expected_pretty = json_serialize_to_string_pretty(value);
+    int result = (parallel == NULL ? expected == NULL : expected != NULL && STREQ(parallel, expected)) &&
+                 (parallel_pretty == NULL ? expected_pretty == NULL : expected_pretty != NULL && STREQ(parallel_pretty, expected_pretty));
+    json_free_serialized_string(parallel);
+    json_free_serialized_string(expected);
+    json_free_serialized_string(parallel_pretty);
+    json_free_serialized_string(expected_pretty);
+    return result;
+}
+
+void test_suite_30(void) {
+    static char text[400000];
+    size_t i = 0, len = 0;
+    JSON_Value *value = NULL, *lazy_value = NULL;
+    char *serialized = NULL, *expected = NULL;
+    json_set_allocation_functions(malloc, free); /* counting allocations isn't thread-safe */
+
+    len = sprintf(text, "[");
+    for (i = 0; i < 3000; i++) {
+        len += sprintf(text + len, "%s{\"id\": %lu, \"s\": \"a\\\"\\n\\u00e9\", \"t\": [1.5, {\"x\": []}], \"e\": {}}, \"%lu\", null, true",
+                       i == 0 ? "" : ", ", (unsigned long)i, (unsigned long)i);
+    }
+    strcpy(text + len, "]");
+    value = json_parse_string(text);
+    TEST(json_array_get_count(json_array(value)) == 12000);
+    serialized = json_serialize_to_string_parallel(value, 4);
+    expected = json_serialize_to_string(value);
+    TEST(serialized != NULL && expected != NULL && STREQ(serialized, expected));
+    json_free_serialized_string(serialized);
+    json_free_serialized_string(expected);
+    TEST(parallel_serialization_matches(value, 4));
+    TEST(parallel_serialization_matches(value, 3));
+    TEST(parallel_serialization_matches(value, 0));
+    TEST(parallel_serialization_matches(value, 1));
+    json_set_serialization_cache(1);
+    TEST(parallel_serialization_matches(value, 4));
+    json_set_serialization_cache(0);
+    json_value_free(value);
+
+    value = json_value_init_object();
+    for (i = 0; i < 5000; i++) {
+        sprintf(text, "key \"%lu\"\t", (unsigned long)i);
+        json_object_set_number(json_object(value), text, (double)i / 3);
+    }
+    json_object_set_value(json_object(value), "nested", json_parse_string("{\"a\": [1, [2, {\"b\": \"/\"}]]}"));
+    TEST(parallel_serialization_matches(value, 4));
+    TEST(parallel_serialization_matches(value, 7));
+    json_value_free(value);
+
+    len = sprintf(text, "{");
+    for (i = 0; i < 2000; i++) {
+        len += sprintf(text + len, "%s\"k%lu\" : [ {\"a\" : [ 1 , 2.50 ] } , \"b\" ]", i == 0 ? "" : " , ", (unsigned long)i);
+    }
+    strcpy(text + len, "}");
+    json_set_lazy_parsing(1); /* lazy values are parsed by calling thread */
+    value = json_parse_string(text);
+    lazy_value = json_parse_string(text);
+    json_set_lazy_parsing(0);
+    serialized = json_serialize_to_string_pretty_parallel(lazy_value, 4);
+    expected = json_serialize_to_string_pretty(value);
+    TEST(serialized != NULL && expected != NULL && STREQ(serialized, expected));
+    json_free_serialized_string(serialized);
+    json_free_serialized_string(expected);
+    TEST(parallel_serialization_matches(lazy_value, 4));
+    json_value_free(value);
+    json_value_free(lazy_value);
+
+    value = json_parse_string("[1, \"2\", [3]]");
+    TEST(parallel_serialization_matches(value, 64)); /* more threads than items */
+    json_value_free(value);
+    value = json_parse_string("[1]");
+    TEST(parallel_serialization_matches(value, 4));
+    json_value_free(value);
+    value = json_parse_string("{}");
+    TEST(parallel_serialization_matches(value, 4));
+    json_value_free(value);
+    value = json_parse_string("\"a\\u0000b\"");
+    TEST(parallel_serialization_matches(value, 4));
+    json_value_free(value);
+    TEST(json_serialize_to_string_parallel(NULL, 4) == NULL);
+    TEST(json_serialize_to_string_pretty_parallel(NULL, 4) == NULL);
+
+    json_set_allocation_functions(counted_malloc, counted_free);
+}
+
 void print_commits_info(const char *username, const char *repo) {
     JSON_Value *root_value;
     JSON_Array *commits;
@@ -650,6 +2393,9 @@ static void *counted_malloc(size_t size) {
     if (res != NULL) {
         malloc_count++;
     }
+    if (size > malloc_largest) {
+        malloc_largest = size;
+    }
     return res;
 }
 